@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <numbers>
+#include <string>
+#include <vector>
+#include "Culling.h"
+#include "DrawRecording.h"
+#include "DrawSorting.h"
+#include "JobSystem.h"
+#include "LevelOfDetailSelection.h"
+#include "MeshOptimiser.h"
+#include "MeshTextParser.h"
+#include "OcclusionCulling.h"
+#include "VertexCompression.h"
+#if defined(_WIN32)
+#include "stdafx.h"
+#include "MeshLoader.h"
+#endif
+
+// Runs the benchmarks of the modules that use no graphics API and prints their results:
+//     Benchmarks [benchmark...] [--models directory]
+// runs the named benchmarks, or all of them, reading the meshes from directory, Models by default.
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double MillisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // The load time of the text mesh and of a binary of it, the throughput of the text parser against the
+    // iostream loop, and the effect of every mesh processing stage on the meshes, along with the parse time
+    // of a synthetic 50M triangle mesh per thread count.
+    void BenchmarkMeshLoading(const std::filesystem::path& modelsDirectory)
+    {
+        for (const char* modelName : { "skull.txt", "car.txt" })
+        {
+            const std::filesystem::path modelPath = modelsDirectory / modelName;
+#if defined(_WIN32)
+            const MeshLoader::BenchmarkResult result = MeshLoader::Benchmark(modelPath.wstring(), 10);
+            std::printf("%s: text %.3f ms, binary %.3f ms\n", modelName, result.textMilliseconds, result.binaryMilliseconds);
+            const MeshLoader::ParserBenchmarkResult parsers = MeshLoader::BenchmarkParsers(modelPath.wstring(), 10);
+            std::printf("%s: iostream %.1f MB/s, parser %.1f MB/s\n", modelName, parsers.streamMegabytesPerSecond, parsers.parserMegabytesPerSecond);
+#endif
+            std::ifstream file(modelPath, std::ios::binary);
+            if (!file)
+            {
+                std::printf("%s: missing\n", modelName);
+                continue;
+            }
+            const std::string text{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+            MeshData mesh;
+            MeshTextParser::Parse(text, mesh);
+            const MeshOptimiser::WeldReport weld = MeshOptimiser::Weld(mesh);
+            std::printf("%s: weld %zu -> %zu vertices, %zu bytes saved\n", modelName,
+                weld.originalVertexCount, weld.weldedVertexCount, weld.SavedBytes());
+            const MeshOptimiser::VertexCacheReport vertexCache = MeshOptimiser::OptimiseVertexCacheAndFetch(mesh);
+            std::printf("%s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", modelName,
+                vertexCache.before.averageCacheMissRatio, vertexCache.after.averageCacheMissRatio,
+                vertexCache.before.averageTransformToVertexRatio, vertexCache.after.averageTransformToVertexRatio);
+            const VertexCompression::Dequantisation dequantisation = VertexCompression::ComputeDequantisation(mesh.vertices);
+            std::vector<VertexCompression::PackedPositionNormalUV> packed(mesh.vertices.size());
+            const VertexCompression::ErrorBounds packingError = VertexCompression::Encode(mesh.vertices, dequantisation, packed);
+            const VertexCompression::ErrorBounds packingBounds = VertexCompression::GuaranteedBounds(mesh.vertices, dequantisation);
+            std::printf("%s: packed vertices %zu -> %zu bytes, error position %g (bound %g), normal %g rad (bound %g), uv %g (bound %g)\n",
+                modelName, mesh.vertices.size() * sizeof(PositionNormalUV), packed.size() * sizeof(VertexCompression::PackedPositionNormalUV),
+                packingError.position, packingBounds.position, packingError.normal, packingBounds.normal, packingError.uv, packingBounds.uv);
+            const double overdrawBefore = MeshOptimiser::EstimateOverdraw(mesh.indices, mesh.vertices).Overdraw();
+            MeshOptimiser::OptimiseOverdraw(mesh.indices, mesh.vertices);
+            const double overdrawAfter = MeshOptimiser::EstimateOverdraw(mesh.indices, mesh.vertices).Overdraw();
+            std::printf("%s: overdraw %.3f -> %.3f shaded fragments per pixel, ACMR %.3f\n", modelName, overdrawBefore, overdrawAfter,
+                MeshOptimiser::SimulateVertexCache(mesh.indices, mesh.vertices.size()).averageCacheMissRatio);
+            MeshOptimiser::BuildMeshlets(mesh);
+            // Cameras around the bounding box of the mesh, looking at its centre from 16 directions.
+            const XMVECTOR halfExtent = XMVectorScale(XMLoadFloat3(&dequantisation.scale), 0.5f);
+            const XMVECTOR centre = XMVectorAdd(XMLoadFloat3(&dequantisation.offset), halfExtent);
+            const float radius = XMVectorGetX(XMVector3Length(halfExtent));
+            std::size_t culledMeshletCount = 0;
+            const unsigned viewCount = 16;
+            for (unsigned view = 0; view < viewCount; ++view)
+            {
+                const float angle = 2 * std::numbers::pi_v<float> * view / viewCount;
+                const XMVECTOR eye = XMVectorMultiplyAdd(XMVectorSet(std::cos(angle), 0.5f, std::sin(angle), 0), XMVectorReplicate(3 * radius), centre);
+                XMFLOAT4X4 viewProjection;
+                XMStoreFloat4x4(&viewProjection, XMMatrixLookAtLH(eye, centre, XMVectorSet(0, 1, 0, 0)) *
+                    XMMatrixPerspectiveFovLH(0.25f * std::numbers::pi_v<float>, 16.0f / 9, 0.1f * radius, 10 * radius));
+                XMFLOAT3 cameraPosition;
+                XMStoreFloat3(&cameraPosition, eye);
+                XMFLOAT4X4 identity;
+                XMStoreFloat4x4(&identity, XMMatrixIdentity());
+                std::vector<Culling::IndexRange> visible;
+                culledMeshletCount += Culling::CullMeshlets(mesh.meshlets, identity, Culling::ExtractFrustum(viewProjection), cameraPosition, visible);
+            }
+            std::printf("%s: %zu meshlets, %.1f triangles each, %.1f%% culled over %u views, ACMR %.3f\n", modelName,
+                mesh.meshlets.size(), mesh.indices.size() / 3.0 / mesh.meshlets.size(),
+                100.0 * culledMeshletCount / (viewCount * mesh.meshlets.size()), viewCount,
+                MeshOptimiser::SimulateVertexCache(mesh.indices, mesh.vertices.size()).averageCacheMissRatio);
+            const Clock::time_point levelsOfDetailStart = Clock::now();
+            MeshOptimiser::BuildLevelsOfDetail(mesh);
+            std::printf("%s: levels of detail built in %.1f ms\n", modelName, MillisecondsSince(levelsOfDetailStart));
+            for (const LevelOfDetail& level : mesh.levelsOfDetail)
+                std::printf("%s:     %u triangles, error %g\n", modelName, level.indexCount / 3, level.error);
+        }
+        {
+            // Non planar 1M triangle grid, which the simplifier cannot collapse for free.
+            MeshData terrain;
+            MeshTextParser::Parse(MeshTextParser::GenerateSyntheticText(1'000'000), terrain);
+            for (PositionNormalUV& vertex : terrain.vertices)
+                vertex.position.y = 0.1f * std::sin(7 * vertex.position.x) * std::cos(5 * vertex.position.z);
+            const MeshOptimiser::VertexCacheReport vertexCache = MeshOptimiser::OptimiseVertexCacheAndFetch(terrain);
+            std::printf("Terrain %zu triangles: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", terrain.indices.size() / 3,
+                vertexCache.before.averageCacheMissRatio, vertexCache.after.averageCacheMissRatio,
+                vertexCache.before.averageTransformToVertexRatio, vertexCache.after.averageTransformToVertexRatio);
+            const Clock::time_point levelsOfDetailStart = Clock::now();
+            MeshOptimiser::BuildLevelsOfDetail(terrain);
+            std::printf("Terrain %zu triangles: levels of detail built in %.1f ms on %u threads\n", terrain.levelsOfDetail[0].indexCount / 3,
+                MillisecondsSince(levelsOfDetailStart), HardwareThreadCount());
+            const Clock::time_point boundsStart = Clock::now();
+            const Bounds bounds = Culling::ComputeBounds(terrain.vertices);
+            std::printf("Terrain %zu vertices: bounds in %.3f ms, radius %g\n", terrain.vertices.size(), MillisecondsSince(boundsStart),
+                bounds.sphere.radius);
+        }
+        constexpr std::size_t syntheticTriangleCount = 50'000'000;
+        for (const MeshTextParser::ScalingBenchmarkResult& result : MeshTextParser::BenchmarkScaling(syntheticTriangleCount))
+            std::printf("Synthetic %zu triangles: %u threads %.1f ms\n", syntheticTriangleCount, result.threadCount, result.milliseconds);
+    }
+
+    // The cost of selecting the levels of detail of 100k models one at a time against in batches, along with
+    // how often their levels change with and without hysteresis.
+    void BenchmarkLevelOfDetailSelection(const std::filesystem::path&)
+    {
+        const std::size_t modelCount = 100'000;
+        const LevelOfDetailSelection::BenchmarkResult result = LevelOfDetailSelection::Benchmark(modelCount, 240);
+        std::printf("Level of detail selection of %zu models: one at a time %.3f ms, batched %.3f ms, %.1f switches per frame (%.1f without hysteresis), %zu mismatches\n",
+            modelCount, result.scalarMilliseconds, result.batchedMilliseconds, result.switchesPerFrame,
+            result.switchesPerFrameWithoutHysteresis, result.mismatchCount);
+    }
+
+    // The throughput of frustum culling 10k, 100k and 1M bounding spheres one at a time, with SSE and with AVX2.
+    void BenchmarkFrustumCulling(const std::filesystem::path&)
+    {
+        for (std::size_t modelCount : { 10'000, 100'000, 1'000'000 })
+        {
+            const Culling::FrustumBenchmarkResult result = Culling::BenchmarkFrustumCulling(modelCount, 20);
+            std::printf("Frustum culling of %zu models: scalar %.1f, SSE %.1f, AVX2 %.1f models per microsecond, %.1f%% visible\n",
+                modelCount, result.scalarModelsPerMicrosecond, result.sseModelsPerMicrosecond, result.avx2ModelsPerMicrosecond,
+                100 * result.visibleFraction);
+        }
+    }
+
+    // How many draws occlusion culling removes from a generated city of 100k models behind rows of walls,
+    // and the time it takes.
+    void BenchmarkOcclusionCulling(const std::filesystem::path&)
+    {
+        const OcclusionCulling::DenseSceneResult result = OcclusionCulling::BenchmarkDenseScene(100'000);
+        std::printf("Occlusion culling of %zu models behind %zu occluders: %zu of %zu draws left by frustum culling culled, rasterised in %.3f ms, tested in %.3f ms\n",
+            result.modelCount, result.occluderCount, result.occludedCount, result.frustumVisibleCount, result.rasteriseMilliseconds, result.testMilliseconds);
+    }
+
+    // The time to sort the keys of 10k, 100k and 1M draws through std::sort and the radix sort, on one and on
+    // every thread.
+    void BenchmarkDrawSorting(const std::filesystem::path&)
+    {
+        for (std::size_t drawCount : { 10'000, 100'000, 1'000'000 })
+        {
+            const DrawSorting::SortBenchmarkResult result = DrawSorting::Benchmark(drawCount, 10);
+            std::printf("Sorting %zu draw keys: std::sort %.3f ms, radix sort %.3f ms, on %u threads %.3f ms%s\n",
+                drawCount, result.stdSortMilliseconds, result.radixSortMilliseconds, HardwareThreadCount(),
+                result.parallelRadixSortMilliseconds, result.identical ? "" : ", ORDERS DIFFER");
+        }
+    }
+
+    // The time to record 10k, 100k and 1M draws into memory through the recording backend of the render
+    // hardware interface, with and without filtering, and the size of the command streams.
+    void BenchmarkCommandRecording(const std::filesystem::path&)
+    {
+        for (std::size_t drawCount : { 10'000, 100'000, 1'000'000 })
+        {
+            const DrawRecording::RecordingBenchmarkResult result = DrawRecording::Benchmark(drawCount, 10);
+            std::printf("Recording %zu draws: %.1f ns a draw, %zu bytes, filtered %.1f ns a draw, %zu bytes, in %zu chunks in parallel %.1f ns a draw\n",
+                drawCount, result.nanosecondsPerDraw, result.streamBytes, result.filteredNanosecondsPerDraw, result.filteredStreamBytes,
+                result.chunkCount, result.parallelNanosecondsPerDraw);
+        }
+    }
+
+    // The time a job system of 1 to 64 threads takes to run a parallel for over a million small tasks, a tree
+    // of dependent jobs and a hundred thousand empty jobs.
+    void BenchmarkJobSystem(const std::filesystem::path&)
+    {
+        for (unsigned threadCount = 1; threadCount <= 64; threadCount *= 2)
+        {
+            const Jobs::ScalingBenchmarkResult result = Jobs::Benchmark(threadCount, 5);
+            std::printf("Job system of %u threads: parallel for %.2f ms, dependency tree %.2f ms, %.1f ns an empty job\n",
+                result.threadCount, result.parallelForMilliseconds, result.dependencyGraphMilliseconds, result.nanosecondsPerEmptyJob);
+        }
+    }
+
+    struct Benchmark
+    {
+        const char* name;
+        void (*run)(const std::filesystem::path& modelsDirectory);
+    };
+
+    constexpr Benchmark benchmarks[]
+    {
+        { "mesh-loading", BenchmarkMeshLoading },
+        { "level-of-detail-selection", BenchmarkLevelOfDetailSelection },
+        { "frustum-culling", BenchmarkFrustumCulling },
+        { "occlusion-culling", BenchmarkOcclusionCulling },
+        { "draw-sorting", BenchmarkDrawSorting },
+        { "command-recording", BenchmarkCommandRecording },
+        { "job-system", BenchmarkJobSystem }
+    };
+}
+
+int main(int argc, char* argv[])
+{
+    std::filesystem::path modelsDirectory = "Models";
+    std::vector<const Benchmark*> selected;
+    for (int argument = 1; argument < argc; ++argument)
+    {
+        if (std::strcmp(argv[argument], "--models") == 0 && argument + 1 < argc)
+        {
+            modelsDirectory = argv[++argument];
+            continue;
+        }
+        const Benchmark* benchmark = std::find_if(std::begin(benchmarks), std::end(benchmarks),
+            [&](const Benchmark& candidate) { return std::strcmp(candidate.name, argv[argument]) == 0; });
+        if (benchmark == std::end(benchmarks))
+        {
+            std::fprintf(stderr, "Unknown benchmark %s, expected one of:\n", argv[argument]);
+            for (const Benchmark& candidate : benchmarks)
+                std::fprintf(stderr, "    %s\n", candidate.name);
+            return 1;
+        }
+        selected.push_back(benchmark);
+    }
+    if (selected.empty())
+        for (const Benchmark& benchmark : benchmarks)
+            selected.push_back(&benchmark);
+    for (const Benchmark* benchmark : selected)
+        benchmark->run(modelsDirectory);
+    return 0;
+}
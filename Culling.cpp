@@ -0,0 +1,406 @@
+#include "Culling.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <random>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// MSVC compiles intrinsics of any instruction set anywhere, GCC and Clang only in functions targeting it.
+#if defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace Culling
+{
+    namespace
+    {
+        float Dot(const XMFLOAT3& first, const XMFLOAT3& second)
+        {
+            return first.x * second.x + first.y * second.y + first.z * second.z;
+        }
+
+        float Length(const XMFLOAT3& vector)
+        {
+            return std::sqrt(Dot(vector, vector));
+        }
+
+        XMFLOAT3 TransformPoint(const XMFLOAT3& point, const XMFLOAT4X4& matrix)
+        {
+            return
+            {
+                point.x * matrix.m[0][0] + point.y * matrix.m[1][0] + point.z * matrix.m[2][0] + matrix.m[3][0],
+                point.x * matrix.m[0][1] + point.y * matrix.m[1][1] + point.z * matrix.m[2][1] + matrix.m[3][1],
+                point.x * matrix.m[0][2] + point.y * matrix.m[1][2] + point.z * matrix.m[2][2] + matrix.m[3][2]
+            };
+        }
+
+        XMFLOAT3 TransformDirection(const XMFLOAT3& direction, const XMFLOAT4X4& matrix)
+        {
+            return
+            {
+                direction.x * matrix.m[0][0] + direction.y * matrix.m[1][0] + direction.z * matrix.m[2][0],
+                direction.x * matrix.m[0][1] + direction.y * matrix.m[1][1] + direction.z * matrix.m[2][1],
+                direction.x * matrix.m[0][2] + direction.y * matrix.m[1][2] + direction.z * matrix.m[2][2]
+            };
+        }
+
+        float LargestScale(const XMFLOAT4X4& model)
+        {
+            return std::max({ Length({ model.m[0][0], model.m[0][1], model.m[0][2] }),
+                Length({ model.m[1][0], model.m[1][1], model.m[1][2] }), Length({ model.m[2][0], model.m[2][1], model.m[2][2] }) });
+        }
+
+        Plane Normalised(float x, float y, float z, float w)
+        {
+            const float length = std::sqrt(x * x + y * y + z * z);
+            return { { x / length, y / length, z / length }, w / length };
+        }
+
+        // Lanes of every set bit of a mask, lowest first, packed as 3 bit lane numbers in nibbles: the
+        // lanes a compacting store keeps.
+        constexpr std::array<std::uint32_t, 256> setLanes = []()
+        {
+            std::array<std::uint32_t, 256> lanes{};
+            for (std::uint32_t mask = 0; mask < 256; ++mask)
+                for (std::uint32_t lane = 0, count = 0; lane < 8; ++lane)
+                    if (mask & (1 << lane))
+                        lanes[mask] |= lane << (4 * count++);
+            return lanes;
+        }();
+
+        std::size_t CullSpheresScalar(std::span<const Sphere> spheres, const Frustum& frustum, std::span<std::uint32_t> visible,
+            std::size_t firstSphere)
+        {
+            std::size_t visibleCount = 0;
+            for (std::size_t sphere = firstSphere; sphere < spheres.size(); ++sphere)
+            {
+                // Written unconditionally and kept by counting it, without a branch to mispredict.
+                visible[visibleCount] = static_cast<std::uint32_t>(sphere);
+                visibleCount += !SphereOutside(frustum, spheres[sphere].centre, spheres[sphere].radius);
+            }
+            return visibleCount;
+        }
+
+        std::size_t CullSpheresSSE(std::span<const Sphere> spheres, const Frustum& frustum, std::span<std::uint32_t> visible)
+        {
+            std::size_t visibleCount = 0, sphere = 0;
+            for (; sphere + 4 <= spheres.size(); sphere += 4)
+            {
+                // Four spheres, transposed so that each register holds one component of all of them.
+                __m128 x = _mm_loadu_ps(&spheres[sphere].centre.x);
+                __m128 y = _mm_loadu_ps(&spheres[sphere + 1].centre.x);
+                __m128 z = _mm_loadu_ps(&spheres[sphere + 2].centre.x);
+                __m128 radius = _mm_loadu_ps(&spheres[sphere + 3].centre.x);
+                _MM_TRANSPOSE4_PS(x, y, z, radius);
+                const __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+                __m128 outside = _mm_setzero_ps();
+                for (const Plane& plane : frustum.planes)
+                {
+                    const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.normal.x)), _mm_mul_ps(y, _mm_set1_ps(plane.normal.y))),
+                        _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.normal.z)), _mm_set1_ps(plane.distance)));
+                    outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeRadius));
+                }
+                const std::uint32_t lanes = setLanes[~_mm_movemask_ps(outside) & 0xF];
+                const __m128i indices = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(sphere)),
+                    _mm_setr_epi32(lanes & 0xF, lanes >> 4 & 0xF, lanes >> 8 & 0xF, lanes >> 12 & 0xF));
+                // Never past the end: at most sphere indices were written before these four.
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&visible[visibleCount]), indices);
+                visibleCount += std::popcount(static_cast<unsigned>(~_mm_movemask_ps(outside) & 0xF));
+            }
+            return visibleCount + CullSpheresScalar(spheres, frustum, visible.subspan(visibleCount), sphere);
+        }
+
+        TARGET_AVX2 std::size_t CullSpheresAVX2(std::span<const Sphere> spheres, const Frustum& frustum, std::span<std::uint32_t> visible)
+        {
+            const __m256i laneShifts = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+            std::size_t visibleCount = 0, sphere = 0;
+            for (; sphere + 8 <= spheres.size(); sphere += 8)
+            {
+                // Spheres n and n + 4 share a register, then both halves are transposed like four spheres.
+                const Sphere* block = &spheres[sphere];
+                const __m256 rows0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&block[0].centre.x)), _mm_loadu_ps(&block[4].centre.x), 1);
+                const __m256 rows1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&block[1].centre.x)), _mm_loadu_ps(&block[5].centre.x), 1);
+                const __m256 rows2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&block[2].centre.x)), _mm_loadu_ps(&block[6].centre.x), 1);
+                const __m256 rows3 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&block[3].centre.x)), _mm_loadu_ps(&block[7].centre.x), 1);
+                const __m256 xy01 = _mm256_unpacklo_ps(rows0, rows1), zr01 = _mm256_unpackhi_ps(rows0, rows1);
+                const __m256 xy23 = _mm256_unpacklo_ps(rows2, rows3), zr23 = _mm256_unpackhi_ps(rows2, rows3);
+                const __m256 x = _mm256_shuffle_ps(xy01, xy23, _MM_SHUFFLE(1, 0, 1, 0));
+                const __m256 y = _mm256_shuffle_ps(xy01, xy23, _MM_SHUFFLE(3, 2, 3, 2));
+                const __m256 z = _mm256_shuffle_ps(zr01, zr23, _MM_SHUFFLE(1, 0, 1, 0));
+                const __m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_shuffle_ps(zr01, zr23, _MM_SHUFFLE(3, 2, 3, 2)));
+                __m256 outside = _mm256_setzero_ps();
+                for (const Plane& plane : frustum.planes)
+                {
+                    const __m256 distance = _mm256_add_ps(
+                        _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.normal.x)), _mm256_mul_ps(y, _mm256_set1_ps(plane.normal.y))),
+                        _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane.normal.z)), _mm256_set1_ps(plane.distance)));
+                    outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, negativeRadius, _CMP_LT_OQ));
+                }
+                const unsigned visibleMask = ~_mm256_movemask_ps(outside) & 0xFF;
+                const __m256i lanes = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32(static_cast<int>(setLanes[visibleMask])), laneShifts),
+                    _mm256_set1_epi32(0xF));
+                // Never past the end: at most sphere indices were written before these eight.
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(&visible[visibleCount]), _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(sphere)), lanes));
+                visibleCount += std::popcount(visibleMask);
+            }
+            return visibleCount + CullSpheresScalar(spheres, frustum, visible.subspan(visibleCount), sphere);
+        }
+    }
+
+    Bounds ComputeBounds(std::span<const PositionNormalUV> vertices, unsigned threadCount)
+    {
+        if (vertices.empty())
+            return { { { 0, 0, 0 }, { 0, 0, 0 } }, { { 0, 0, 0 }, 0 } };
+        // Positions load as x, y, z and the x of the normal after them, a lane every reduction ignores.
+        constexpr std::size_t chunkVertexCount = 1 << 18;
+        const std::size_t chunkCount = (vertices.size() + chunkVertexCount - 1) / chunkVertexCount;
+        auto chunkOf = [&](std::size_t chunk)
+        {
+            return vertices.subspan(chunk * chunkVertexCount, std::min(chunkVertexCount, vertices.size() - chunk * chunkVertexCount));
+        };
+        std::vector<XMFLOAT4> minima(chunkCount), maxima(chunkCount);
+        ParallelFor(chunkCount, [&](std::size_t chunk)
+        {
+            const std::span<const PositionNormalUV> chunkVertices = chunkOf(chunk);
+            __m128 minimum = _mm_loadu_ps(&chunkVertices[0].position.x), maximum = minimum;
+            for (const PositionNormalUV& vertex : chunkVertices)
+            {
+                const __m128 position = _mm_loadu_ps(&vertex.position.x);
+                minimum = _mm_min_ps(minimum, position);
+                maximum = _mm_max_ps(maximum, position);
+            }
+            _mm_storeu_ps(&minima[chunk].x, minimum);
+            _mm_storeu_ps(&maxima[chunk].x, maximum);
+        }, threadCount);
+        XMFLOAT3 minimum{ minima[0].x, minima[0].y, minima[0].z }, maximum{ maxima[0].x, maxima[0].y, maxima[0].z };
+        for (std::size_t chunk = 1; chunk < chunkCount; ++chunk)
+        {
+            minimum = { std::min(minimum.x, minima[chunk].x), std::min(minimum.y, minima[chunk].y), std::min(minimum.z, minima[chunk].z) };
+            maximum = { std::max(maximum.x, maxima[chunk].x), std::max(maximum.y, maxima[chunk].y), std::max(maximum.z, maxima[chunk].z) };
+        }
+        Bounds bounds;
+        bounds.box.centre = { 0.5f * (minimum.x + maximum.x), 0.5f * (minimum.y + maximum.y), 0.5f * (minimum.z + maximum.z) };
+        bounds.box.extents = { 0.5f * (maximum.x - minimum.x), 0.5f * (maximum.y - minimum.y), 0.5f * (maximum.z - minimum.z) };
+        // Four vertices at a time, transposed so that each register holds one coordinate of all of them.
+        std::vector<float> squaredRadii(chunkCount);
+        ParallelFor(chunkCount, [&](std::size_t chunk)
+        {
+            const std::span<const PositionNormalUV> chunkVertices = chunkOf(chunk);
+            const __m128 centreX = _mm_set1_ps(bounds.box.centre.x);
+            const __m128 centreY = _mm_set1_ps(bounds.box.centre.y);
+            const __m128 centreZ = _mm_set1_ps(bounds.box.centre.z);
+            __m128 largest = _mm_setzero_ps();
+            std::size_t vertex = 0;
+            for (; vertex + 4 <= chunkVertices.size(); vertex += 4)
+            {
+                __m128 x = _mm_loadu_ps(&chunkVertices[vertex].position.x);
+                __m128 y = _mm_loadu_ps(&chunkVertices[vertex + 1].position.x);
+                __m128 z = _mm_loadu_ps(&chunkVertices[vertex + 2].position.x);
+                __m128 unused = _mm_loadu_ps(&chunkVertices[vertex + 3].position.x);
+                _MM_TRANSPOSE4_PS(x, y, z, unused);
+                x = _mm_sub_ps(x, centreX);
+                y = _mm_sub_ps(y, centreY);
+                z = _mm_sub_ps(z, centreZ);
+                largest = _mm_max_ps(largest, _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+            }
+            float lanes[4];
+            _mm_storeu_ps(lanes, largest);
+            float squaredRadius = std::max({ lanes[0], lanes[1], lanes[2], lanes[3] });
+            for (; vertex < chunkVertices.size(); ++vertex)
+            {
+                const XMFLOAT3& position = chunkVertices[vertex].position;
+                const XMFLOAT3 offset{ position.x - bounds.box.centre.x, position.y - bounds.box.centre.y, position.z - bounds.box.centre.z };
+                squaredRadius = std::max(squaredRadius, offset.x * offset.x + offset.y * offset.y + offset.z * offset.z);
+            }
+            squaredRadii[chunk] = squaredRadius;
+        }, threadCount);
+        bounds.sphere = { bounds.box.centre, std::sqrt(*std::max_element(squaredRadii.begin(), squaredRadii.end())) };
+        return bounds;
+    }
+
+    Bounds BoxBounds(const Box& box)
+    {
+        const float radius = std::sqrt(box.extents.x * box.extents.x + box.extents.y * box.extents.y + box.extents.z * box.extents.z);
+        return { box, { box.centre, radius } };
+    }
+
+    Bounds TransformBounds(const Bounds& bounds, const XMFLOAT4X4& model)
+    {
+        // Every world axis of the box spans the local extents projected onto it through the absolute matrix.
+        Bounds world;
+        world.box.centre = TransformPoint(bounds.box.centre, model);
+        const XMFLOAT3& extents = bounds.box.extents;
+        world.box.extents =
+        {
+            extents.x * std::fabs(model.m[0][0]) + extents.y * std::fabs(model.m[1][0]) + extents.z * std::fabs(model.m[2][0]),
+            extents.x * std::fabs(model.m[0][1]) + extents.y * std::fabs(model.m[1][1]) + extents.z * std::fabs(model.m[2][1]),
+            extents.x * std::fabs(model.m[0][2]) + extents.y * std::fabs(model.m[1][2]) + extents.z * std::fabs(model.m[2][2])
+        };
+        world.sphere.centre = TransformPoint(bounds.sphere.centre, model);
+        world.sphere.radius = bounds.sphere.radius * LargestScale(model);
+        return world;
+    }
+
+    Frustum ExtractFrustum(const XMFLOAT4X4& viewProjection)
+    {
+        // Every plane bounds one clip space coordinate against w, e.g. the left one is x >= -w, that is
+        // dot(position, column 0 + column 3) >= 0.
+        const auto& m = viewProjection.m;
+        Frustum frustum;
+        frustum.planes[0] = Normalised(m[0][3] + m[0][0], m[1][3] + m[1][0], m[2][3] + m[2][0], m[3][3] + m[3][0]);
+        frustum.planes[1] = Normalised(m[0][3] - m[0][0], m[1][3] - m[1][0], m[2][3] - m[2][0], m[3][3] - m[3][0]);
+        frustum.planes[2] = Normalised(m[0][3] + m[0][1], m[1][3] + m[1][1], m[2][3] + m[2][1], m[3][3] + m[3][1]);
+        frustum.planes[3] = Normalised(m[0][3] - m[0][1], m[1][3] - m[1][1], m[2][3] - m[2][1], m[3][3] - m[3][1]);
+        frustum.planes[4] = Normalised(m[0][2], m[1][2], m[2][2], m[3][2]);
+        frustum.planes[5] = Normalised(m[0][3] - m[0][2], m[1][3] - m[1][2], m[2][3] - m[2][2], m[3][3] - m[3][2]);
+        return frustum;
+    }
+
+    bool SphereOutside(const Frustum& frustum, const XMFLOAT3& centre, float radius)
+    {
+        for (const Plane& plane : frustum.planes)
+            if (Dot(plane.normal, centre) + plane.distance < -radius)
+                return true;
+        return false;
+    }
+
+    bool SupportsAVX2()
+    {
+        static const bool supported = []()
+        {
+#if defined(_MSC_VER)
+            int registers[4];
+            __cpuid(registers, 0);
+            if (registers[0] < 7)
+                return false;
+            // AVX registers must be enabled by the operating system too, which it reports through XGETBV.
+            __cpuid(registers, 1);
+            const bool avx = (registers[2] & (1 << 27)) != 0 && (registers[2] & (1 << 28)) != 0;
+            if (!avx || (_xgetbv(0) & 6) != 6)
+                return false;
+            __cpuidex(registers, 7, 0);
+            return (registers[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2") != 0;
+#endif
+        }();
+        return supported;
+    }
+
+    std::size_t CullSpheres(std::span<const Sphere> spheres, const Frustum& frustum, std::span<std::uint32_t> visible)
+    {
+        return CullSpheres(spheres, frustum, visible, SupportsAVX2() ? InstructionSet::AVX2 : InstructionSet::SSE);
+    }
+
+    std::size_t CullSpheres(std::span<const Sphere> spheres, const Frustum& frustum, std::span<std::uint32_t> visible,
+        InstructionSet instructionSet)
+    {
+        switch (instructionSet)
+        {
+        case InstructionSet::AVX2:
+            return CullSpheresAVX2(spheres, frustum, visible);
+        case InstructionSet::SSE:
+            return CullSpheresSSE(spheres, frustum, visible);
+        default:
+            return CullSpheresScalar(spheres, frustum, visible, 0);
+        }
+    }
+
+    bool BackFacing(const Meshlet& meshlet, const XMFLOAT3& cameraPosition)
+    {
+        // Conservative over the bounding sphere: the angle between the axis and the direction from the
+        // camera to any point of the sphere stays under 90 degrees minus the cone half angle.
+        const XMFLOAT3 cameraToCentre{ meshlet.centre.x - cameraPosition.x, meshlet.centre.y - cameraPosition.y, meshlet.centre.z - cameraPosition.z };
+        return Dot(cameraToCentre, meshlet.coneAxis) > meshlet.coneCutoff * Length(cameraToCentre) + meshlet.radius;
+    }
+
+    std::size_t CullMeshlets(std::span<const Meshlet> meshlets, const XMFLOAT4X4& model, const Frustum& frustum,
+        const XMFLOAT3& cameraPosition, std::vector<IndexRange>& visible)
+    {
+        const float scales[3] =
+        {
+            Length({ model.m[0][0], model.m[0][1], model.m[0][2] }),
+            Length({ model.m[1][0], model.m[1][1], model.m[1][2] }),
+            Length({ model.m[2][0], model.m[2][1], model.m[2][2] })
+        };
+        const float largestScale = std::max({ scales[0], scales[1], scales[2] });
+        const bool uniformScale = largestScale - std::min({ scales[0], scales[1], scales[2] }) <= 1e-3f * largestScale;
+        std::size_t culledCount = 0;
+        for (const Meshlet& meshlet : meshlets)
+        {
+            Meshlet world = meshlet;
+            world.centre = TransformPoint(meshlet.centre, model);
+            world.radius = meshlet.radius * largestScale;
+            if (SphereOutside(frustum, world.centre, world.radius))
+            {
+                ++culledCount;
+                continue;
+            }
+            if (uniformScale && meshlet.coneCutoff < 1)
+            {
+                const XMFLOAT3 axis = TransformDirection(meshlet.coneAxis, model);
+                const float axisLength = Length(axis);
+                world.coneAxis = { axis.x / axisLength, axis.y / axisLength, axis.z / axisLength };
+                if (BackFacing(world, cameraPosition))
+                {
+                    ++culledCount;
+                    continue;
+                }
+            }
+            if (!visible.empty() && visible.back().startIndex + visible.back().indexCount == meshlet.startIndex)
+                visible.back().indexCount += 3 * meshlet.triangleCount;
+            else
+                visible.push_back({ meshlet.startIndex, 3 * meshlet.triangleCount });
+        }
+        return culledCount;
+    }
+
+    FrustumBenchmarkResult BenchmarkFrustumCulling(std::size_t sphereCount, unsigned iterations)
+    {
+        using Clock = std::chrono::steady_clock;
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> position(-1000, 1000);
+        std::uniform_real_distribution<float> radius(0.5f, 10);
+        std::vector<Sphere> spheres(sphereCount);
+        for (Sphere& sphere : spheres)
+            sphere = { { position(random), position(random), position(random) }, radius(random) };
+        // The camera of the sample, at the origin looking down z, out to the far side of the spheres.
+        XMFLOAT4X4 viewProjection{};
+        const float yScale = 1 / std::tan(0.125f * std::numbers::pi_v<float>), farPlane = 1000, nearPlane = 1;
+        viewProjection.m[0][0] = yScale / (16.0f / 9);
+        viewProjection.m[1][1] = yScale;
+        viewProjection.m[2][2] = farPlane / (farPlane - nearPlane);
+        viewProjection.m[2][3] = 1;
+        viewProjection.m[3][2] = -nearPlane * farPlane / (farPlane - nearPlane);
+        const Frustum frustum = ExtractFrustum(viewProjection);
+        std::vector<std::uint32_t> visible(sphereCount);
+        auto modelsPerMicrosecond = [&](InstructionSet instructionSet, std::size_t& visibleCount)
+        {
+            double bestMicroseconds = std::numeric_limits<double>::max();
+            for (unsigned iteration = 0; iteration < iterations; ++iteration)
+            {
+                const Clock::time_point start = Clock::now();
+                visibleCount = CullSpheres(spheres, frustum, visible, instructionSet);
+                bestMicroseconds = std::min(bestMicroseconds, std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+            }
+            return sphereCount / bestMicroseconds;
+        };
+        FrustumBenchmarkResult result{};
+        std::size_t visibleCount = 0;
+        result.scalarModelsPerMicrosecond = modelsPerMicrosecond(InstructionSet::Scalar, visibleCount);
+        result.sseModelsPerMicrosecond = modelsPerMicrosecond(InstructionSet::SSE, visibleCount);
+        if (SupportsAVX2())
+            result.avx2ModelsPerMicrosecond = modelsPerMicrosecond(InstructionSet::AVX2, visibleCount);
+        result.visibleFraction = sphereCount > 0 ? static_cast<double>(visibleCount) / sphereCount : 0;
+        return result;
+    }
+}
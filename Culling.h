@@ -0,0 +1,79 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include "MeshData.h"
+#include "Parallel.h"
+
+// CPU visibility tests run before draws are recorded. Matrices follow DirectXMath: row vectors
+// (clip = position * viewProjection), left handed, with clip space depth in [0, w].
+namespace Culling
+{
+    // Points p with dot(normal, p) + distance >= 0 are on the inner side.
+    struct Plane
+    {
+        XMFLOAT3 normal;
+        float distance;
+    };
+
+    // Left, right, bottom, top, near and far planes, normalised.
+    struct Frustum
+    {
+        Plane planes[6];
+    };
+
+    struct IndexRange
+    {
+        std::uint32_t startIndex;
+        std::uint32_t indexCount;
+    };
+
+    // Bounding box of the vertices and the sphere around its centre through the farthest of them, reduced
+    // four lanes at a time on up to threadCount threads.
+    Bounds ComputeBounds(std::span<const PositionNormalUV> vertices, unsigned threadCount = HardwareThreadCount());
+    // Bounds of vertices reaching every corner of box, such as those of a grid or a parallelepiped, known
+    // without reading them: the box and the sphere through its corners.
+    Bounds BoxBounds(const Box& box);
+    // Bounds of a mesh drawn with the model matrix: the box around its transformed box and its sphere moved
+    // by the matrix and scaled by its largest axis scale.
+    Bounds TransformBounds(const Bounds& bounds, const XMFLOAT4X4& model);
+    Frustum ExtractFrustum(const XMFLOAT4X4& viewProjection);
+    bool SphereOutside(const Frustum& frustum, const XMFLOAT3& centre, float radius);
+    // Whether every triangle of the meshlet faces away from cameraPosition, in the space of the meshlet.
+    bool BackFacing(const Meshlet& meshlet, const XMFLOAT3& cameraPosition);
+
+    enum class InstructionSet
+    {
+        Scalar, SSE, AVX2
+    };
+
+    // Whether the processor, and the operating system, support AVX2.
+    bool SupportsAVX2();
+    // Writes the index of every sphere that is not outside the frustum to visible, which must hold as many
+    // indices as there are spheres, in order, and returns how many it wrote. Eight spheres are tested at a
+    // time with AVX2 when the processor supports it, four with SSE otherwise.
+    std::size_t CullSpheres(std::span<const Sphere> spheres, const Frustum& frustum, std::span<std::uint32_t> visible);
+    // CullSpheres through the given instruction set, which the processor must support.
+    std::size_t CullSpheres(std::span<const Sphere> spheres, const Frustum& frustum, std::span<std::uint32_t> visible,
+        InstructionSet instructionSet);
+
+    // Appends the index ranges of the meshlets of a mesh drawn with the model matrix that are neither
+    // outside the world space frustum nor back facing from the world space cameraPosition, merging
+    // ranges that follow each other. Normal cones are only tested under uniformly scaled model matrices.
+    // Returns the number of meshlets culled.
+    std::size_t CullMeshlets(std::span<const Meshlet> meshlets, const XMFLOAT4X4& model, const Frustum& frustum,
+        const XMFLOAT3& cameraPosition, std::vector<IndexRange>& visible);
+
+    struct FrustumBenchmarkResult
+    {
+        double scalarModelsPerMicrosecond;
+        double sseModelsPerMicrosecond;
+        // 0 when the processor does not support AVX2.
+        double avx2ModelsPerMicrosecond;
+        double visibleFraction;
+    };
+
+    // Throughput of CullSpheres through every instruction set over sphereCount spheres scattered around a
+    // camera looking down one axis, the best of iterations runs each.
+    FrustumBenchmarkResult BenchmarkFrustumCulling(std::size_t sphereCount, unsigned iterations);
+}
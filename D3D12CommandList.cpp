@@ -0,0 +1,78 @@
+#include "stdafx.h"
+#include "D3D12CommandList.h"
+#include <array>
+#include <cstddef>
+
+namespace Rhi
+{
+    static_assert(sizeof(VertexBufferView) == sizeof(D3D12_VERTEX_BUFFER_VIEW)
+        && offsetof(VertexBufferView, sizeInBytes) == offsetof(D3D12_VERTEX_BUFFER_VIEW, SizeInBytes)
+        && offsetof(VertexBufferView, strideInBytes) == offsetof(D3D12_VERTEX_BUFFER_VIEW, StrideInBytes));
+    static_assert(sizeof(IndexBufferView) == sizeof(D3D12_INDEX_BUFFER_VIEW)
+        && offsetof(IndexBufferView, sizeInBytes) == offsetof(D3D12_INDEX_BUFFER_VIEW, SizeInBytes)
+        && offsetof(IndexBufferView, format) == offsetof(D3D12_INDEX_BUFFER_VIEW, Format));
+    static_assert(static_cast<DXGI_FORMAT>(IndexFormat::Uint16) == DXGI_FORMAT_R16_UINT
+        && static_cast<DXGI_FORMAT>(IndexFormat::Uint32) == DXGI_FORMAT_R32_UINT);
+    static_assert(static_cast<D3D12_PRIMITIVE_TOPOLOGY>(PrimitiveTopology::TriangleList) == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST
+        && static_cast<D3D12_PRIMITIVE_TOPOLOGY>(PrimitiveTopology::TriangleStrip) == D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+
+    void D3D12CommandList::SetPipelineState(PipelineState* pipelineState)
+    {
+        commandList->SetPipelineState(reinterpret_cast<ID3D12PipelineState*>(pipelineState));
+    }
+
+    void D3D12CommandList::SetGraphicsRootSignature(RootSignature* rootSignature)
+    {
+        commandList->SetGraphicsRootSignature(reinterpret_cast<ID3D12RootSignature*>(rootSignature));
+    }
+
+    void D3D12CommandList::SetGraphicsRootConstantBufferView(std::uint32_t rootParameterIndex, GpuAddress bufferLocation)
+    {
+        commandList->SetGraphicsRootConstantBufferView(rootParameterIndex, bufferLocation);
+    }
+
+    void D3D12CommandList::SetGraphicsRootShaderResourceView(std::uint32_t rootParameterIndex, GpuAddress bufferLocation)
+    {
+        commandList->SetGraphicsRootShaderResourceView(rootParameterIndex, bufferLocation);
+    }
+
+    void D3D12CommandList::SetGraphicsRootDescriptorTable(std::uint32_t rootParameterIndex, DescriptorHandle baseDescriptor)
+    {
+        commandList->SetGraphicsRootDescriptorTable(rootParameterIndex, D3D12_GPU_DESCRIPTOR_HANDLE{ baseDescriptor.ptr });
+    }
+
+    void D3D12CommandList::SetDescriptorHeaps(std::uint32_t descriptorHeapCount, DescriptorHeap* const* descriptorHeaps)
+    {
+        // At most one heap of shader resources and one of samplers can be set.
+        std::array<ID3D12DescriptorHeap*, 2> heaps;
+        for (std::uint32_t heapIndex = 0; heapIndex < descriptorHeapCount; ++heapIndex)
+            heaps[heapIndex] = reinterpret_cast<ID3D12DescriptorHeap*>(descriptorHeaps[heapIndex]);
+        commandList->SetDescriptorHeaps(descriptorHeapCount, heaps.data());
+    }
+
+    void D3D12CommandList::IASetVertexBuffers(std::uint32_t startSlot, std::uint32_t viewCount, const VertexBufferView* views)
+    {
+        commandList->IASetVertexBuffers(startSlot, viewCount, reinterpret_cast<const D3D12_VERTEX_BUFFER_VIEW*>(views));
+    }
+
+    void D3D12CommandList::IASetIndexBuffer(const IndexBufferView* view)
+    {
+        commandList->IASetIndexBuffer(reinterpret_cast<const D3D12_INDEX_BUFFER_VIEW*>(view));
+    }
+
+    void D3D12CommandList::IASetPrimitiveTopology(PrimitiveTopology primitiveTopology)
+    {
+        commandList->IASetPrimitiveTopology(static_cast<D3D12_PRIMITIVE_TOPOLOGY>(primitiveTopology));
+    }
+
+    void D3D12CommandList::OMSetStencilRef(std::uint32_t stencilReference)
+    {
+        commandList->OMSetStencilRef(stencilReference);
+    }
+
+    void D3D12CommandList::DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+        std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation)
+    {
+        commandList->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+    }
+}
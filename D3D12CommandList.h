@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Rhi.h"
+
+namespace Rhi
+{
+    // Records the commands into a D3D12 graphics command list, whose objects the Rhi ones are.
+    class D3D12CommandList final : public CommandList
+    {
+    public:
+        explicit D3D12CommandList(ID3D12GraphicsCommandList* commandList = nullptr) : commandList(commandList) {}
+
+        void SetPipelineState(PipelineState* pipelineState) override;
+        void SetGraphicsRootSignature(RootSignature* rootSignature) override;
+        void SetGraphicsRootConstantBufferView(std::uint32_t rootParameterIndex, GpuAddress bufferLocation) override;
+        void SetGraphicsRootShaderResourceView(std::uint32_t rootParameterIndex, GpuAddress bufferLocation) override;
+        void SetGraphicsRootDescriptorTable(std::uint32_t rootParameterIndex, DescriptorHandle baseDescriptor) override;
+        void SetDescriptorHeaps(std::uint32_t descriptorHeapCount, DescriptorHeap* const* descriptorHeaps) override;
+        void IASetVertexBuffers(std::uint32_t startSlot, std::uint32_t viewCount, const VertexBufferView* views) override;
+        void IASetIndexBuffer(const IndexBufferView* view) override;
+        void IASetPrimitiveTopology(PrimitiveTopology primitiveTopology) override;
+        void OMSetStencilRef(std::uint32_t stencilReference) override;
+        void DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+            std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation) override;
+
+    private:
+        ID3D12GraphicsCommandList* commandList;
+    };
+
+    inline PipelineState* ToRhi(ID3D12PipelineState* pipelineState)
+    {
+        return reinterpret_cast<PipelineState*>(pipelineState);
+    }
+
+    inline RootSignature* ToRhi(ID3D12RootSignature* rootSignature)
+    {
+        return reinterpret_cast<RootSignature*>(rootSignature);
+    }
+
+    inline DescriptorHeap* ToRhi(ID3D12DescriptorHeap* descriptorHeap)
+    {
+        return reinterpret_cast<DescriptorHeap*>(descriptorHeap);
+    }
+
+    inline DescriptorHandle ToRhi(D3D12_GPU_DESCRIPTOR_HANDLE handle)
+    {
+        return { handle.ptr };
+    }
+
+    inline VertexBufferView ToRhi(const D3D12_VERTEX_BUFFER_VIEW& view)
+    {
+        return { view.BufferLocation, view.SizeInBytes, view.StrideInBytes };
+    }
+
+    inline IndexBufferView ToRhi(const D3D12_INDEX_BUFFER_VIEW& view)
+    {
+        return { view.BufferLocation, view.SizeInBytes, static_cast<IndexFormat>(view.Format) };
+    }
+}
@@ -11,6 +11,21 @@
 
 #include "stdafx.h"
 #include "D3D12HelloProject.h"
+#include <cstdarg>
+
+namespace
+{
+    // Writes a diagnostic line, formatted as by swprintf, to the debugger.
+    void LogDiagnostic(_Printf_format_string_ const wchar_t* format, ...)
+    {
+        WCHAR message[256];
+        va_list arguments;
+        va_start(arguments, format);
+        vswprintf_s(message, format, arguments);
+        va_end(arguments);
+        OutputDebugStringW(message);
+    }
+}
 
 D3D12HelloProject::D3D12HelloProject(UINT width, UINT height, std::wstring name) :
     DXSample(width, height, name),
@@ -18,9 +33,12 @@ D3D12HelloProject::D3D12HelloProject(UINT width, UINT height, std::wstring name)
     viewport(0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height)),
     scissorRect(0, 0, static_cast<LONG>(width), static_cast<LONG>(height)),
     renderTargetViewDescriptorSize{}, depthStencilViewDescriptorSize{}, shaderBufferResourceViewsDescriptorSize{},
-    meshes{}, models{}, perSceneBuffer{},
+    meshes{}, models{}, perSceneBuffer{}, visibleModelIndices{}, visibleModelCount{}, drawKeys{},
+    instanceBuffer{}, instanceGroups{}, instanceGroupCount{},
+    hierarchicalDepthReadbacks{}, hierarchicalDepthRectangles{},
     channelStencilTexture{},
-    shaderResourceViewDefaultBuffers{}, shaderResourceViewUploadBuffers{}
+    shaderResourceViewDefaultBuffers{}, shaderResourceViewUploadBuffers{},
+    fenceValue{}, frameFenceValues{}
 {
 }
 
@@ -28,10 +46,15 @@ void D3D12HelloProject::OnInit()
 {
     LoadPipeline();
     LoadAssets();
-    ThrowIfFailed(commandList->Close());
-    ID3D12CommandList* ppCommandLists[] = { commandList.Get() };
+    ThrowIfFailed(recordingContexts[0]->commandList->Close());
+    ID3D12CommandList* ppCommandLists[] = { recordingContexts[0]->commandList.Get() };
     commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
-    WaitForPreviousFrame();
+    // The upload buffers of the textures are done with once the copies just submitted are, which the value
+    // signalled after them marks.
+    const UINT64 copiesFenceValue = Signal();
+    for (ComPtr<ID3D12Resource>& uploadBuffer : shaderResourceViewUploadBuffers)
+        deletionQueue.Retire(std::move(uploadBuffer), copiesFenceValue);
+    WaitForFence(copiesFenceValue);
 }
 
 // Load the rendering pipeline dependencies.
@@ -133,12 +156,12 @@ void D3D12HelloProject::LoadPipeline()
         heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
         ThrowIfFailed(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&depthStencilViewHeap)));
 
-        heapDesc.NumDescriptors = modelCount + 1;
+        heapDesc.NumDescriptors = frameCount;
         heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
         heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
         ThrowIfFailed(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&constantBufferViewHeap)));
 
-        heapDesc.NumDescriptors = textureCount + 2;
+        heapDesc.NumDescriptors = textureCount + 3;
         heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
         heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
         ThrowIfFailed(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&shaderResourceViewHeap)));
@@ -156,8 +179,6 @@ void D3D12HelloProject::LoadPipeline()
             rtvHandle.Offset(1, renderTargetViewDescriptorSize);
         }
     }
-
-    ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&commandAllocator)));
 }
 
 // Load the sample assets.
@@ -180,7 +201,7 @@ void D3D12HelloProject::LoadAssets()
         std::array<CD3DX12_ROOT_PARAMETER1, 4> rootParameters;
         perSceneConstantBufferTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
         rootParameters[0].InitAsDescriptorTable(1, &perSceneConstantBufferTable);
-        rootParameters[1].InitAsConstantBufferView(1, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC);
+        rootParameters[DrawRecording::instancesRootParameter].InitAsShaderResourceView(4, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE);
         channelStencilShaderResourceTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE);
         rootParameters[2].InitAsDescriptorTable(1, &channelStencilShaderResourceTable, D3D12_SHADER_VISIBILITY_PIXEL);
         textureTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 3, 1, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
@@ -234,7 +255,12 @@ void D3D12HelloProject::LoadAssets()
 #endif
 
         ComPtr<ID3DBlob> errorBlob = nullptr;
-        D3DCompileFromFile(GetAssetFullPath(L"Lit.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, "Vertex", "vs_5_1", compileFlags, 0, &vertexShader, &errorBlob);
+#if USE_PACKED_VERTICES
+        LPCSTR vertexShaderEntryPoint = "PackedVertex";
+#else
+        LPCSTR vertexShaderEntryPoint = "Vertex";
+#endif
+        D3DCompileFromFile(GetAssetFullPath(L"Lit.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, vertexShaderEntryPoint, "vs_5_1", compileFlags, 0, &vertexShader, &errorBlob);
         if (errorBlob != nullptr)
         {
             OutputDebugStringA((char*)errorBlob->GetBufferPointer());
@@ -264,12 +290,21 @@ void D3D12HelloProject::LoadAssets()
         }
 
         // Define the vertex input layout.
+#if USE_PACKED_VERTICES
+        D3D12_INPUT_ELEMENT_DESC inputElementDescs[] =
+        {
+            { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+            { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+            { "UV", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+        };
+#else
         D3D12_INPUT_ELEMENT_DESC inputElementDescs[] =
         {
             { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
             { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
             { "UV", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
         };
+#endif
 
         
 
@@ -323,51 +358,39 @@ void D3D12HelloProject::LoadAssets()
             IID_PPV_ARGS(&pipelineStates[static_cast<size_t>(RenderLayer::Transparent)])));
     }
 
-    ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, commandAllocator.Get(), nullptr, IID_PPV_ARGS(&commandList)));
-    ThrowIfFailed(CreateDDSTextureFromFile12(device.Get(), commandList.Get(), L"Textures/tile.dds",
+    ID3D12GraphicsCommandList* commandList = AddRecordingContext().commandList.Get();
+    ThrowIfFailed(CreateDDSTextureFromFile12(device.Get(), commandList, L"Textures/tile.dds",
         shaderResourceViewDefaultBuffers[0], shaderResourceViewUploadBuffers[0]));
-    ThrowIfFailed(CreateDDSTextureFromFile12(device.Get(), commandList.Get(), L"Textures/bricks2.dds",
+    ThrowIfFailed(CreateDDSTextureFromFile12(device.Get(), commandList, L"Textures/bricks2.dds",
         shaderResourceViewDefaultBuffers[1], shaderResourceViewUploadBuffers[1]));
-    ThrowIfFailed(CreateDDSTextureFromFile12(device.Get(), commandList.Get(), L"Textures/checkboard.dds",
+    ThrowIfFailed(CreateDDSTextureFromFile12(device.Get(), commandList, L"Textures/checkboard.dds",
         shaderResourceViewDefaultBuffers[2], shaderResourceViewUploadBuffers[2]));
 
-
-    std::ifstream meshLoader("Models/skull.txt");
-    std::string ignore;
-    UINT triangleCount;
-    UINT vertexCount;
-    meshLoader >> ignore >> vertexCount;
-    meshLoader >> ignore >> triangleCount;
-    meshLoader >> ignore >> ignore >> ignore >> ignore;
-    std::vector<PositionNormalUV> vertices(vertexCount);
-    for (UINT i = 0; i < vertexCount; ++i)
-    {
-        meshLoader >> vertices[i].position.x >> vertices[i].position.y >> vertices[i].position.z;
-        meshLoader >> vertices[i].normal.x >> vertices[i].normal.y >> vertices[i].normal.z;
-        vertices[i].uv = { 0.0f, 0.0f };
-    }
-    meshLoader >> ignore >> ignore >> ignore;
-    std::vector<UINT> indices(3 * triangleCount);
-    for (UINT i = 0; i < triangleCount; ++i)
-    {
-        meshLoader >> indices[i * 3U + 0] >> indices[i * 3U + 1] >> indices[i * 3U + 2];
-    }
-    meshLoader.close(); 
-    //MeshData skull{ vertices , indices };
-    MeshData grid{}, cube{};
-    CreateGrid(3, 3, 2, 2, grid);
-    CreateParallelepiped(1, 1, 1, cube);
-    CreateMesh(grid, meshes[static_cast<size_t>(MeshType::Grid)]);
-    CreateMesh(cube, meshes[static_cast<size_t>(MeshType::Parallelepiped)]);
-    //CreateMesh(skull, meshes[static_cast<size_t>(MeshType::Skull)]);
+    CreateMesh(GridCounts(2, 2), [this](auto grid) { return CreateGrid(3, 3, 2, 2, grid); },
+        meshes[static_cast<size_t>(MeshType::Grid)]);
+    CreateMesh(ParallelepipedCounts(), [this](auto cube) { return CreateParallelepiped(1, 1, 1, cube); },
+        meshes[static_cast<size_t>(MeshType::Parallelepiped)]);
+    // The bounding box of the flat grid, like that of the parallelepiped, is exactly its surface.
+    for (MeshType occluderType : { MeshType::Grid, MeshType::Parallelepiped })
+    {
+        Mesh& mesh = meshes[static_cast<size_t>(occluderType)];
+        mesh.occluder = OcclusionCulling::MakeOccluderMesh(mesh.bounds.box);
+    }
+    MeshLoader::MeshSource skull(L"Models/skull.txt", { .weld = true, .optimiseVertexCache = true, .optimiseOverdraw = true,
+        .buildMeshlets = true, .buildLevelsOfDetail = true });
+    Mesh& skullMesh = meshes[static_cast<size_t>(MeshType::Skull)];
+    CreateMesh(skull.Counts(), [&skull](auto destination) { return skull.Produce(destination); }, skullMesh);
+    skullMesh.meshlets.assign(skull.Meshlets().begin(), skull.Meshlets().end());
+    skullMesh.levelsOfDetail.assign(skull.LevelsOfDetail().begin(), skull.LevelsOfDetail().end());
     CD3DX12_CPU_DESCRIPTOR_HANDLE constantBufferDescriptorHandle(constantBufferViewHeap->GetCPUDescriptorHandleForHeapStart());
     CreateConstantBuffer(constantBufferDescriptorHandle, perSceneBuffer);
+    CreateWriteBuffer(instanceBuffer);
     for (size_t meshIndex = 0, firstModelPerMeshIndex = 0; meshIndex < meshCount; firstModelPerMeshIndex += modelsPerMesh[meshIndex++])
         for (size_t modelIndex = firstModelPerMeshIndex; modelIndex < modelsPerMesh[meshIndex] + firstModelPerMeshIndex; ++modelIndex)
         {
             models[modelIndex].mesh = &meshes[meshIndex];
-            CreateConstantBuffer(constantBufferDescriptorHandle, models[modelIndex].buffer);     
             models[modelIndex].renderLayer = RenderLayer::Transparent;
+            models[modelIndex].levelOfDetail = 0;
         }
     auto& perSceneData = perSceneBuffer.data.data;
     perSceneData.cameraPosition = { 0, 1, -5 };
@@ -375,7 +398,7 @@ void D3D12HelloProject::LoadAssets()
     cameraRight = { 1, 0, 0 };
     cameraUp = { 0, 1, 0 };
     XMMATRIX cameraView = XMMatrixLookToLH(XMLoadFloat3(&perSceneBuffer.data.data.cameraPosition), XMLoadFloat3(&cameraForward), XMLoadFloat3(&cameraUp));
-    XMMATRIX cameraProjection = XMMatrixPerspectiveFovLH(0.25f * std::numbers::pi_v<float>, m_aspectRatio, 1, 1000);
+    XMMATRIX cameraProjection = XMMatrixPerspectiveFovLH(0.25f * std::numbers::pi_v<float>, m_aspectRatio, cameraNearPlane, cameraFarPlane);
     perSceneBuffer.data.data.viewProjection = XMMatrixTranspose(cameraView * cameraProjection);
     //perSceneData.ambientalLight.downColour = { 1, 0, 0 };
     //perSceneData.ambientalLight.colourDifference = { -1, 1, 0 };
@@ -395,39 +418,48 @@ void D3D12HelloProject::LoadAssets()
     perSceneData.capsuleLights.normalizedSegmentStartToSegmentEnd = { 1, 0, 0 };
     perSceneData.capsuleLights.segmentLength = 2;
     perSceneData.capsuleLights.rangeReciprocal = 1;*/
-    perSceneBuffer.Update();
+    perSceneBuffer.Update(frameIndex);
     for (size_t modelIndex = 0; modelIndex < modelCount; ++modelIndex)
     {
-        auto& perModelData = models[modelIndex].buffer.data.data;
-        perModelData.textureTransform = XMMatrixTranspose(XMMatrixIdentity());
-        XMStoreFloat4(&perModelData.diffuseColour, Colors::White);
-        perModelData.diffuseColour.w = 0.5f;
-        perModelData.specularExponent = 100;
-        perModelData.specularIntensity = 10;
-    }
-    models[0].buffer.data.data.model = XMMatrixTranspose(XMMatrixTranslation(0, 1.5f, 0) * XMMatrixTranslation(0, 0, 10));
-    models[1].buffer.data.data.model = XMMatrixTranspose(XMMatrixRotationZ(-std::numbers::pi_v<float> / 2) * XMMatrixTranslation(1.5f, 0, 0) * XMMatrixTranslation(0, 0, 10));
-    models[2].buffer.data.data.model = XMMatrixTranspose(XMMatrixRotationX(std::numbers::pi_v<float> / 2) * XMMatrixTranslation(0, 0, 1.5f) * XMMatrixTranslation(0, 0, 10));
-    models[3].buffer.data.data.model = XMMatrixTranspose(XMMatrixRotationZ(std::numbers::pi_v<float>) * XMMatrixTranslation(0, -1.5f, 0) * XMMatrixTranslation(0, 0, 10));
-    models[4].buffer.data.data.model = XMMatrixTranspose(XMMatrixRotationZ(std::numbers::pi_v<float> / 2) * XMMatrixTranslation(-1.5f, 0, 0) * XMMatrixTranslation(0, 0, 10));
-    models[5].buffer.data.data.model = XMMatrixTranspose(XMMatrixRotationX(-std::numbers::pi_v<float> / 2) * XMMatrixTranslation(0, 0, -1.5f) * XMMatrixTranslation(0, 0, 10));
+        PerInstance& instanceData = models[modelIndex].instance;
+        instanceData.textureTransform = XMMatrixTranspose(XMMatrixIdentity());
+        XMStoreFloat4(&instanceData.diffuseColour, Colors::White);
+        instanceData.diffuseColour.w = 0.5f;
+        instanceData.specularExponent = 100;
+        instanceData.specularIntensity = 10;
+        const VertexCompression::Dequantisation& positionDequantisation = models[modelIndex].mesh->positionDequantisation;
+        instanceData.positionScale = { positionDequantisation.scale.x, positionDequantisation.scale.y, positionDequantisation.scale.z, 0 };
+        instanceData.positionOffset = { positionDequantisation.offset.x, positionDequantisation.offset.y, positionDequantisation.offset.z, 0 };
+    }
+    models[0].SetModelMatrix(XMMatrixTranslation(0, 1.5f, 0) * XMMatrixTranslation(0, 0, 10));
+    models[1].SetModelMatrix(XMMatrixRotationZ(-std::numbers::pi_v<float> / 2) * XMMatrixTranslation(1.5f, 0, 0) * XMMatrixTranslation(0, 0, 10));
+    models[2].SetModelMatrix(XMMatrixRotationX(std::numbers::pi_v<float> / 2) * XMMatrixTranslation(0, 0, 1.5f) * XMMatrixTranslation(0, 0, 10));
+    models[3].SetModelMatrix(XMMatrixRotationZ(std::numbers::pi_v<float>) * XMMatrixTranslation(0, -1.5f, 0) * XMMatrixTranslation(0, 0, 10));
+    models[4].SetModelMatrix(XMMatrixRotationZ(std::numbers::pi_v<float> / 2) * XMMatrixTranslation(-1.5f, 0, 0) * XMMatrixTranslation(0, 0, 10));
+    models[5].SetModelMatrix(XMMatrixRotationX(-std::numbers::pi_v<float> / 2) * XMMatrixTranslation(0, 0, -1.5f) * XMMatrixTranslation(0, 0, 10));
     for (size_t modelIndex = 6; modelIndex < 9; ++modelIndex)
         models[modelIndex].renderLayer = RenderLayer::ChannelStencilReader;
-    XMStoreFloat4(&models[6].buffer.data.data.diffuseColour, Colors::Red);
-    models[6].buffer.data.data.model = XMMatrixTranspose(XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixTranslation(-1, 0, 0) * XMMatrixTranslation(0, 0, 10));
-    XMStoreFloat4(&models[7].buffer.data.data.diffuseColour, Colors::Green);
-    models[7].buffer.data.data.model = XMMatrixTranspose(XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixTranslation(0, 0, 10));
-    XMStoreFloat4(&models[8].buffer.data.data.diffuseColour, Colors::Blue);
-    models[8].buffer.data.data.model = XMMatrixTranspose(XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixTranslation(1, 0, 0) * XMMatrixTranslation(0, 0, 10));
-    XMStoreFloat4(&models[9].buffer.data.data.diffuseColour, Colors::White);
+    XMStoreFloat4(&models[6].instance.diffuseColour, Colors::Red);
+    models[6].SetModelMatrix(XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixTranslation(-1, 0, 0) * XMMatrixTranslation(0, 0, 10));
+    XMStoreFloat4(&models[7].instance.diffuseColour, Colors::Green);
+    models[7].SetModelMatrix(XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixTranslation(0, 0, 10));
+    XMStoreFloat4(&models[8].instance.diffuseColour, Colors::Blue);
+    models[8].SetModelMatrix(XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixTranslation(1, 0, 0) * XMMatrixTranslation(0, 0, 10));
+    XMStoreFloat4(&models[9].instance.diffuseColour, Colors::White);
     models[9].renderLayer = RenderLayer::Opaque;
-    models[9].buffer.data.data.model = XMMatrixTranspose(XMMatrixScaling(0.3f, 0.3f, 0.3f));
-    for (size_t modelIndex = 0; modelIndex < modelCount; ++modelIndex)
-        models[modelIndex].buffer.Update();
-    std::sort(models.begin(), models.end(), [](const Model& first, const Model& second)
+    models[9].SetModelMatrix(XMMatrixScaling(0.3f, 0.3f, 0.3f));
+    // Skulls ever further away, so that they are drawn from ever coarser levels of detail, the nearest one
+    // culled meshlet by meshlet.
+    const std::array<XMFLOAT3, modelsPerMesh[static_cast<size_t>(MeshType::Skull)]> skullPositions{ {
+        { -3, 0, 6 }, { 4, 0, 25 }, { 0, 0, 90 } } };
+    for (size_t skullIndex = 0; skullIndex < skullPositions.size(); ++skullIndex)
     {
-        return first.renderLayer < second.renderLayer;
-    });
+        Model& model = models[10 + skullIndex];
+        model.renderLayer = RenderLayer::Opaque;
+        XMStoreFloat4(&model.instance.diffuseColour, Colors::Ivory);
+        model.SetModelMatrix(XMMatrixScaling(0.2f, 0.2f, 0.2f) * XMMatrixTranslation(
+            skullPositions[skullIndex].x, skullPositions[skullIndex].y, skullPositions[skullIndex].z));
+    }
 
     D3D12_RESOURCE_DESC channelStencilTextureDescription;
     ZeroMemory(&channelStencilTextureDescription, sizeof(D3D12_RESOURCE_DESC));
@@ -493,7 +525,7 @@ void D3D12HelloProject::LoadAssets()
     CD3DX12_CPU_DESCRIPTOR_HANDLE depthStencilViewDescriptorHandle(depthStencilViewHeap->GetCPUDescriptorHandleForHeapStart());
     D3D12_RESOURCE_DESC depthStencilDescription = {};
     depthStencilDescription.MipLevels = 1;
-    depthStencilDescription.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+    depthStencilDescription.Format = DXGI_FORMAT_R24G8_TYPELESS;
     depthStencilDescription.Width = m_width;
     depthStencilDescription.Height = m_height;
     depthStencilDescription.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
@@ -525,23 +557,51 @@ void D3D12HelloProject::LoadAssets()
     channelStencilDepthStencilViewDescription.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
     channelStencilDepthStencilViewDescription.Texture2D.MipSlice = 0;
     device->CreateDepthStencilView(channelStencilTexture.Get(), &channelStencilDepthStencilViewDescription, depthStencilViewDescriptorHandle);
+    D3D12_SHADER_RESOURCE_VIEW_DESC depthShaderResourceViewDescription = {};
+    depthShaderResourceViewDescription.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    depthShaderResourceViewDescription.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+    depthShaderResourceViewDescription.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+    depthShaderResourceViewDescription.Texture2D.MostDetailedMip = 0;
+    depthShaderResourceViewDescription.Texture2D.MipLevels = 1;
+    depthShaderResourceViewDescription.Texture2D.ResourceMinLODClamp = 0.0f;
+    depthShaderResourceViewDescription.Texture2D.PlaneSlice = 0;
+    device->CreateShaderResourceView(depthStencilBuffer.Get(), &depthShaderResourceViewDescription, shaderResourceViewDescriptorHandle);
+    CreateHierarchicalDepth();
 
     ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)));
-    fenceValue = 1;
     fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
     if (fenceEvent == nullptr)
     {
         ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
     }
-    WaitForPreviousFrame();
+    WaitForGpu();
+}
+
+MeshCounts D3D12HelloProject::ParallelepipedCounts()
+{
+    return { 24, 36 };
+}
+
+MeshCounts D3D12HelloProject::GridCounts(UINT vertexColumnCount, UINT vertexRowsCount)
+{
+    const UINT verticesPerCell = 6;
+    return { vertexColumnCount * vertexRowsCount, (vertexColumnCount - 1) * (vertexRowsCount - 1) * verticesPerCell };
 }
 
 void D3D12HelloProject::CreateParallelepiped(float width, float height, float depth, MeshData& parallelepiped)
 {
-    std::vector<PositionNormalUV>& vertices = parallelepiped.vertices;
-    vertices.resize(24);
-    std::vector<UINT>& indices = parallelepiped.indices;
-    indices.resize(36);
+    const MeshCounts counts = ParallelepipedCounts();
+    parallelepiped.vertices.resize(counts.vertexCount);
+    parallelepiped.indices.resize(counts.indexCount);
+    CreateParallelepiped(width, height, depth, MeshSpans<std::uint32_t>{ parallelepiped.vertices, parallelepiped.indices });
+}
+
+template<typename Index>
+Bounds D3D12HelloProject::CreateParallelepiped(float width, float height, float depth, MeshSpans<Index> parallelepiped)
+{
+    std::span<PositionNormalUV> vertices = parallelepiped.vertices;
+    std::span<Index> indices = parallelepiped.indices;
+    assert(vertices.size() == ParallelepipedCounts().vertexCount && indices.size() == ParallelepipedCounts().indexCount);
     float halfWidth = 0.5f * width;
     float halfHeight = 0.5f * height;
     float halfDepth = 0.5f * depth;
@@ -584,9 +644,19 @@ void D3D12HelloProject::CreateParallelepiped(float width, float height, float de
     vertices[23] = { {  halfWidth, -halfHeight,  halfDepth }, right, bottomRight };
     indices[30] = 20; indices[31] = 21; indices[32] = 22;
     indices[33] = 20; indices[34] = 22; indices[35] = 23;
+    return Culling::BoxBounds({ { 0, 0, 0 }, { halfWidth, halfHeight, halfDepth } });
 }
 
 void D3D12HelloProject::CreateGrid(float width, float depth, UINT vertexColumnCount, UINT vertexRowsCount, MeshData& grid)
+{
+    const MeshCounts counts = GridCounts(vertexColumnCount, vertexRowsCount);
+    grid.vertices.resize(counts.vertexCount);
+    grid.indices.resize(counts.indexCount);
+    CreateGrid(width, depth, vertexColumnCount, vertexRowsCount, MeshSpans<std::uint32_t>{ grid.vertices, grid.indices });
+}
+
+template<typename Index>
+Bounds D3D12HelloProject::CreateGrid(float width, float depth, UINT vertexColumnCount, UINT vertexRowsCount, MeshSpans<Index> grid)
 {
     float halfWidth = 0.5f * width;
     float halfDepth = 0.5f * depth;
@@ -594,8 +664,8 @@ void D3D12HelloProject::CreateGrid(float width, float depth, UINT vertexColumnCo
     float cellDepth = depth / (vertexRowsCount - 1);
     float cellU = 1.0f / (vertexColumnCount - 1);
     float cellV = 1.0f / (vertexRowsCount - 1);
-    std::vector<PositionNormalUV>& vertices = grid.vertices;
-    vertices.resize(vertexColumnCount * vertexRowsCount);
+    std::span<PositionNormalUV> vertices = grid.vertices;
+    assert(vertices.size() == GridCounts(vertexColumnCount, vertexRowsCount).vertexCount);
     for (UINT vertexRow = 0; vertexRow < vertexRowsCount; ++vertexRow)
     {
         float z = halfDepth - vertexRow * cellDepth;
@@ -607,61 +677,513 @@ void D3D12HelloProject::CreateGrid(float width, float depth, UINT vertexColumnCo
             vertices[vertexRow * vertexColumnCount + vertexColumn].uv = { vertexColumn * cellU, vertexRow * cellV };
         }
     }
-    std::vector<UINT>& indices = grid.indices;
+    std::span<Index> indices = grid.indices;
     const UINT verticesPerCell = 6;
-    indices.resize((vertexColumnCount - 1) * (vertexRowsCount - 1) * verticesPerCell);
+    assert(indices.size() == GridCounts(vertexColumnCount, vertexRowsCount).indexCount);
     for (UINT vertexRowsInBetween = 0, cell = 0; vertexRowsInBetween < vertexRowsCount - 1; ++vertexRowsInBetween)
     {
         for (UINT vertexColumnInBetween = 0; vertexColumnInBetween < vertexColumnCount - 1; ++vertexColumnInBetween, cell += verticesPerCell)
         {
-            indices[cell] = vertexRowsInBetween * vertexColumnCount + vertexColumnInBetween;
-            indices[cell + 1] = vertexRowsInBetween * vertexColumnCount + vertexColumnInBetween + 1;
-            indices[cell + 2] = (vertexRowsInBetween + 1) * vertexColumnCount + vertexColumnInBetween;
-            indices[cell + 3] = (vertexRowsInBetween + 1) * vertexColumnCount + vertexColumnInBetween;
-            indices[cell + 4] = vertexRowsInBetween * vertexColumnCount + vertexColumnInBetween + 1;
-            indices[cell + 5] = (vertexRowsInBetween + 1) * vertexColumnCount + vertexColumnInBetween + 1;
+            indices[cell] = static_cast<Index>(vertexRowsInBetween * vertexColumnCount + vertexColumnInBetween);
+            indices[cell + 1] = static_cast<Index>(vertexRowsInBetween * vertexColumnCount + vertexColumnInBetween + 1);
+            indices[cell + 2] = static_cast<Index>((vertexRowsInBetween + 1) * vertexColumnCount + vertexColumnInBetween);
+            indices[cell + 3] = static_cast<Index>((vertexRowsInBetween + 1) * vertexColumnCount + vertexColumnInBetween);
+            indices[cell + 4] = static_cast<Index>(vertexRowsInBetween * vertexColumnCount + vertexColumnInBetween + 1);
+            indices[cell + 5] = static_cast<Index>((vertexRowsInBetween + 1) * vertexColumnCount + vertexColumnInBetween + 1);
         }
     }
+    return Culling::BoxBounds({ { 0, 0, 0 }, { halfWidth, 0, halfDepth } });
 }
 
-void D3D12HelloProject::CreateMesh(const MeshData& data, Mesh& mesh)
+void D3D12HelloProject::CreateMesh(std::span<const PositionNormalUV> vertices, std::span<const std::uint32_t> indices, Mesh& mesh)
 {
     assert(mesh.indexCount == 0);
-    const UINT vertexBufferSize = sizeof(PositionNormalUV) * data.vertices.size();
+    mesh.bounds = Culling::ComputeBounds(vertices);
+    std::vector<PositionNormalUV> splitVertices;
+    MeshOptimiser::ShortIndexMesh split;
+    std::vector<Submesh> submeshes{ { 0, static_cast<std::uint32_t>(indices.size()), 0 } };
+    if (vertices.size() > MeshOptimiser::shortIndexVertexCount)
+    {
+        split = MeshOptimiser::SplitForShortIndices(indices, vertices.size());
+        splitVertices.reserve(split.vertexRemap.size());
+        for (std::uint32_t vertex : split.vertexRemap)
+            splitVertices.push_back(vertices[vertex]);
+        vertices = splitVertices;
+        indices = split.indices;
+        submeshes = std::move(split.submeshes);
+    }
+    UploadVertices(vertices, mesh);
+    const UINT indexCount = static_cast<UINT>(indices.size());
+    MeshOptimiser::WriteShortIndices(indices, submeshes, { CreateIndexBuffer(indexCount, mesh), indexCount });
+    mesh.indexBuffer->Unmap(0, nullptr);
+    mesh.submeshes = std::move(submeshes);
+}
+
+void D3D12HelloProject::CreateMesh(const MeshData& data, Mesh& mesh)
+{
+    CreateMesh(data.vertices, data.indices, mesh);
+    mesh.meshlets = data.meshlets;
+    mesh.levelsOfDetail = data.levelsOfDetail;
+}
+
+void* D3D12HelloProject::CreateMappedUploadBuffer(UINT size, ComPtr<ID3D12Resource>& buffer)
+{
     CD3DX12_HEAP_PROPERTIES uploadProperties(D3D12_HEAP_TYPE_UPLOAD);
-    CD3DX12_RESOURCE_DESC vertexBufferDescription(CD3DX12_RESOURCE_DESC::Buffer(vertexBufferSize));
+    CD3DX12_RESOURCE_DESC bufferDescription(CD3DX12_RESOURCE_DESC::Buffer(size));
     ThrowIfFailed(device->CreateCommittedResource(
         &uploadProperties,
         D3D12_HEAP_FLAG_NONE,
-        &vertexBufferDescription,
+        &bufferDescription,
         D3D12_RESOURCE_STATE_GENERIC_READ,
         nullptr,
-        IID_PPV_ARGS(&mesh.vertexBuffer)));
-    void* vertexDataBegin;
+        IID_PPV_ARGS(&buffer)));
+    void* dataBegin;
     const CD3DX12_RANGE readRange(0, 0);
-    ThrowIfFailed(mesh.vertexBuffer->Map(0, &readRange, &vertexDataBegin));
-    memcpy(vertexDataBegin, &data.vertices[0], vertexBufferSize);
-    mesh.vertexBuffer->Unmap(0, nullptr);
+    ThrowIfFailed(buffer->Map(0, &readRange, &dataBegin));
+    return dataBegin;
+}
+
+// Returns the mapped memory of the vertex buffer, which the caller fills and unmaps.
+void* D3D12HelloProject::CreateVertexBuffer(UINT vertexCount, Mesh& mesh)
+{
+#if USE_PACKED_VERTICES
+    const UINT vertexStride = sizeof(VertexCompression::PackedPositionNormalUV);
+#else
+    const UINT vertexStride = sizeof(PositionNormalUV);
+#endif
+    const UINT vertexBufferSize = vertexStride * vertexCount;
+    void* vertexDataBegin = CreateMappedUploadBuffer(vertexBufferSize, mesh.vertexBuffer);
     mesh.vertexBufferView.BufferLocation = mesh.vertexBuffer->GetGPUVirtualAddress();
-    mesh.vertexBufferView.StrideInBytes = sizeof(PositionNormalUV);
+    mesh.vertexBufferView.StrideInBytes = vertexStride;
     mesh.vertexBufferView.SizeInBytes = vertexBufferSize;
-    mesh.indexCount = data.indices.size();
-    const UINT indexBufferSize = sizeof(UINT) * mesh.indexCount;
-    CD3DX12_RESOURCE_DESC indexBufferDescription(CD3DX12_RESOURCE_DESC::Buffer(indexBufferSize));
+    return vertexDataBegin;
+}
+
+// Creates the vertex buffer of mesh and copies vertices into it, packing them if vertices are packed.
+void D3D12HelloProject::UploadVertices(std::span<const PositionNormalUV> vertices, Mesh& mesh)
+{
+    void* vertexDataBegin = CreateVertexBuffer(static_cast<UINT>(vertices.size()), mesh);
+#if USE_PACKED_VERTICES
+    mesh.positionDequantisation = VertexCompression::ComputeDequantisation(vertices);
+    VertexCompression::Encode(vertices, mesh.positionDequantisation,
+        { static_cast<VertexCompression::PackedPositionNormalUV*>(vertexDataBegin), vertices.size() });
+#else
+    memcpy(vertexDataBegin, vertices.data(), vertices.size_bytes());
+    mesh.positionDequantisation = { { 1, 1, 1 }, { 0, 0, 0 } };
+#endif
+    mesh.vertexBuffer->Unmap(0, nullptr);
+}
+
+// Returns the mapped memory of the 16 bit index buffer, which the caller fills with indices relative to
+// the base vertex of their submesh and unmaps.
+std::uint16_t* D3D12HelloProject::CreateIndexBuffer(UINT indexCount, Mesh& mesh)
+{
+    const UINT indexBufferSize = static_cast<UINT>(sizeof(std::uint16_t) * indexCount);
+    void* indexDataBegin = CreateMappedUploadBuffer(indexBufferSize, mesh.indexBuffer);
+    mesh.indexCount = indexCount;
+    mesh.indexBufferView.BufferLocation = mesh.indexBuffer->GetGPUVirtualAddress();
+    mesh.indexBufferView.Format = DXGI_FORMAT_R16_UINT;
+    mesh.indexBufferView.SizeInBytes = indexBufferSize;
+    return static_cast<std::uint16_t*>(indexDataBegin);
+}
+
+// Appends the packets drawing instanceCount instances, whose data starts at instanceOffset into the instance
+// buffer, of the parts of
+// indexRanges, sorted and disjoint, that fall in each submesh.
+void D3D12HelloProject::AppendDrawPackets(const Mesh& mesh, std::span<const Culling::IndexRange> indexRanges,
+    UINT64 instanceOffset, UINT instanceCount, std::vector<DrawRecording::DrawPacket>& packets)
+{
+    auto indexRange = indexRanges.begin();
+    for (const Submesh& submesh : mesh.submeshes)
+    {
+        const std::uint32_t submeshEnd = submesh.startIndex + submesh.indexCount;
+        for (; indexRange != indexRanges.end() && indexRange->startIndex < submeshEnd; ++indexRange)
+        {
+            const std::uint32_t start = std::max(indexRange->startIndex, submesh.startIndex);
+            const std::uint32_t end = std::min(indexRange->startIndex + indexRange->indexCount, submeshEnd);
+            if (start < end)
+                packets.push_back({ instanceOffset, Rhi::ToRhi(mesh.vertexBufferView), Rhi::ToRhi(mesh.indexBufferView), end - start, instanceCount,
+                    start, submesh.baseVertex });
+            // A range crossing into the next submesh is drawn again from there.
+            if (indexRange->startIndex + indexRange->indexCount > submeshEnd)
+                break;
+        }
+    }
+}
+
+// Selects the level of detail of every model whose mesh has coarser ones from the size of its bounding
+// sphere on screen, projecting all of the spheres at once and then selecting the levels mesh by mesh.
+void D3D12HelloProject::SelectLevelsOfDetail(const XMMATRIX& projection, const XMFLOAT3& cameraPosition)
+{
+    std::array<Sphere, modelCount> spheres;
+    for (size_t modelIndex = 0; modelIndex < modelCount; ++modelIndex)
+        spheres[modelIndex] = models[modelIndex].worldBounds.sphere;
+    XMFLOAT4X4 projectionRows;
+    XMStoreFloat4x4(&projectionRows, projection);
+    std::array<float, modelCount> projectedRadii;
+    LevelOfDetailSelection::ProjectRadii(spheres, cameraPosition,
+        LevelOfDetailSelection::ProjectionScale(projectionRows, static_cast<float>(m_height)), projectedRadii);
+    std::array<size_t, modelCount> meshModelIndices;
+    std::array<float, modelCount> meshProjectedRadii;
+    std::array<std::uint32_t, modelCount> meshLevels;
+    for (const Mesh& mesh : meshes)
+    {
+        if (mesh.levelsOfDetail.empty())
+            continue;
+        size_t meshModelCount = 0;
+        for (size_t modelIndex = 0; modelIndex < modelCount; ++modelIndex)
+            if (models[modelIndex].mesh == &mesh)
+            {
+                meshModelIndices[meshModelCount] = modelIndex;
+                meshProjectedRadii[meshModelCount] = projectedRadii[modelIndex];
+                meshLevels[meshModelCount++] = models[modelIndex].levelOfDetail;
+            }
+        LevelOfDetailSelection::SelectLevels(mesh.levelsOfDetail, mesh.bounds.sphere.radius,
+            { meshProjectedRadii.data(), meshModelCount }, { meshLevels.data(), meshModelCount });
+        for (size_t meshModelIndex = 0; meshModelIndex < meshModelCount; ++meshModelIndex)
+            models[meshModelIndices[meshModelIndex]].levelOfDetail = meshLevels[meshModelIndex];
+    }
+}
+
+// Culls the world bounding spheres of all models against the frustum of the per scene view projection
+// into the list of models to draw, then refreshes the visible index ranges of every one of those: its
+// level of detail, culled meshlet by meshlet when that is the full mesh and it has meshlets.
+void D3D12HelloProject::CullModels()
+{
+    XMFLOAT4X4 viewProjectionRows;
+    XMStoreFloat4x4(&viewProjectionRows, XMMatrixTranspose(perSceneBuffer.data.data.viewProjection));
+    const Culling::Frustum frustum = Culling::ExtractFrustum(viewProjectionRows);
+    const XMFLOAT3& cameraPosition = perSceneBuffer.data.data.cameraPosition;
+    std::array<Sphere, modelCount> spheres;
+    for (size_t modelIndex = 0; modelIndex < modelCount; ++modelIndex)
+        spheres[modelIndex] = models[modelIndex].worldBounds.sphere;
+    visibleModelCount = Culling::CullSpheres(spheres, frustum, visibleModelIndices);
+    // Only opaque models hide what is behind them.
+    std::vector<OcclusionCulling::Occluder> occluders;
+    std::array<Box, modelCount> boxes;
+    for (size_t modelIndex = 0; modelIndex < modelCount; ++modelIndex)
+        boxes[modelIndex] = models[modelIndex].worldBounds.box;
+    for (std::uint32_t modelIndex : std::span(visibleModelIndices).first(visibleModelCount))
+    {
+        const Model& model = models[modelIndex];
+        if (model.renderLayer != RenderLayer::Opaque || model.mesh->occluder.indices.empty())
+            continue;
+        OcclusionCulling::Occluder& occluder = occluders.emplace_back();
+        occluder.mesh = &model.mesh->occluder;
+        XMStoreFloat4x4(&occluder.model, XMMatrixTranspose(model.instance.model));
+    }
+    occlusionDepthBuffer.Rasterise(occluders, viewProjectionRows);
+    visibleModelCount = occlusionDepthBuffer.CullBoxes(boxes, std::span(visibleModelIndices).first(visibleModelCount));
+    // Models hidden behind the depth of the newest frame the GPU is done with, as seen through its view
+    // projection. A model uncovered by an occluder moving away since then shows up as many frames late.
+    const UINT64 completedFenceValue = fence->GetCompletedValue();
+    const HierarchicalDepthReadback* newestReadback = nullptr;
+    for (UINT frame = 0, newestFrame = 0; frame < frameCount; ++frame)
+        if (frameFenceValues[frame] != 0 && frameFenceValues[frame] <= completedFenceValue
+            && (newestReadback == nullptr || frameFenceValues[frame] > frameFenceValues[newestFrame]))
+        {
+            newestReadback = &hierarchicalDepthReadbacks[frame];
+            newestFrame = frame;
+        }
+    if (newestReadback != nullptr)
+        visibleModelCount = HierarchicalDepth::CullBoxes(hierarchicalDepthLevels,
+            std::span(newestReadback->texels, HierarchicalDepth::TexelCount(hierarchicalDepthLevels)), newestReadback->viewProjection,
+            boxes, std::span(visibleModelIndices).first(visibleModelCount));
+    for (std::uint32_t modelIndex : std::span(visibleModelIndices).first(visibleModelCount))
+    {
+        Model& model = models[modelIndex];
+        const Mesh& mesh = *model.mesh;
+        model.visibleIndexRanges.clear();
+        if (!mesh.levelsOfDetail.empty() && (model.levelOfDetail > 0 || mesh.meshlets.empty()))
+        {
+            const LevelOfDetail& level = mesh.levelsOfDetail[std::min<std::size_t>(model.levelOfDetail, mesh.levelsOfDetail.size() - 1)];
+            model.visibleIndexRanges.push_back({ level.startIndex, level.indexCount });
+            continue;
+        }
+        if (mesh.meshlets.empty())
+        {
+            model.visibleIndexRanges.push_back({ 0, mesh.indexCount });
+            continue;
+        }
+        XMFLOAT4X4 modelRows;
+        XMStoreFloat4x4(&modelRows, XMMatrixTranspose(model.instance.model));
+        Culling::CullMeshlets(mesh.meshlets, modelRows, frustum, cameraPosition, model.visibleIndexRanges);
+    }
+}
+
+// Orders the visible models by their draw keys: by layer, then by state and front to back in the depth
+// tested layers, back to front before anything else in the transparent one.
+void D3D12HelloProject::SortModels(const XMFLOAT3& cameraPosition)
+{
+    const XMVECTOR position = XMLoadFloat3(&cameraPosition);
+    const XMVECTOR forward = XMLoadFloat3(&cameraForward);
+    const std::span<std::uint32_t> visibleModels = std::span(visibleModelIndices).first(visibleModelCount);
+    for (size_t drawIndex = 0; drawIndex < visibleModels.size(); ++drawIndex)
+    {
+        const Model& model = models[visibleModels[drawIndex]];
+        const float viewDepth = XMVectorGetX(XMVector3Dot(XMVectorSubtract(XMLoadFloat3(&model.worldBounds.sphere.centre), position), forward));
+        DrawSorting::DrawDescription draw;
+        draw.layer = static_cast<std::uint32_t>(model.renderLayer);
+        // Pipeline states are indexed by layer, and every model shares the textures, the only material.
+        draw.pipeline = draw.layer;
+        draw.material = 0;
+        draw.mesh = static_cast<std::uint32_t>(model.mesh - meshes.data());
+        draw.depth = DrawSorting::QuantiseDepth(viewDepth, cameraNearPlane, cameraFarPlane);
+        draw.backToFront = model.renderLayer == RenderLayer::Transparent;
+        drawKeys[drawIndex] = DrawSorting::MakeKey(draw);
+    }
+    drawSorter.Sort(std::span(drawKeys).first(visibleModels.size()), visibleModels);
+}
+
+// Copies the data of the visible models into the instance buffer in draw order and groups consecutive
+// models that differ in nothing but their instance data, so that each group is drawn at once. The
+// models of a group being consecutive in draw order, drawing them as instances in that order keeps the
+// back to front order of the transparent ones.
+void D3D12HelloProject::GroupInstances()
+{
+    auto sameRange = [](const Culling::IndexRange& left, const Culling::IndexRange& right)
+    {
+        return left.startIndex == right.startIndex && left.indexCount == right.indexCount;
+    };
+    instanceGroupCount = 0;
+    // Models keeping their layer and mesh, the groups, and so the draw packets, follow from the drawn
+    // models and the index ranges they draw alone.
+    bool signatureChanged = false;
+    size_t signatureLength = 0;
+    auto sign = [this, &signatureChanged, &signatureLength](std::uint32_t value)
+    {
+        if (signatureLength == drawPacketSignature.size())
+        {
+            drawPacketSignature.push_back(value);
+            signatureChanged = true;
+        }
+        else if (drawPacketSignature[signatureLength] != value)
+        {
+            drawPacketSignature[signatureLength] = value;
+            signatureChanged = true;
+        }
+        ++signatureLength;
+    };
+    for (UINT instance = 0; instance < visibleModelCount; ++instance)
+    {
+        const Model& model = models[visibleModelIndices[instance]];
+        instanceBuffer.data[instance] = model.instance;
+        sign(visibleModelIndices[instance]);
+        sign(static_cast<std::uint32_t>(model.visibleIndexRanges.size()));
+        for (const Culling::IndexRange& indexRange : model.visibleIndexRanges)
+        {
+            sign(indexRange.startIndex);
+            sign(indexRange.indexCount);
+        }
+        if (instanceGroupCount > 0)
+        {
+            InstanceGroup& group = instanceGroups[instanceGroupCount - 1];
+            if (group.renderLayer == model.renderLayer && group.mesh == model.mesh
+                && std::ranges::equal(group.indexRanges, model.visibleIndexRanges, sameRange))
+            {
+                ++group.instanceCount;
+                continue;
+            }
+        }
+        instanceGroups[instanceGroupCount++] = { model.renderLayer, model.mesh, model.visibleIndexRanges, instance, 1 };
+    }
+    memcpy(instanceBuffer.dataCPU[frameIndex], instanceBuffer.data.data(), visibleModelCount * sizeof(PerInstance));
+    signatureChanged |= signatureLength != drawPacketSignature.size();
+    drawPacketSignature.resize(signatureLength);
+    if (signatureChanged)
+        BuildDrawPackets();
+}
+
+// Rebuilds the draw packets of every render layer from the instance groups, each packet reading its
+// instances from where the group starts in the instance buffer.
+void D3D12HelloProject::BuildDrawPackets()
+{
+    for (std::vector<DrawRecording::DrawPacket>& layerPackets : drawPackets)
+        layerPackets.clear();
+    for (const InstanceGroup& group : std::span(instanceGroups).first(instanceGroupCount))
+        AppendDrawPackets(*group.mesh, group.indexRanges, group.firstInstance * sizeof(PerInstance),
+            group.instanceCount, drawPackets[static_cast<size_t>(group.renderLayer)]);
+}
+
+// Creates what builds the hierarchical depth pyramid of depthStencilBuffer, whose shader resource view
+// follows the textures in shaderResourceViewHeap.
+void D3D12HelloProject::CreateHierarchicalDepth()
+{
+    {
+        D3D12_FEATURE_DATA_ROOT_SIGNATURE featureData = {};
+        featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
+        if (FAILED(device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &featureData, sizeof(featureData))))
+        {
+            featureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
+        }
+        CD3DX12_DESCRIPTOR_RANGE1 depthBufferTable;
+        std::array<CD3DX12_ROOT_PARAMETER1, 6> rootParameters;
+        rootParameters[0].InitAsConstants(3, 0);
+        depthBufferTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE);
+        rootParameters[1].InitAsDescriptorTable(1, &depthBufferTable);
+        rootParameters[2].InitAsShaderResourceView(1, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC);
+        rootParameters[3].InitAsShaderResourceView(2, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE);
+        rootParameters[4].InitAsUnorderedAccessView(0, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE);
+        rootParameters[5].InitAsUnorderedAccessView(1, 0, D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE);
+        CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
+        rootSignatureDesc.Init_1_1(rootParameters.size(), rootParameters.data());
+
+        ComPtr<ID3DBlob> signature;
+        ComPtr<ID3DBlob> error;
+        ThrowIfFailed(D3DX12SerializeVersionedRootSignature(&rootSignatureDesc, featureData.HighestVersion, &signature, &error));
+        ThrowIfFailed(device->CreateRootSignature(0, signature->GetBufferPointer(), signature->GetBufferSize(), IID_PPV_ARGS(&hierarchicalDepthRootSignature)));
+    }
+
+#if defined(_DEBUG)
+    UINT compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#else
+    UINT compileFlags = 0;
+#endif
+    const std::array<LPCSTR, 3> entryPoints{ "BuildFirstLevel", "BuildLevel", "TestRectangles" };
+    for (size_t entryPointIndex = 0; entryPointIndex < entryPoints.size(); ++entryPointIndex)
+    {
+        ComPtr<ID3DBlob> computeShader;
+        ComPtr<ID3DBlob> errorBlob;
+        D3DCompileFromFile(GetAssetFullPath(L"HierarchicalDepth.hlsl").c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE,
+            entryPoints[entryPointIndex], "cs_5_1", compileFlags, 0, &computeShader, &errorBlob);
+        if (errorBlob != nullptr)
+        {
+            OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+        }
+        D3D12_COMPUTE_PIPELINE_STATE_DESC computeStateDescription = {};
+        computeStateDescription.pRootSignature = hierarchicalDepthRootSignature.Get();
+        computeStateDescription.CS = CD3DX12_SHADER_BYTECODE(computeShader.Get());
+        ThrowIfFailed(device->CreateComputePipelineState(&computeStateDescription, IID_PPV_ARGS(&hierarchicalDepthPipelineStates[entryPointIndex])));
+    }
+
+    hierarchicalDepthLevels = HierarchicalDepth::MakeLevels(m_width, m_height);
+    const UINT levelsSize = static_cast<UINT>(sizeof(HierarchicalDepth::Level) * hierarchicalDepthLevels.size());
+    memcpy(CreateMappedUploadBuffer(levelsSize, hierarchicalDepthLevelBuffer), hierarchicalDepthLevels.data(), levelsSize);
+    hierarchicalDepthLevelBuffer->Unmap(0, nullptr);
+    CreateWriteBuffer(hierarchicalDepthRectangles);
+
+    const UINT texelsSize = static_cast<UINT>(sizeof(HierarchicalDepth::DepthRange) * HierarchicalDepth::TexelCount(hierarchicalDepthLevels));
+    const UINT bufferSize = texelsSize + static_cast<UINT>(sizeof(HierarchicalDepth::Visibility) * modelCount);
+    CD3DX12_HEAP_PROPERTIES defaultProperties(D3D12_HEAP_TYPE_DEFAULT);
+    CD3DX12_RESOURCE_DESC bufferDescription(CD3DX12_RESOURCE_DESC::Buffer(bufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS));
     ThrowIfFailed(device->CreateCommittedResource(
-        &uploadProperties,
+        &defaultProperties,
         D3D12_HEAP_FLAG_NONE,
-        &indexBufferDescription,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
+        &bufferDescription,
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
         nullptr,
-        IID_PPV_ARGS(&mesh.indexBuffer)));
-    void* indexDataBegin;
-    ThrowIfFailed(mesh.indexBuffer->Map(0, &readRange, &indexDataBegin));
-    memcpy(indexDataBegin, &data.indices[0], indexBufferSize);
-    mesh.indexBuffer->Unmap(0, nullptr);
-    mesh.indexBufferView.BufferLocation = mesh.indexBuffer->GetGPUVirtualAddress();
-    mesh.indexBufferView.Format = DXGI_FORMAT_R32_UINT;
-    mesh.indexBufferView.SizeInBytes = indexBufferSize;
+        IID_PPV_ARGS(&hierarchicalDepthBuffer)));
+    CD3DX12_HEAP_PROPERTIES readbackProperties(D3D12_HEAP_TYPE_READBACK);
+    CD3DX12_RESOURCE_DESC readbackDescription(CD3DX12_RESOURCE_DESC::Buffer(bufferSize));
+    for (HierarchicalDepthReadback& readback : hierarchicalDepthReadbacks)
+    {
+        ThrowIfFailed(device->CreateCommittedResource(
+            &readbackProperties,
+            D3D12_HEAP_FLAG_NONE,
+            &readbackDescription,
+            D3D12_RESOURCE_STATE_COPY_DEST,
+            nullptr,
+            IID_PPV_ARGS(&readback.buffer)));
+        void* readbackDataBegin;
+        const CD3DX12_RANGE readRange(0, bufferSize);
+        ThrowIfFailed(readback.buffer->Map(0, &readRange, &readbackDataBegin));
+        readback.texels = static_cast<const HierarchicalDepth::DepthRange*>(readbackDataBegin);
+    }
+}
+
+// Builds the pyramid of the depth the frame was rendered to and copies it into the read back buffer of the frame.
+void D3D12HelloProject::RecordHierarchicalDepth(RecordingContext& context)
+{
+    HierarchicalDepthReadback& readback = hierarchicalDepthReadbacks[frameIndex];
+    XMStoreFloat4x4(&readback.viewProjection, XMMatrixTranspose(perSceneBuffer.data.data.viewProjection));
+    readback.rectangleCount = 0;
+    if (m_diagnostics)
+    {
+        for (const Model& model : models)
+            readback.rectangleCount += HierarchicalDepth::ProjectBox(model.worldBounds.box, readback.viewProjection,
+                hierarchicalDepthLevels[0].width, hierarchicalDepthLevels[0].height, hierarchicalDepthRectangles.data[readback.rectangleCount]);
+        hierarchicalDepthRectangles.Update(frameIndex);
+    }
+    CD3DX12_RESOURCE_BARRIER depthWriteToShaderResource(CD3DX12_RESOURCE_BARRIER::Transition
+    (
+        depthStencilBuffer.Get(),
+        D3D12_RESOURCE_STATE_DEPTH_WRITE,
+        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE
+    ));
+    context.commandList->ResourceBarrier(1, &depthWriteToShaderResource);
+
+    context.commandList->SetComputeRootSignature(hierarchicalDepthRootSignature.Get());
+    Rhi::DescriptorHeap* descriptorHeaps[] = { Rhi::ToRhi(shaderResourceViewHeap.Get()) };
+    context.filteredCommandList.SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+    CD3DX12_GPU_DESCRIPTOR_HANDLE depthBufferHandle(shaderResourceViewHeap->GetGPUDescriptorHandleForHeapStart(), textureCount + 2, shaderBufferResourceViewsDescriptorSize);
+    context.commandList->SetComputeRootDescriptorTable(1, depthBufferHandle);
+    context.commandList->SetComputeRootShaderResourceView(2, hierarchicalDepthLevelBuffer->GetGPUVirtualAddress());
+    context.commandList->SetComputeRootShaderResourceView(3, hierarchicalDepthRectangles.dataGPU[frameIndex]->GetGPUVirtualAddress());
+    const D3D12_GPU_VIRTUAL_ADDRESS texelsAddress = hierarchicalDepthBuffer->GetGPUVirtualAddress();
+    context.commandList->SetComputeRootUnorderedAccessView(4, texelsAddress);
+    context.commandList->SetComputeRootUnorderedAccessView(5, texelsAddress + sizeof(HierarchicalDepth::DepthRange) * HierarchicalDepth::TexelCount(hierarchicalDepthLevels));
+    const UINT levelCount = static_cast<UINT>(hierarchicalDepthLevels.size());
+    context.commandList->SetComputeRoot32BitConstant(0, 0, 0);
+    context.commandList->SetComputeRoot32BitConstant(0, levelCount, 1);
+    context.commandList->SetComputeRoot32BitConstant(0, readback.rectangleCount, 2);
+
+    // Every level reads the one before it, finished by the barrier.
+    CD3DX12_RESOURCE_BARRIER texelsWritten(CD3DX12_RESOURCE_BARRIER::UAV(hierarchicalDepthBuffer.Get()));
+    context.filteredCommandList.SetPipelineState(Rhi::ToRhi(hierarchicalDepthPipelineStates[0].Get()));
+    context.commandList->Dispatch((hierarchicalDepthLevels[0].width + 7) / 8, (hierarchicalDepthLevels[0].height + 7) / 8, 1);
+    context.filteredCommandList.SetPipelineState(Rhi::ToRhi(hierarchicalDepthPipelineStates[1].Get()));
+    for (UINT levelIndex = 1; levelIndex < levelCount; ++levelIndex)
+    {
+        context.commandList->ResourceBarrier(1, &texelsWritten);
+        context.commandList->SetComputeRoot32BitConstant(0, levelIndex, 0);
+        context.commandList->Dispatch((hierarchicalDepthLevels[levelIndex].width + 7) / 8, (hierarchicalDepthLevels[levelIndex].height + 7) / 8, 1);
+    }
+    if (m_diagnostics)
+    {
+        context.commandList->ResourceBarrier(1, &texelsWritten);
+        context.filteredCommandList.SetPipelineState(Rhi::ToRhi(hierarchicalDepthPipelineStates[2].Get()));
+        context.commandList->Dispatch((readback.rectangleCount + 63) / 64, 1, 1);
+    }
+
+    std::array<CD3DX12_RESOURCE_BARRIER, 2> beforeCopy
+    {
+        CD3DX12_RESOURCE_BARRIER::Transition(hierarchicalDepthBuffer.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE),
+        CD3DX12_RESOURCE_BARRIER::Transition(depthStencilBuffer.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_DEPTH_WRITE)
+    };
+    context.commandList->ResourceBarrier(static_cast<UINT>(beforeCopy.size()), beforeCopy.data());
+    context.commandList->CopyResource(readback.buffer.Get(), hierarchicalDepthBuffer.Get());
+    CD3DX12_RESOURCE_BARRIER afterCopy(CD3DX12_RESOURCE_BARRIER::Transition
+    (
+        hierarchicalDepthBuffer.Get(),
+        D3D12_RESOURCE_STATE_COPY_SOURCE,
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS
+    ));
+    context.commandList->ResourceBarrier(1, &afterCopy);
+}
+
+// Rebuilds the pyramid read back for frame from its first level and retests the rectangles the GPU tested on
+// the CPU, logging how many texels and visibilities differ, which is none unless the two stopped matching.
+void D3D12HelloProject::ValidateHierarchicalDepth(UINT frame)
+{
+    const HierarchicalDepthReadback& readback = hierarchicalDepthReadbacks[frame];
+    const std::size_t texelCount = HierarchicalDepth::TexelCount(hierarchicalDepthLevels);
+    std::vector<HierarchicalDepth::DepthRange> texels(readback.texels, readback.texels + texelCount);
+    HierarchicalDepth::BuildPyramid(hierarchicalDepthLevels, texels);
+    size_t texelMismatchCount = 0;
+    for (size_t texelIndex = 0; texelIndex < texelCount; ++texelIndex)
+        texelMismatchCount += texels[texelIndex].nearest != readback.texels[texelIndex].nearest
+            || texels[texelIndex].farthest != readback.texels[texelIndex].farthest;
+    const HierarchicalDepth::Visibility* visibilities = reinterpret_cast<const HierarchicalDepth::Visibility*>(readback.texels + texelCount);
+    // The rectangles of later frames have replaced the ones in data since, so they are read from the upload
+    // buffer of the frame, slowly, as it is write combined.
+    const HierarchicalDepth::ScreenRectangle* rectangles = static_cast<const HierarchicalDepth::ScreenRectangle*>(hierarchicalDepthRectangles.dataCPU[frame]);
+    size_t visibilityMismatchCount = 0;
+    for (UINT rectangleIndex = 0; rectangleIndex < readback.rectangleCount; ++rectangleIndex)
+        visibilityMismatchCount += HierarchicalDepth::Test(hierarchicalDepthLevels, texels,
+            rectangles[rectangleIndex]) != visibilities[rectangleIndex];
+    if (texelMismatchCount > 0 || visibilityMismatchCount > 0)
+        LogDiagnostic(L"Hierarchical depth mismatch: %zu of %zu texels, %zu of %u visibilities\n",
+            texelMismatchCount, texelCount, visibilityMismatchCount, readback.rectangleCount);
 }
 
 // Update frame-based values.
@@ -702,9 +1224,13 @@ void D3D12HelloProject::OnUpdate()
     if (GetAsyncKeyState(VK_LSHIFT))
         cameraPosition.y -= 0.1f;
     XMMATRIX cameraView = XMMatrixLookToLH(XMLoadFloat3(&cameraPosition), XMLoadFloat3(&cameraForward), XMLoadFloat3(&cameraUp));
-    XMMATRIX cameraProjection = XMMatrixPerspectiveFovLH(0.25f * std::numbers::pi_v<float>, m_aspectRatio, 1, 1000);
+    XMMATRIX cameraProjection = XMMatrixPerspectiveFovLH(0.25f * std::numbers::pi_v<float>, m_aspectRatio, cameraNearPlane, cameraFarPlane);
     perSceneBuffer.data.data.viewProjection = XMMatrixTranspose(cameraView * cameraProjection);
-    perSceneBuffer.Update();
+    perSceneBuffer.Update(frameIndex);
+    SelectLevelsOfDetail(cameraProjection, cameraPosition);
+    CullModels();
+    SortModels(cameraPosition);
+    GroupInstances();
 }
 
 void D3D12HelloProject::OnMouseDown(WPARAM btnState, int x, int y)
@@ -742,175 +1268,262 @@ void D3D12HelloProject::OnMouseMove(WPARAM btnState, int x, int y)
 // Render the scene.
 void D3D12HelloProject::OnRender()
 {
-    // Record all the commands we need to render the scene into the command list.
+    // Record all the commands we need to render the scene into the command lists.
     PopulateCommandList();
 
-    // Execute the command list.
-    ID3D12CommandList* ppCommandLists[] = { commandList.Get() };
-    commandQueue->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+    // Execute the command lists, in the order of the chunks they recorded.
+    std::vector<ID3D12CommandList*> commandLists(recordingChunks.size());
+    for (size_t chunkIndex = 0; chunkIndex < commandLists.size(); ++chunkIndex)
+        commandLists[chunkIndex] = recordingContexts[chunkIndex]->commandList.Get();
+    commandQueue->ExecuteCommandLists(static_cast<UINT>(commandLists.size()), commandLists.data());
 
     // Present the frame.
     ThrowIfFailed(swapChain->Present(1, 0));
 
-    WaitForPreviousFrame();
+    MoveToNextFrame();
+    // The frame last recorded into the slot about to be reused is done, its pyramid read back.
+    if (m_diagnostics && frameFenceValues[frameIndex] != 0)
+        ValidateHierarchicalDepth(frameIndex);
 }
 
 void D3D12HelloProject::OnDestroy()
 {
     // Ensure that the GPU is no longer referencing resources that are about to be
     // cleaned up by the destructor.
-    WaitForPreviousFrame();
+    WaitForGpu();
+    CollectRetired();
 
     CloseHandle(fenceEvent);
+    if (m_diagnostics)
+        LogStateFiltering();
 }
 
-// Fill the command list with all the render commands and dependent state.
-void D3D12HelloProject::PopulateCommandList()
+// Logs how many state setting calls of each kind every recording context was asked for and how many it filtered.
+void D3D12HelloProject::LogStateFiltering()
 {
-    // Command list allocators can only be reset when the associated 
-    // command lists have finished execution on the GPU; apps should use 
-    // fences to determine GPU execution progress.
-    ThrowIfFailed(commandAllocator->Reset());
+    FilteredCommandList::CallCounts totalCounts{};
+    for (size_t call = 0; call < static_cast<size_t>(FilteredCommandList::Call::Count); ++call)
+    {
+        FilteredCommandList::CallCounts counts{};
+        for (const std::unique_ptr<RecordingContext>& context : recordingContexts)
+        {
+            const FilteredCommandList::CallCounts& contextCounts = context->filteredCommandList.Counts(static_cast<FilteredCommandList::Call>(call));
+            counts.submitted += contextCounts.submitted;
+            counts.filtered += contextCounts.filtered;
+        }
+        totalCounts.submitted += counts.submitted;
+        totalCounts.filtered += counts.filtered;
+        LogDiagnostic(L"%s: %llu submitted, %llu filtered\n", FilteredCommandList::CallName(static_cast<FilteredCommandList::Call>(call)),
+            counts.submitted, counts.filtered);
+    }
+    LogDiagnostic(L"State setting calls: %llu submitted, %llu filtered\n", totalCounts.submitted, totalCounts.filtered);
+}
 
-    // However, when ExecuteCommandList() is called on a particular command 
-    // list, that command list can then be reset at any time and must be before 
-    // re-recording.
-    ThrowIfFailed(commandList->Reset(commandAllocator.Get(), pipelineStates[static_cast<size_t>(RenderLayer::Opaque)].Get()));
+// Adds a command list with allocators of its own, open for recording into the one of the current frame.
+RecordingContext& D3D12HelloProject::AddRecordingContext()
+{
+    RecordingContext& context = *recordingContexts.emplace_back(std::make_unique<RecordingContext>());
+    for (ComPtr<ID3D12CommandAllocator>& commandAllocator : context.commandAllocators)
+        ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&commandAllocator)));
+    ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, context.commandAllocators[frameIndex].Get(), nullptr,
+        IID_PPV_ARGS(&context.commandList)));
+    context.rhiCommandList = Rhi::D3D12CommandList(context.commandList.Get());
+    return context;
+}
 
-    commandList->SetGraphicsRootSignature(rootSignature.Get());
+// Binds everything the draws of renderLayer need, none of which carries over from one command list to the next.
+void D3D12HelloProject::SetRenderLayerState(RecordingContext& context, RenderLayer renderLayer)
+{
+    // Index into shaderResourceViewHeap of the texture every render layer samples.
+    constexpr std::array<INT, 4> renderLayerTextures{ 1, 1, 0, 1 };
 
-    ID3D12DescriptorHeap* descriptorHeaps[] = { constantBufferViewHeap.Get() };
-    commandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+    context.filteredCommandList.SetGraphicsRootSignature(Rhi::ToRhi(rootSignature.Get()));
 
-    commandList->RSSetViewports(1, &viewport);
-    commandList->RSSetScissorRects(1, &scissorRect);
+    Rhi::DescriptorHeap* descriptorHeaps[] = { Rhi::ToRhi(constantBufferViewHeap.Get()) };
+    context.filteredCommandList.SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
 
-    CD3DX12_RESOURCE_BARRIER backBufferPresentToRenderTarget(CD3DX12_RESOURCE_BARRIER::Transition
-    (
-        renderTargets[frameIndex].Get(), 
-        D3D12_RESOURCE_STATE_PRESENT, 
-        D3D12_RESOURCE_STATE_RENDER_TARGET
-    ));
-    commandList->ResourceBarrier(1, &backBufferPresentToRenderTarget);
-    
-    commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-    CD3DX12_GPU_DESCRIPTOR_HANDLE descriptorHandle(constantBufferViewHeap->GetGPUDescriptorHandleForHeapStart());
-    commandList->SetGraphicsRootDescriptorTable(0, descriptorHandle);
-    descriptorHeaps[0] = shaderResourceViewHeap.Get();
-    commandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
+    context.commandList->RSSetViewports(1, &viewport);
+    context.commandList->RSSetScissorRects(1, &scissorRect);
+
+    context.filteredCommandList.IASetPrimitiveTopology(Rhi::PrimitiveTopology::TriangleList);
+    CD3DX12_GPU_DESCRIPTOR_HANDLE descriptorHandle(constantBufferViewHeap->GetGPUDescriptorHandleForHeapStart(), frameIndex, shaderBufferResourceViewsDescriptorSize);
+    context.filteredCommandList.SetGraphicsRootDescriptorTable(0, Rhi::ToRhi(descriptorHandle));
+    descriptorHeaps[0] = Rhi::ToRhi(shaderResourceViewHeap.Get());
+    context.filteredCommandList.SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
     CD3DX12_GPU_DESCRIPTOR_HANDLE shaderResourceViewHandle(shaderResourceViewHeap->GetGPUDescriptorHandleForHeapStart(), 2, shaderBufferResourceViewsDescriptorSize);
-    commandList->SetGraphicsRootDescriptorTable(3, shaderResourceViewHandle);
+    context.filteredCommandList.SetGraphicsRootDescriptorTable(3, Rhi::ToRhi(shaderResourceViewHandle));
+
+    CD3DX12_CPU_DESCRIPTOR_HANDLE renderTargetViewHandle(renderTargetViewHeap->GetCPUDescriptorHandleForHeapStart(), frameIndex, renderTargetViewDescriptorSize);
+    CD3DX12_CPU_DESCRIPTOR_HANDLE depthStencilViewHandle(depthStencilViewHeap->GetCPUDescriptorHandleForHeapStart());
+    context.commandList->OMSetRenderTargets(1, &renderTargetViewHandle, false, &depthStencilViewHandle);
+    context.filteredCommandList.SetPipelineState(Rhi::ToRhi(pipelineStates[static_cast<size_t>(renderLayer)].Get()));
+    shaderResourceViewHandle.InitOffsetted(shaderResourceViewHeap->GetGPUDescriptorHandleForHeapStart(),
+        renderLayerTextures[static_cast<size_t>(renderLayer)], shaderBufferResourceViewsDescriptorSize);
+    context.filteredCommandList.SetGraphicsRootDescriptorTable(2, Rhi::ToRhi(shaderResourceViewHandle));
+}
+
+// Records the chunk of recordingChunks into the recording context of the same index, which also starts the
+// frame when it is the first chunk and ends it when it is the last. Called from any thread, at most once a
+// frame for every chunk.
+void D3D12HelloProject::RecordChunk(size_t chunkIndex)
+{
+    const RecordingChunk& chunk = recordingChunks[chunkIndex];
+    RecordingContext& context = *recordingContexts[chunkIndex];
+    ID3D12PipelineState* pipelineState = pipelineStates[static_cast<size_t>(chunk.renderLayer)].Get();
 
+    // Command list allocators can only be reset when the associated 
+    // command lists have finished execution on the GPU; apps should use 
+    // fences to determine GPU execution progress.
+    ID3D12CommandAllocator* commandAllocator = context.commandAllocators[frameIndex].Get();
+    ThrowIfFailed(commandAllocator->Reset());
 
+    // However, when ExecuteCommandList() is called on a particular command 
+    // list, that command list can then be reset at any time and must be before 
+    // re-recording.
+    ThrowIfFailed(context.commandList->Reset(commandAllocator, pipelineState));
+    context.filteredCommandList.Begin(context.rhiCommandList, Rhi::ToRhi(pipelineState));
 
     CD3DX12_CPU_DESCRIPTOR_HANDLE renderTargetViewHandle(renderTargetViewHeap->GetCPUDescriptorHandleForHeapStart(), frameIndex, renderTargetViewDescriptorSize);
     CD3DX12_CPU_DESCRIPTOR_HANDLE depthStencilViewHandle(depthStencilViewHeap->GetCPUDescriptorHandleForHeapStart());
-    commandList->OMSetRenderTargets(1, &renderTargetViewHandle, false, &depthStencilViewHandle);
     const float clearColor[] = { 0.0f, 0.2f, 0.4f, 1.0f };
-    commandList->ClearRenderTargetView(renderTargetViewHandle, clearColor, 0, nullptr);
-    commandList->ClearDepthStencilView(depthStencilViewHeap->GetCPUDescriptorHandleForHeapStart(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
-    commandList->SetPipelineState(pipelineStates[static_cast<size_t>(RenderLayer::Opaque)].Get());
-    shaderResourceViewHandle.Offset(-1, shaderBufferResourceViewsDescriptorSize);
-    commandList->SetGraphicsRootDescriptorTable(2, shaderResourceViewHandle);
-    for (size_t modelIndex = 0; modelIndex < modelCount; ++modelIndex)
-        if (models[modelIndex].renderLayer == RenderLayer::Opaque)
-        {
-            commandList->SetGraphicsRootConstantBufferView(1, models[modelIndex].buffer.dataGPU->GetGPUVirtualAddress());
-            commandList->IASetVertexBuffers(0, 1, &models[modelIndex].mesh->vertexBufferView);
-            commandList->IASetIndexBuffer(&models[modelIndex].mesh->indexBufferView);
-            commandList->DrawIndexedInstanced(models[modelIndex].mesh->indexCount, 1, 0, 0, 0);
-        }
+    if (chunkIndex == 0)
+    {
+        CD3DX12_RESOURCE_BARRIER backBufferPresentToRenderTarget(CD3DX12_RESOURCE_BARRIER::Transition
+        (
+            renderTargets[frameIndex].Get(), 
+            D3D12_RESOURCE_STATE_PRESENT, 
+            D3D12_RESOURCE_STATE_RENDER_TARGET
+        ));
+        context.commandList->ResourceBarrier(1, &backBufferPresentToRenderTarget);
+        context.commandList->ClearRenderTargetView(renderTargetViewHandle, clearColor, 0, nullptr);
+        context.commandList->ClearDepthStencilView(depthStencilViewHandle, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+    }
 
+    const D3D12_GPU_VIRTUAL_ADDRESS instanceBufferAddress = instanceBuffer.dataGPU[frameIndex]->GetGPUVirtualAddress();
+    SetRenderLayerState(context, chunk.renderLayer);
+    DrawRecording::Record(context.filteredCommandList, chunk.packets, instanceBufferAddress);
 
-    /*CD3DX12_RESOURCE_BARRIER channelStencilReadToDepthWrite(CD3DX12_RESOURCE_BARRIER::Transition
-    (
-        channelStencilTexture.Get(),
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        D3D12_RESOURCE_STATE_DEPTH_WRITE
-    ));
-    commandList->ResourceBarrier(1, &channelStencilReadToDepthWrite);
-    depthStencilViewHandle.Offset(1, depthStencilViewDescriptorSize);
-    commandList->OMSetRenderTargets(0, nullptr, false, &depthStencilViewHandle);
-    commandList->ClearDepthStencilView(depthStencilViewHandle, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
-    commandList->SetPipelineState(pipelineStates[static_cast<size_t>(RenderLayer::ChannelStencilWritter)].Get());
-    for (size_t modelIndex = 0; modelIndex < modelCount; ++modelIndex)
-        if (models[modelIndex].renderLayer == RenderLayer::Transparent || models[modelIndex].renderLayer == RenderLayer::ChannelStencilReader)
+    if (chunkIndex + 1 == recordingChunks.size())
+    {
+        /*CD3DX12_GPU_DESCRIPTOR_HANDLE shaderResourceViewHandle(shaderResourceViewHeap->GetGPUDescriptorHandleForHeapStart(), 1, shaderBufferResourceViewsDescriptorSize);
+        CD3DX12_RESOURCE_BARRIER channelStencilReadToDepthWrite(CD3DX12_RESOURCE_BARRIER::Transition
+        (
+            channelStencilTexture.Get(),
+            D3D12_RESOURCE_STATE_GENERIC_READ,
+            D3D12_RESOURCE_STATE_DEPTH_WRITE
+        ));
+        context.commandList->ResourceBarrier(1, &channelStencilReadToDepthWrite);
+        depthStencilViewHandle.Offset(1, depthStencilViewDescriptorSize);
+        context.commandList->OMSetRenderTargets(0, nullptr, false, &depthStencilViewHandle);
+        context.commandList->ClearDepthStencilView(depthStencilViewHandle, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+        context.filteredCommandList.SetPipelineState(Rhi::ToRhi(pipelineStates[static_cast<size_t>(RenderLayer::ChannelStencilWritter)].Get()));
+        // Every model writes its own stencil reference, so they are drawn one instance at a time.
+        for (UINT instance = 0; instance < visibleModelCount; ++instance)
         {
-            UINT ref = 1 << ((modelIndex % 3) * 2);
-            commandList->OMSetStencilRef(ref);
-            commandList->SetGraphicsRootConstantBufferView(1, models[modelIndex].buffer.dataGPU->GetGPUVirtualAddress());
-            commandList->IASetVertexBuffers(0, 1, &models[modelIndex].mesh->vertexBufferView);
-            commandList->IASetIndexBuffer(&models[modelIndex].mesh->indexBufferView);
-            commandList->DrawIndexedInstanced(models[modelIndex].mesh->indexCount, 1, 0, 0, 0);
+            const std::uint32_t modelIndex = visibleModelIndices[instance];
+            if (models[modelIndex].renderLayer == RenderLayer::Transparent || models[modelIndex].renderLayer == RenderLayer::ChannelStencilReader)
+            {
+                UINT ref = 1 << ((modelIndex % 3) * 2);
+                context.filteredCommandList.OMSetStencilRef(ref);
+                std::vector<DrawRecording::DrawPacket> modelPackets;
+                AppendDrawPackets(*models[modelIndex].mesh, models[modelIndex].visibleIndexRanges, instance * sizeof(PerInstance), 1, modelPackets);
+                DrawRecording::Record(context.filteredCommandList, modelPackets, instanceBufferAddress);
+            }
         }
-    CD3DX12_RESOURCE_BARRIER channelStencilDepthWriteToRead(CD3DX12_RESOURCE_BARRIER::Transition
-    (
-        channelStencilTexture.Get(),
-        D3D12_RESOURCE_STATE_DEPTH_WRITE,
-        D3D12_RESOURCE_STATE_GENERIC_READ
-    ));
-    commandList->ResourceBarrier(1, &channelStencilDepthWriteToRead);
+        CD3DX12_RESOURCE_BARRIER channelStencilDepthWriteToRead(CD3DX12_RESOURCE_BARRIER::Transition
+        (
+            channelStencilTexture.Get(),
+            D3D12_RESOURCE_STATE_DEPTH_WRITE,
+            D3D12_RESOURCE_STATE_GENERIC_READ
+        ));
+        context.commandList->ResourceBarrier(1, &channelStencilDepthWriteToRead);
 
 
 
-    commandList->SetPipelineState(pipelineStates[static_cast<size_t>(RenderLayer::ChannelStencilReader)].Get());
-    shaderResourceViewHandle.Offset(-1, shaderBufferResourceViewsDescriptorSize);
-    commandList->SetGraphicsRootDescriptorTable(2, shaderResourceViewHandle);
-    depthStencilViewHandle.Offset(-1, depthStencilViewDescriptorSize);
-    commandList->OMSetRenderTargets(1, &renderTargetViewHandle, false, &depthStencilViewHandle);
-    commandList->ClearRenderTargetView(renderTargetViewHandle, clearColor, 0, nullptr);
-    commandList->ClearDepthStencilView(depthStencilViewHandle, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
-    for (size_t modelIndex = 0; modelIndex < modelCount; ++modelIndex)
-        if (models[modelIndex].renderLayer == RenderLayer::ChannelStencilReader)
-        { 
-            commandList->SetGraphicsRootConstantBufferView(1, models[modelIndex].buffer.dataGPU->GetGPUVirtualAddress());
-            commandList->IASetVertexBuffers(0, 1, &models[modelIndex].mesh->vertexBufferView);
-            commandList->IASetIndexBuffer(&models[modelIndex].mesh->indexBufferView);
-            commandList->DrawIndexedInstanced(models[modelIndex].mesh->indexCount, 1, 0, 0, 0);
-        }
+        context.filteredCommandList.SetPipelineState(Rhi::ToRhi(pipelineStates[static_cast<size_t>(RenderLayer::ChannelStencilReader)].Get()));
+        shaderResourceViewHandle.Offset(-1, shaderBufferResourceViewsDescriptorSize);
+        context.filteredCommandList.SetGraphicsRootDescriptorTable(2, Rhi::ToRhi(shaderResourceViewHandle));
+        depthStencilViewHandle.Offset(-1, depthStencilViewDescriptorSize);
+        context.commandList->OMSetRenderTargets(1, &renderTargetViewHandle, false, &depthStencilViewHandle);
+        context.commandList->ClearRenderTargetView(renderTargetViewHandle, clearColor, 0, nullptr);
+        context.commandList->ClearDepthStencilView(depthStencilViewHandle, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+        DrawRecording::Record(context.filteredCommandList, drawPackets[static_cast<size_t>(RenderLayer::ChannelStencilReader)], instanceBufferAddress);
 
 
 
-    commandList->SetPipelineState(pipelineStates[static_cast<size_t>(RenderLayer::Transparent)].Get());
-    shaderResourceViewHandle.Offset(1, shaderBufferResourceViewsDescriptorSize);
-    commandList->SetGraphicsRootDescriptorTable(2, shaderResourceViewHandle);
-    for (size_t modelIndex = 0; modelIndex < modelCount; ++modelIndex)
-        if(models[modelIndex].renderLayer == RenderLayer::Transparent)
-        {
-            commandList->SetGraphicsRootConstantBufferView(1, models[modelIndex].buffer.dataGPU->GetGPUVirtualAddress());
-            commandList->IASetVertexBuffers(0, 1, &models[modelIndex].mesh->vertexBufferView);
-            commandList->IASetIndexBuffer(&models[modelIndex].mesh->indexBufferView);
-            commandList->DrawIndexedInstanced(models[modelIndex].mesh->indexCount, 1, 0, 0, 0);
-        }*/
-    CD3DX12_RESOURCE_BARRIER backBufferRenderTargetToPresent(CD3DX12_RESOURCE_BARRIER::Transition
-    (
-        renderTargets[frameIndex].Get(),
-        D3D12_RESOURCE_STATE_RENDER_TARGET,
-        D3D12_RESOURCE_STATE_PRESENT
-    ));
-    commandList->ResourceBarrier(1, &backBufferRenderTargetToPresent);
+        context.filteredCommandList.SetPipelineState(Rhi::ToRhi(pipelineStates[static_cast<size_t>(RenderLayer::Transparent)].Get()));
+        shaderResourceViewHandle.Offset(1, shaderBufferResourceViewsDescriptorSize);
+        context.filteredCommandList.SetGraphicsRootDescriptorTable(2, Rhi::ToRhi(shaderResourceViewHandle));
+        DrawRecording::Record(context.filteredCommandList, drawPackets[static_cast<size_t>(RenderLayer::Transparent)], instanceBufferAddress);*/
+        RecordHierarchicalDepth(context);
+        CD3DX12_RESOURCE_BARRIER backBufferRenderTargetToPresent(CD3DX12_RESOURCE_BARRIER::Transition
+        (
+            renderTargets[frameIndex].Get(),
+            D3D12_RESOURCE_STATE_RENDER_TARGET,
+            D3D12_RESOURCE_STATE_PRESENT
+        ));
+        context.commandList->ResourceBarrier(1, &backBufferRenderTargetToPresent);
+    }
+
+    ThrowIfFailed(context.commandList->Close());
+}
 
-    ThrowIfFailed(commandList->Close());
+// Splits the draw packets of every drawn render layer into chunks and records each chunk into a command list
+// of its own, in parallel.
+void D3D12HelloProject::PopulateCommandList()
+{
+    const unsigned threadCount = HardwareThreadCount();
+    recordingChunks.clear();
+    for (RenderLayer renderLayer : { RenderLayer::Opaque })
+    {
+        const std::span<const DrawRecording::DrawPacket> packets = drawPackets[static_cast<size_t>(renderLayer)];
+        const size_t chunkCount = DrawRecording::ChunkCount(packets.size(), threadCount);
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+            recordingChunks.push_back({ renderLayer, DrawRecording::Chunk(packets, chunkCount, chunk) });
+    }
+    // Closed straight away, as a chunk resets the command list it records into.
+    while (recordingContexts.size() < recordingChunks.size())
+        ThrowIfFailed(AddRecordingContext().commandList->Close());
+    ParallelFor(recordingChunks.size(), [this](size_t chunkIndex) { RecordChunk(chunkIndex); }, threadCount);
 }
 
-void D3D12HelloProject::WaitForPreviousFrame()
+// Signals the end of the frame just submitted and moves on to the next back buffer, waiting only until the
+// GPU is done with the frame last recorded into its slot, frameCount frames ago.
+void D3D12HelloProject::MoveToNextFrame()
 {
-    // WAITING FOR THE FRAME TO COMPLETE BEFORE CONTINUING IS NOT BEST PRACTICE.
-    // This is code implemented as such for simplicity. The D3D12HelloFrameBuffering
-    // sample illustrates how to use fences for efficient resource usage and to
-    // maximize GPU utilization.
+    frameFenceValues[frameIndex] = Signal();
+    frameIndex = swapChain->GetCurrentBackBufferIndex();
+    WaitForFence(frameFenceValues[frameIndex]);
+    CollectRetired();
+}
 
-    // Signal and increment the fence value.
-    const UINT64 previousFenceValue = fenceValue;
-    ThrowIfFailed(commandQueue->Signal(fence.Get(), previousFenceValue));
-    fenceValue++;
+// Waits until the GPU is done with everything submitted so far.
+void D3D12HelloProject::WaitForGpu()
+{
+    WaitForFence(Signal());
+}
 
-    // Wait until the previous frame is finished.
-    if (fence->GetCompletedValue() < previousFenceValue)
+// Signals the next fence value after everything submitted so far, returning it.
+UINT64 D3D12HelloProject::Signal()
+{
+    ThrowIfFailed(commandQueue->Signal(fence.Get(), ++fenceValue));
+    return fenceValue;
+}
+
+void D3D12HelloProject::WaitForFence(UINT64 value)
+{
+    if (fence->GetCompletedValue() < value)
     {
-        ThrowIfFailed(fence->SetEventOnCompletion(previousFenceValue, fenceEvent));
+        ThrowIfFailed(fence->SetEventOnCompletion(value, fenceEvent));
         WaitForSingleObject(fenceEvent, INFINITE);
     }
+}
 
-    frameIndex = swapChain->GetCurrentBackBufferIndex();
+// Releases whatever was retired before the last value the GPU has passed.
+void D3D12HelloProject::CollectRetired()
+{
+    const UINT64 releasedByteCount = deletionQueue.Collect(fence->GetCompletedValue());
+    if (m_diagnostics && releasedByteCount > 0)
+        LogDiagnostic(L"Deletion queue: %llu bytes released, %llu bytes of %zu resources pending\n",
+            releasedByteCount, deletionQueue.PendingByteCount(), deletionQueue.PendingResourceCount());
 }
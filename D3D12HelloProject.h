@@ -17,8 +17,23 @@
 #include <numbers>
 #include <algorithm>
 #include <numeric>
+#include <memory>
 #include <DirectXColors.h>
 #include "DDSTextureLoader.h"
+#include "MeshData.h"
+#include "MeshLoader.h"
+#include "MeshOptimiser.h"
+#include "VertexCompression.h"
+#include "Culling.h"
+#include "LevelOfDetailSelection.h"
+#include "OcclusionCulling.h"
+#include "DeletionQueue.h"
+#include "HierarchicalDepth.h"
+#include "DrawSorting.h"
+#include "FilteredCommandList.h"
+#include "D3D12CommandList.h"
+#include "DrawRecording.h"
+#include "Parallel.h"
 #include <dxgidebug.h>
 
 //REMOVE MACROS WHEN MSVC DECIDES TO SUPPORT THE no_unique_address ATTRIBUTE
@@ -28,6 +43,10 @@
 #define MAX_NUMBER_SPOT_LIGHTS 1
 #define MAX_NUMBER_CAPSULE_LIGHTS 0
 
+// Uploads mesh vertices as VertexCompression::PackedPositionNormalUV, half the size of PositionNormalUV,
+// and draws them through the PackedVertex shader.
+#define USE_PACKED_VERTICES false
+
 using namespace DirectX;
 
 // Note that while ComPtr is used to manage the lifetime of resources on the CPU,
@@ -114,17 +133,6 @@ namespace ConstantBuffer
     template<typename T>
     using Data = AlignedBuffer<T, 256>;
 
-    struct PerModel
-    {
-            XMMATRIX model;
-            XMMATRIX textureTransform;
-            XMFLOAT4 diffuseColour;
-            float specularExponent;
-            float specularIntensity;
-        private:
-            XMFLOAT2 padding;
-    };
-
     template<bool useHemisphericAmbientalLighting, unsigned short directionalLightsCount, 
         unsigned short pointLightsCount, unsigned short spotLightsCount, unsigned short capsuleLightsCount>
     struct PerScene
@@ -153,25 +161,41 @@ namespace ConstantBuffer
 
 };
 
+// Data of a model drawn as one instance of an instanced draw, the element of the instance buffer that
+// the shaders index by SV_InstanceID.
+struct PerInstance
+{
+        XMMATRIX model;
+        XMMATRIX textureTransform;
+        XMFLOAT4 diffuseColour;
+        float specularExponent;
+        float specularIntensity;
+    private:
+        XMFLOAT2 padding;
+    public:
+        // Dequantisation of the packed vertex positions of the model mesh, w unused.
+        XMFLOAT4 positionScale;
+        XMFLOAT4 positionOffset;
+};
+
+// Back buffers of the swap chain, which is also how many frames the CPU records ahead of the GPU, 2 or 3.
+constexpr UINT frameCount = 2;
+static_assert(frameCount >= 2 && frameCount <= 3);
+
+// Data the CPU writes and the GPU reads, uploaded into a copy per frame in flight, so that updating the
+// copy of the frame being recorded never touches the ones the GPU may still be reading.
 template<typename T>
 struct WriteBuffer
 {
     T data;
-    ComPtr<ID3D12Resource> dataGPU;
-    void* dataCPU;
-    void Update()
+    std::array<ComPtr<ID3D12Resource>, frameCount> dataGPU;
+    std::array<void*, frameCount> dataCPU;
+    void Update(UINT frame)
     {
-        memcpy(dataCPU, &data, sizeof(data));
+        memcpy(dataCPU[frame], &data, sizeof(data));
     }
 };
 
-struct PositionNormalUV
-{
-    XMFLOAT3 position;
-    XMFLOAT3 normal;
-    XMFLOAT2 uv;
-};
-
 enum class MeshType
 {
     Grid, Parallelepiped, Skull
@@ -184,12 +208,17 @@ struct Mesh
     ComPtr<ID3D12Resource> indexBuffer;
     D3D12_INDEX_BUFFER_VIEW indexBufferView;
     UINT indexCount;
-};
-
-struct MeshData
-{
-    std::vector<PositionNormalUV> vertices;
-    std::vector<UINT> indices;
+    // Drawn one after the other, together covering all indexCount indices.
+    std::vector<Submesh> submeshes;
+    VertexCompression::Dequantisation positionDequantisation;
+    Bounds bounds;
+    // Culled one by one on the CPU when not empty, together covering the first level of detail.
+    std::vector<Meshlet> meshlets;
+    // Ranges of the index buffer drawing the mesh ever coarser, the full mesh first; empty when it has no coarser ones.
+    std::vector<LevelOfDetail> levelsOfDetail;
+    // Triangles rasterised for the opaque models drawing the mesh so that they hide the models behind
+    // them; empty when they hide nothing.
+    OcclusionCulling::OccluderMesh occluder;
 };
 
 enum class RenderLayer
@@ -201,7 +230,65 @@ struct Model
 {
     RenderLayer renderLayer;
     Mesh const* mesh;
-    WriteBuffer<ConstantBuffer::Data<ConstantBuffer::PerModel>> buffer;
+    // Copied into the instance buffer every frame the model is drawn.
+    PerInstance instance;
+    // Bounds of the mesh in world space, refreshed whenever SetModelMatrix changes the model matrix.
+    Bounds worldBounds;
+    // Index into the levels of detail of the mesh, 0 for the full mesh, selected every frame.
+    std::uint32_t levelOfDetail;
+    // Index ranges of the mesh left to draw this frame after culling its meshlets.
+    std::vector<Culling::IndexRange> visibleIndexRanges;
+
+    // Sets the model matrix of the instance data.
+    void SetModelMatrix(FXMMATRIX modelMatrix)
+    {
+        instance.model = XMMatrixTranspose(modelMatrix);
+        XMFLOAT4X4 modelRows;
+        XMStoreFloat4x4(&modelRows, modelMatrix);
+        worldBounds = Culling::TransformBounds(mesh->bounds, modelRows);
+    }
+};
+
+// Consecutive visible models drawn by a single instanced draw, which share their render layer, so
+// pipeline state and material, their mesh and the index ranges of it left to draw.
+struct InstanceGroup
+{
+    RenderLayer renderLayer;
+    Mesh const* mesh;
+    std::span<const Culling::IndexRange> indexRanges;
+    // Range of the instance buffer holding the data of the models.
+    UINT firstInstance;
+    UINT instanceCount;
+};
+
+// A command list with an allocator of its own, so that it can record its share of the frame on any thread,
+// and the filter of the state recorded into it.
+struct RecordingContext
+{
+    // One for every frame in flight, reset once the GPU is done with the frame that last recorded into it.
+    std::array<ComPtr<ID3D12CommandAllocator>, frameCount> commandAllocators;
+    ComPtr<ID3D12GraphicsCommandList> commandList;
+    Rhi::D3D12CommandList rhiCommandList;
+    FilteredCommandList filteredCommandList;
+};
+
+// What the hierarchical depth pyramid a frame built is read back into, and what it was built from.
+struct HierarchicalDepthReadback
+{
+    // Texels of the pyramid followed by the visibility of every tested rectangle, mapped for good and only
+    // ever read once the frame that copied into it is done.
+    ComPtr<ID3D12Resource> buffer;
+    const HierarchicalDepth::DepthRange* texels;
+    // View projection the depth buffer of the pyramid was rendered with.
+    XMFLOAT4X4 viewProjection;
+    UINT rectangleCount;
+};
+
+// Consecutive draw packets of a render layer recorded into one command list.
+struct RecordingChunk
+{
+    RenderLayer renderLayer;
+    std::span<const DrawRecording::DrawPacket> packets;
 };
 
 template<size_t sourceCount, size_t... vectorSizeInitialisers>
@@ -211,13 +298,14 @@ constexpr std::array<size_t, sizeof... (vectorSizeInitialisers)> Organise()
     return { vectorSizeInitialisers... };
 }
 
-constexpr UINT frameCount = 2;
 constexpr size_t meshCount = 3;
 constexpr size_t renderLayerCount = 3;
-constexpr std::array<size_t, meshCount> modelsPerMesh{ 6, 4, 0 };
+constexpr std::array<size_t, meshCount> modelsPerMesh{ 6, 4, 3 };
 constexpr size_t modelCount = std::accumulate(modelsPerMesh.begin(), modelsPerMesh.end(), 0);
-constexpr std::array<size_t, renderLayerCount> modelsPerRenderLayer = Organise<modelCount, 1, 3, 6>();
+constexpr std::array<size_t, renderLayerCount> modelsPerRenderLayer = Organise<modelCount, 4, 3, 6>();
 constexpr size_t textureCount = 3;
+constexpr float cameraNearPlane = 1;
+constexpr float cameraFarPlane = 1000;
 
 class D3D12HelloProject : public DXSample
 {
@@ -248,7 +336,6 @@ private:
     ComPtr<ID3D12Device> device;
     std::array<ComPtr<ID3D12Resource>, frameCount> renderTargets;
     ComPtr<ID3D12Resource> depthStencilBuffer;
-    ComPtr<ID3D12CommandAllocator> commandAllocator;
     ComPtr<ID3D12CommandQueue> commandQueue;
     ComPtr<ID3D12RootSignature> rootSignature;
     ComPtr<ID3D12DescriptorHeap> renderTargetViewHeap;
@@ -256,7 +343,11 @@ private:
     ComPtr<ID3D12DescriptorHeap> constantBufferViewHeap;
     ComPtr<ID3D12DescriptorHeap> shaderResourceViewHeap;
     std::array<ComPtr<ID3D12PipelineState>, 4> pipelineStates;
-    ComPtr<ID3D12GraphicsCommandList> commandList;
+    // Command lists the chunks of the frame are recorded into in parallel and submitted in order, the first
+    // one also recording the uploads of LoadAssets. Only ever grown, as the chunks of a frame need them.
+    std::vector<std::unique_ptr<RecordingContext>> recordingContexts;
+    // Chunks of the frame, each recorded into the recording context of the same index.
+    std::vector<RecordingChunk> recordingChunks;
     UINT renderTargetViewDescriptorSize;
     UINT depthStencilViewDescriptorSize;
     UINT shaderBufferResourceViewsDescriptorSize;
@@ -265,47 +356,147 @@ private:
     std::array<Mesh, meshCount> meshes;
     std::array<Model, modelCount> models;
     WriteBuffer<PerScene> perSceneBuffer;
+    // Indices into models of the first visibleModelCount models inside the view frustum and not hidden by
+    // occluders, in the order of their draw keys.
+    std::array<std::uint32_t, modelCount> visibleModelIndices;
+    size_t visibleModelCount;
+    std::array<std::uint64_t, modelCount> drawKeys;
+    DrawSorting::RadixSorter drawSorter;
+    // Data of the visible models in the order of visibleModelIndices, refilled every frame.
+    WriteBuffer<std::array<PerInstance, modelCount>> instanceBuffer;
+    std::array<InstanceGroup, modelCount> instanceGroups;
+    size_t instanceGroupCount;
+    // Draw packets of the instance groups per render layer, only rebuilt when the drawn models or the
+    // parts of their meshes they draw change, which drawPacketSignature tracks.
+    std::array<std::vector<DrawRecording::DrawPacket>, 4> drawPackets;
+    std::vector<std::uint32_t> drawPacketSignature;
+    OcclusionCulling::DepthBuffer occlusionDepthBuffer;
+    // Pyramid of the depth buffer built on the GPU at the end of every frame and read back, against which
+    // the models of the frames after it are tested.
+    ComPtr<ID3D12RootSignature> hierarchicalDepthRootSignature;
+    // BuildFirstLevel, BuildLevel and TestRectangles.
+    std::array<ComPtr<ID3D12PipelineState>, 3> hierarchicalDepthPipelineStates;
+    std::vector<HierarchicalDepth::Level> hierarchicalDepthLevels;
+    ComPtr<ID3D12Resource> hierarchicalDepthLevelBuffer;
+    // Texels of the pyramid followed by the visibility of every tested rectangle.
+    ComPtr<ID3D12Resource> hierarchicalDepthBuffer;
+    std::array<HierarchicalDepthReadback, frameCount> hierarchicalDepthReadbacks;
+    WriteBuffer<std::array<HierarchicalDepth::ScreenRectangle, modelCount>> hierarchicalDepthRectangles;
     ComPtr<ID3D12Resource> channelStencilTexture;
     std::array<ComPtr<ID3D12Resource>, textureCount> shaderResourceViewDefaultBuffers;
+    // Only needed until the initial copy into the default buffers is done, when they are retired.
     std::array<ComPtr<ID3D12Resource>, textureCount> shaderResourceViewUploadBuffers;
     XMFLOAT2 lastMousePosition;
     XMFLOAT3 cameraUp, cameraForward, cameraRight;
 
     // Synchronization objects.
+    // Back buffer and slot of the per frame resources the frame being recorded uses.
     UINT frameIndex;
     HANDLE fenceEvent;
     ComPtr<ID3D12Fence> fence;
+    // Last value signalled, and the value signalled after the frame last submitted from every slot, 0 before
+    // there was one.
     UINT64 fenceValue;
+    std::array<UINT64, frameCount> frameFenceValues;
+    // Resources and descriptors retired mid-run, released once the GPU is done with them.
+    DeletionQueue deletionQueue;
 
     void LoadPipeline();
     void LoadAssets();
+    static MeshCounts ParallelepipedCounts();
+    static MeshCounts GridCounts(UINT vertexColumnCount, UINT vertexRowsCount);
+    template<typename Index>
+    Bounds CreateParallelepiped(float width, float height, float depth, MeshSpans<Index> parallelepiped);
     void CreateParallelepiped(float width, float height, float depth, MeshData& parallelepiped);
+    template<typename Index>
+    Bounds CreateGrid(float width, float depth, UINT vertexColumnCount, UINT vertexRowsCount, MeshSpans<Index> grid);
     void CreateGrid(float width, float depth, UINT vertexColumnCount, UINT vertexRowsCount, MeshData& grid);
+    void CreateMesh(std::span<const PositionNormalUV> vertices, std::span<const std::uint32_t> indices, Mesh& mesh);
     void CreateMesh(const MeshData& data, Mesh& mesh);
+    template<typename Producer>
+    void CreateMesh(MeshCounts counts, Producer&& produce, Mesh& mesh);
+    void* CreateMappedUploadBuffer(UINT size, ComPtr<ID3D12Resource>& buffer);
+    template<typename T>
+    void CreateWriteBuffer(WriteBuffer<T>& buffer);
+    void* CreateVertexBuffer(UINT vertexCount, Mesh& mesh);
+    void UploadVertices(std::span<const PositionNormalUV> vertices, Mesh& mesh);
+    std::uint16_t* CreateIndexBuffer(UINT indexCount, Mesh& mesh);
+    void AppendDrawPackets(const Mesh& mesh, std::span<const Culling::IndexRange> indexRanges, UINT64 instanceOffset,
+        UINT instanceCount, std::vector<DrawRecording::DrawPacket>& packets);
+    void SelectLevelsOfDetail(const XMMATRIX& projection, const XMFLOAT3& cameraPosition);
+    void CullModels();
+    void SortModels(const XMFLOAT3& cameraPosition);
+    void GroupInstances();
+    void BuildDrawPackets();
+    void CreateHierarchicalDepth();
+    void RecordHierarchicalDepth(RecordingContext& context);
+    void ValidateHierarchicalDepth(UINT frame);
     template<typename T>
     void CreateConstantBuffer(CD3DX12_CPU_DESCRIPTOR_HANDLE& descriptorHandle, WriteBuffer<T>& buffer);
+    RecordingContext& AddRecordingContext();
+    void SetRenderLayerState(RecordingContext& context, RenderLayer renderLayer);
+    void RecordChunk(size_t chunkIndex);
     void PopulateCommandList();
-    void WaitForPreviousFrame();
+    void MoveToNextFrame();
+    void WaitForGpu();
+    UINT64 Signal();
+    void WaitForFence(UINT64 value);
+    void CollectRetired();
+    void LogStateFiltering();
 };
 
+// Creates the mapped upload buffers of every frame in flight of buffer.
+template<typename T>
+void D3D12HelloProject::CreateWriteBuffer(WriteBuffer<T>& buffer)
+{
+    for (UINT frame = 0; frame < frameCount; ++frame)
+        buffer.dataCPU[frame] = CreateMappedUploadBuffer(sizeof(buffer.data), buffer.dataGPU[frame]);
+}
+
+// Creates the buffers of buffer and a constant buffer view of every one of them, in the order of their
+// frames from descriptorHandle on.
 template<typename T>
 void D3D12HelloProject::CreateConstantBuffer(CD3DX12_CPU_DESCRIPTOR_HANDLE& descriptorHandle, WriteBuffer<T>& buffer)
 {
-    UINT constantBufferSize = sizeof(buffer.data);
-    CD3DX12_HEAP_PROPERTIES uploadProperties(D3D12_HEAP_TYPE_UPLOAD);
-    CD3DX12_RESOURCE_DESC constantBufferDescription(CD3DX12_RESOURCE_DESC::Buffer(constantBufferSize));
-    ThrowIfFailed(device->CreateCommittedResource(
-        &uploadProperties,
-        D3D12_HEAP_FLAG_NONE,
-        &constantBufferDescription,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr,
-        IID_PPV_ARGS(&buffer.dataGPU)));
-    D3D12_CONSTANT_BUFFER_VIEW_DESC constantBufferViewDescription = {};
-    constantBufferViewDescription.BufferLocation = buffer.dataGPU->GetGPUVirtualAddress();
-    constantBufferViewDescription.SizeInBytes = constantBufferSize;
-    device->CreateConstantBufferView(&constantBufferViewDescription, descriptorHandle);
-    descriptorHandle.Offset(1, shaderBufferResourceViewsDescriptorSize);
-    CD3DX12_RANGE readRange(0, 0);
-    ThrowIfFailed(buffer.dataGPU->Map(0, &readRange, &buffer.dataCPU));
+    CreateWriteBuffer(buffer);
+    for (UINT frame = 0; frame < frameCount; ++frame)
+    {
+        D3D12_CONSTANT_BUFFER_VIEW_DESC constantBufferViewDescription = {};
+        constantBufferViewDescription.BufferLocation = buffer.dataGPU[frame]->GetGPUVirtualAddress();
+        constantBufferViewDescription.SizeInBytes = sizeof(buffer.data);
+        device->CreateConstantBufferView(&constantBufferViewDescription, descriptorHandle);
+        descriptorHandle.Offset(1, shaderBufferResourceViewsDescriptorSize);
+    }
+}
+
+// Creates the vertex and index upload buffers of mesh from counts, letting produce(MeshSpans<Index>) write
+// into them and return the bounds of the vertices. A mesh whose vertices all fit 16 bit indices has them
+// written straight into the mapped index buffer, and its vertices straight into the mapped vertex buffer
+// unless they are packed, in which case only the vertices are produced into a temporary buffer first.
+// A mesh that needs splitting into submeshes is produced into temporary buffers as a whole first.
+template<typename Producer>
+void D3D12HelloProject::CreateMesh(MeshCounts counts, Producer&& produce, Mesh& mesh)
+{
+    assert(mesh.indexCount == 0);
+    if (counts.vertexCount <= MeshOptimiser::shortIndexVertexCount)
+    {
+        std::span<std::uint16_t> indices{ CreateIndexBuffer(counts.indexCount, mesh), counts.indexCount };
+#if USE_PACKED_VERTICES
+        std::vector<PositionNormalUV> vertices(counts.vertexCount);
+        mesh.bounds = produce(MeshSpans<std::uint16_t>{ vertices, indices });
+        UploadVertices(vertices, mesh);
+#else
+        void* vertexDataBegin = CreateVertexBuffer(counts.vertexCount, mesh);
+        mesh.bounds = produce(MeshSpans<std::uint16_t>{ { static_cast<PositionNormalUV*>(vertexDataBegin), counts.vertexCount }, indices });
+        mesh.vertexBuffer->Unmap(0, nullptr);
+        mesh.positionDequantisation = { { 1, 1, 1 }, { 0, 0, 0 } };
+#endif
+        mesh.indexBuffer->Unmap(0, nullptr);
+        mesh.submeshes = { { 0, counts.indexCount, 0 } };
+        return;
+    }
+    std::vector<PositionNormalUV> vertices(counts.vertexCount);
+    std::vector<std::uint32_t> indices(counts.indexCount);
+    produce(MeshSpans<std::uint32_t>{ vertices, indices });
+    CreateMesh(vertices, indices, mesh);
 }
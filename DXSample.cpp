@@ -18,7 +18,8 @@ DXSample::DXSample(UINT width, UINT height, std::wstring name) :
     m_width(width),
     m_height(height),
     m_title(name),
-    m_useWarpDevice(false)
+    m_useWarpDevice(false),
+    m_diagnostics(false)
 {
     WCHAR assetsPath[512];
     GetAssetsPath(assetsPath, _countof(assetsPath));
@@ -123,5 +124,10 @@ void DXSample::ParseCommandLineArgs(WCHAR* argv[], int argc)
             m_useWarpDevice = true;
             m_title = m_title + L" (WARP)";
         }
+        else if (_wcsnicmp(argv[i], L"-diagnostics", wcslen(argv[i])) == 0 ||
+            _wcsnicmp(argv[i], L"/diagnostics", wcslen(argv[i])) == 0)
+        {
+            m_diagnostics = true;
+        }
     }
 }
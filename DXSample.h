@@ -57,6 +57,9 @@ protected:
     // Adapter info.
     bool m_useWarpDevice;
 
+    // Whether to validate GPU work against the CPU and log what was found to the debugger.
+    bool m_diagnostics;
+
 private:
     // Root assets path.
     std::wstring m_assetsPath;
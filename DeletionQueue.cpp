@@ -0,0 +1,32 @@
+#include "stdafx.h"
+#include "DXSampleHelper.h"
+#include "DeletionQueue.h"
+#include <cassert>
+#include <utility>
+
+void DeletionQueue::Retire(ComPtr<ID3D12Resource> resource, UINT64 fenceValue)
+{
+    if (!resource)
+        return;
+    assert(resources.empty() || resources.back().fenceValue <= fenceValue);
+    // The size of the allocation backing the resource, which for a texture is more than its texels.
+    ComPtr<ID3D12Device> device;
+    ThrowIfFailed(resource->GetDevice(IID_PPV_ARGS(&device)));
+    const D3D12_RESOURCE_DESC description = resource->GetDesc();
+    const UINT64 byteCount = device->GetResourceAllocationInfo(0, 1, &description).SizeInBytes;
+    resources.push_back({ std::move(resource), fenceValue, byteCount });
+    pendingByteCount += byteCount;
+}
+
+UINT64 DeletionQueue::Collect(UINT64 completedFenceValue)
+{
+    UINT64 byteCount = 0;
+    while (!resources.empty() && resources.front().fenceValue <= completedFenceValue)
+    {
+        byteCount += resources.front().byteCount;
+        resources.pop_front();
+    }
+    pendingByteCount -= byteCount;
+    releasedByteCount += byteCount;
+    return byteCount;
+}
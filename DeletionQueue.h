@@ -0,0 +1,39 @@
+#pragma once
+
+#include <d3d12.h>
+#include <wrl/client.h>
+#include <cstddef>
+#include <deque>
+
+// Keeps the resources retired by the CPU alive until the GPU is done with them, that is until the fence passes
+// the value it was tagged with, the value signalled after the last command list using them.
+class DeletionQueue
+{
+public:
+    DeletionQueue() : pendingByteCount(0), releasedByteCount(0) {}
+    DeletionQueue(const DeletionQueue&) = delete;
+    DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+    // Fence values must not decrease from one retirement to the next.
+    void Retire(Microsoft::WRL::ComPtr<ID3D12Resource> resource, UINT64 fenceValue);
+    // Releases everything retired at or before completedFenceValue, returning the bytes released.
+    UINT64 Collect(UINT64 completedFenceValue);
+
+    // Memory of the resources retired but not released yet, and released so far.
+    UINT64 PendingByteCount() const { return pendingByteCount; }
+    UINT64 ReleasedByteCount() const { return releasedByteCount; }
+    std::size_t PendingResourceCount() const { return resources.size(); }
+
+private:
+    struct RetiredResource
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+        UINT64 fenceValue;
+        UINT64 byteCount;
+    };
+
+    // In order of their fence values, so that collecting only looks at the front.
+    std::deque<RetiredResource> resources;
+    UINT64 pendingByteCount;
+    UINT64 releasedByteCount;
+};
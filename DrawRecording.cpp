@@ -0,0 +1,108 @@
+#include "DrawRecording.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <vector>
+#include "FilteredCommandList.h"
+#include "Parallel.h"
+#include "RecordingCommandList.h"
+
+namespace DrawRecording
+{
+    void Record(Rhi::CommandList& commandList, std::span<const DrawPacket> packets, Rhi::GpuAddress instanceBuffer)
+    {
+        for (const DrawPacket& packet : packets)
+        {
+            commandList.SetGraphicsRootShaderResourceView(instancesRootParameter, instanceBuffer + packet.instanceOffset);
+            commandList.IASetVertexBuffers(0, 1, &packet.vertexBufferView);
+            commandList.IASetIndexBuffer(&packet.indexBufferView);
+            commandList.DrawIndexedInstanced(packet.indexCount, packet.instanceCount, packet.startIndex, packet.baseVertex, 0);
+        }
+    }
+
+    std::size_t ChunkCount(std::size_t packetCount, unsigned threadCount)
+    {
+        return std::clamp<std::size_t>(packetCount / minimumChunkDrawCount, 1, std::max(1u, threadCount));
+    }
+
+    std::span<const DrawPacket> Chunk(std::span<const DrawPacket> packets, std::size_t chunkCount, std::size_t chunk)
+    {
+        const std::size_t begin = packets.size() * chunk / chunkCount;
+        const std::size_t end = packets.size() * (chunk + 1) / chunkCount;
+        return packets.subspan(begin, end - begin);
+    }
+
+    RecordingBenchmarkResult Benchmark(std::size_t drawCount, unsigned iterations)
+    {
+        using Clock = std::chrono::steady_clock;
+        constexpr std::size_t meshCount = 100;
+        constexpr std::uint32_t instancesPerDraw = 4, instanceSize = 192;
+        constexpr Rhi::GpuAddress instanceBuffer = 0x10000;
+        std::vector<DrawPacket> packets(drawCount);
+        for (std::size_t draw = 0; draw < drawCount; ++draw)
+        {
+            const std::uint32_t mesh = static_cast<std::uint32_t>(draw * meshCount / drawCount);
+            DrawPacket& packet = packets[draw];
+            packet.instanceOffset = draw * instancesPerDraw * instanceSize;
+            packet.vertexBufferView = { 0x1000000 + mesh * 0x10000ull, 0x10000, 32 };
+            packet.indexBufferView = { 0x8000000 + mesh * 0x10000ull, 0x10000, Rhi::IndexFormat::Uint16 };
+            packet.indexCount = 36;
+            packet.instanceCount = instancesPerDraw;
+            packet.startIndex = 0;
+            packet.baseVertex = 0;
+        }
+
+        auto addBuffers = [&](Rhi::RecordingCommandList& recording)
+        {
+            recording.AddBuffer(instanceBuffer, drawCount * instancesPerDraw * instanceSize);
+            for (std::uint32_t mesh = 0; mesh < meshCount; ++mesh)
+            {
+                recording.AddBuffer(0x1000000 + mesh * 0x10000ull, 0x10000);
+                recording.AddBuffer(0x8000000 + mesh * 0x10000ull, 0x10000);
+            }
+        };
+
+        const unsigned threadCount = HardwareThreadCount();
+        RecordingBenchmarkResult result{ drawCount, std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), 0, 0,
+            ChunkCount(drawCount, threadCount), std::numeric_limits<double>::max() };
+        Rhi::RecordingCommandList recording;
+        addBuffers(recording);
+        FilteredCommandList filtered;
+        for (bool filter : { false, true })
+        {
+            double& nanosecondsPerDraw = filter ? result.filteredNanosecondsPerDraw : result.nanosecondsPerDraw;
+            for (unsigned iteration = 0; iteration < iterations; ++iteration)
+            {
+                recording.Clear();
+                const Clock::time_point start = Clock::now();
+                if (filter)
+                {
+                    filtered.Begin(recording, nullptr);
+                    Record(filtered, packets, instanceBuffer);
+                }
+                else
+                    Record(recording, packets, instanceBuffer);
+                nanosecondsPerDraw = std::min(nanosecondsPerDraw,
+                    std::chrono::duration<double, std::nano>(Clock::now() - start).count() / std::max<std::size_t>(1, drawCount));
+            }
+            (filter ? result.filteredStreamBytes : result.streamBytes) = recording.Stream().size();
+        }
+
+        std::vector<Rhi::RecordingCommandList> chunkRecordings(result.chunkCount);
+        std::for_each(chunkRecordings.begin(), chunkRecordings.end(), addBuffers);
+        std::vector<FilteredCommandList> chunkFilters(result.chunkCount);
+        for (unsigned iteration = 0; iteration < iterations; ++iteration)
+        {
+            const Clock::time_point start = Clock::now();
+            ParallelFor(result.chunkCount, [&](std::size_t chunk)
+            {
+                chunkRecordings[chunk].Clear();
+                chunkFilters[chunk].Begin(chunkRecordings[chunk], nullptr);
+                Record(chunkFilters[chunk], Chunk(packets, result.chunkCount, chunk), instanceBuffer);
+            }, threadCount);
+            result.parallelNanosecondsPerDraw = std::min(result.parallelNanosecondsPerDraw,
+                std::chrono::duration<double, std::nano>(Clock::now() - start).count() / std::max<std::size_t>(1, drawCount));
+        }
+        return result;
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include "Rhi.h"
+
+// Recording of the draws of a frame through the render hardware interface, shared by the renderer
+// and headless runs.
+namespace DrawRecording
+{
+    // Everything a draw of the submesh parts an instance group draws needs, so that recording a layer is a
+    // linear scan of its packets. Instances are an offset into the instance buffer, so that the same packets
+    // draw from the copy of any frame in flight.
+    struct DrawPacket
+    {
+        std::uint64_t instanceOffset;
+        Rhi::VertexBufferView vertexBufferView;
+        Rhi::IndexBufferView indexBufferView;
+        std::uint32_t indexCount;
+        std::uint32_t instanceCount;
+        std::uint32_t startIndex;
+        std::int32_t baseVertex;
+    };
+
+    // Root parameter of the instance buffer of a draw.
+    constexpr std::uint32_t instancesRootParameter = 1;
+
+    // Binds the instances in instanceBuffer and buffers of every packet and draws it.
+    void Record(Rhi::CommandList& commandList, std::span<const DrawPacket> packets, Rhi::GpuAddress instanceBuffer);
+
+    // Fewest draws worth a command list of their own; below that, the cost of another list and of binding
+    // the state of the layer again outweighs recording the draws on another thread.
+    constexpr std::size_t minimumChunkDrawCount = 2048;
+
+    // Number of chunks the packetCount packets of a layer are recorded in on up to threadCount threads, at
+    // least one even when there are no packets.
+    std::size_t ChunkCount(std::size_t packetCount, unsigned threadCount);
+
+    // The chunk-th of chunkCount consecutive chunks of packets of nearly equal size.
+    std::span<const DrawPacket> Chunk(std::span<const DrawPacket> packets, std::size_t chunkCount, std::size_t chunk);
+
+    struct RecordingBenchmarkResult
+    {
+        std::size_t drawCount;
+        double nanosecondsPerDraw;
+        double filteredNanosecondsPerDraw;
+        std::size_t streamBytes;
+        std::size_t filteredStreamBytes;
+        // Filtered recording of the packets split into chunkCount chunks, each into a list of its own, on
+        // every hardware thread.
+        std::size_t chunkCount;
+        double parallelNanosecondsPerDraw;
+    };
+
+    // Time to record drawCount packets of instance groups sorted by mesh, a hundred meshes and a few
+    // instances each, into a RecordingCommandList, directly and through a FilteredCommandList, the best
+    // of iterations runs each, and the size of the streams they record, along with the time to record them
+    // filtered in chunks on every thread.
+    RecordingBenchmarkResult Benchmark(std::size_t drawCount, unsigned iterations);
+}
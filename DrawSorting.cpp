@@ -0,0 +1,184 @@
+#include "DrawSorting.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <random>
+
+namespace DrawSorting
+{
+    namespace
+    {
+        constexpr std::uint64_t Field(std::uint32_t value, unsigned bits)
+        {
+            return value & ((std::uint64_t(1) << bits) - 1);
+        }
+    }
+
+    std::uint32_t QuantiseDepth(float viewDepth, float nearPlane, float farPlane)
+    {
+        const float normalised = std::clamp((viewDepth - nearPlane) / (farPlane - nearPlane), 0.0f, 1.0f);
+        return static_cast<std::uint32_t>(normalised * ((1u << depthBits) - 1));
+    }
+
+    std::uint64_t MakeKey(const DrawDescription& draw)
+    {
+        std::uint64_t key = Field(draw.layer, layerBits) << (64 - layerBits);
+        if (draw.backToFront)
+        {
+            const std::uint32_t invertedDepth = ((1u << depthBits) - 1) - draw.depth;
+            key |= Field(invertedDepth, depthBits) << (pipelineBits + materialBits + meshBits);
+            key |= Field(draw.pipeline, pipelineBits) << (materialBits + meshBits);
+            key |= Field(draw.material, materialBits) << meshBits;
+            key |= Field(draw.mesh, meshBits);
+        }
+        else
+        {
+            key |= Field(draw.pipeline, pipelineBits) << (materialBits + meshBits + depthBits);
+            key |= Field(draw.material, materialBits) << (meshBits + depthBits);
+            key |= Field(draw.mesh, meshBits) << depthBits;
+            key |= Field(draw.depth, depthBits);
+        }
+        return key;
+    }
+
+    void RadixSorter::Sort(std::span<std::uint64_t> keys, std::span<std::uint32_t> values, unsigned threadCount)
+    {
+        constexpr std::size_t digitCount = 256, passCount = 8;
+        const std::size_t count = keys.size();
+        if (count < 2)
+            return;
+        keyScratch.resize(count);
+        valueScratch.resize(count);
+        const std::size_t blockCount = std::clamp<std::size_t>(count / minimumBlockSize, 1, std::max(1u, threadCount));
+        histograms.resize(blockCount * passCount * digitCount);
+        std::span<std::uint64_t> sourceKeys = keys, destinationKeys = keyScratch;
+        std::span<std::uint32_t> sourceValues = values, destinationValues = valueScratch;
+        auto blockHistogram = [&](std::size_t block, std::size_t pass)
+        {
+            return &histograms[(block * passCount + pass) * digitCount];
+        };
+        // A single read counts the digits of every pass, block by block. The counts tell which passes can
+        // be skipped, their digit being the same for every key, and stay those of the blocks until a pass
+        // moves keys from one block to another.
+        ParallelFor(blockCount, [&](std::size_t block)
+        {
+            std::size_t counts[passCount][digitCount]{};
+            const std::uint64_t* blockKeys = sourceKeys.data();
+            const std::size_t end = (block + 1) * count / blockCount;
+            for (std::size_t index = block * count / blockCount; index < end; ++index)
+                for (std::size_t pass = 0; pass < passCount; ++pass)
+                    ++counts[pass][(blockKeys[index] >> (8 * pass)) & (digitCount - 1)];
+            for (std::size_t pass = 0; pass < passCount; ++pass)
+                std::copy_n(counts[pass], digitCount, blockHistogram(block, pass));
+        }, threadCount);
+        bool scattered = false;
+        for (std::size_t pass = 0; pass < passCount; ++pass)
+        {
+            const unsigned shift = static_cast<unsigned>(8 * pass);
+            const std::size_t firstDigit = (sourceKeys[0] >> shift) & (digitCount - 1);
+            std::size_t firstDigitCount = 0;
+            for (std::size_t block = 0; block < blockCount; ++block)
+                firstDigitCount += blockHistogram(block, pass)[firstDigit];
+            if (firstDigitCount == count)
+                continue;
+            if (scattered && blockCount > 1)
+                ParallelFor(blockCount, [&](std::size_t block)
+                {
+                    std::size_t counts[digitCount]{};
+                    const std::uint64_t* blockKeys = sourceKeys.data();
+                    const std::size_t end = (block + 1) * count / blockCount;
+                    for (std::size_t index = block * count / blockCount; index < end; ++index)
+                        ++counts[(blockKeys[index] >> shift) & (digitCount - 1)];
+                    std::copy_n(counts, digitCount, blockHistogram(block, pass));
+                }, threadCount);
+            // Each block scatters its keys of a digit after those of the smaller digits and of the same
+            // digit in the blocks before it, which keeps the sort stable.
+            std::size_t offset = 0;
+            for (std::size_t digit = 0; digit < digitCount; ++digit)
+                for (std::size_t block = 0; block < blockCount; ++block)
+                {
+                    std::size_t& digitOffset = blockHistogram(block, pass)[digit];
+                    const std::size_t digitKeyCount = digitOffset;
+                    digitOffset = offset;
+                    offset += digitKeyCount;
+                }
+            ParallelFor(blockCount, [&](std::size_t block)
+            {
+                // Local copies, which the stores into the keys cannot alias.
+                std::size_t offsets[digitCount];
+                std::copy_n(blockHistogram(block, pass), digitCount, offsets);
+                const std::uint64_t* blockKeys = sourceKeys.data();
+                const std::uint32_t* blockValues = sourceValues.data();
+                std::uint64_t* scatteredKeys = destinationKeys.data();
+                std::uint32_t* scatteredValues = destinationValues.data();
+                const std::size_t end = (block + 1) * count / blockCount;
+                for (std::size_t index = block * count / blockCount; index < end; ++index)
+                {
+                    const std::size_t destination = offsets[(blockKeys[index] >> shift) & (digitCount - 1)]++;
+                    scatteredKeys[destination] = blockKeys[index];
+                    scatteredValues[destination] = blockValues[index];
+                }
+            }, threadCount);
+            std::swap(sourceKeys, destinationKeys);
+            std::swap(sourceValues, destinationValues);
+            scattered = true;
+        }
+        if (sourceKeys.data() != keys.data())
+        {
+            std::copy(sourceKeys.begin(), sourceKeys.end(), keys.begin());
+            std::copy(sourceValues.begin(), sourceValues.end(), values.begin());
+        }
+    }
+
+    SortBenchmarkResult Benchmark(std::size_t drawCount, unsigned iterations)
+    {
+        using Clock = std::chrono::steady_clock;
+        // Draws spread over four layers, the last blended, with a few pipelines, hundreds of materials
+        // and a thousand meshes at random depths.
+        std::mt19937 random(1);
+        std::uniform_int_distribution<std::uint32_t> layer(0, 3), material(0, 255), mesh(0, 1023), depth(0, (1u << depthBits) - 1);
+        std::vector<std::uint64_t> keys(drawCount);
+        for (std::uint64_t& key : keys)
+        {
+            const std::uint32_t drawLayer = layer(random);
+            key = MakeKey({ drawLayer, drawLayer, material(random), mesh(random), depth(random), drawLayer == 3 });
+        }
+        std::vector<std::uint32_t> indices(drawCount);
+        for (std::uint32_t index = 0; index < drawCount; ++index)
+            indices[index] = index;
+
+        SortBenchmarkResult result{ drawCount, std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+            std::numeric_limits<double>::max(), true };
+        // Sorting by key then index gives the order of a stable sort by key.
+        std::vector<std::pair<std::uint64_t, std::uint32_t>> reference(drawCount), draws(drawCount);
+        for (std::size_t draw = 0; draw < drawCount; ++draw)
+            reference[draw] = { keys[draw], indices[draw] };
+        for (unsigned iteration = 0; iteration < iterations; ++iteration)
+        {
+            draws = reference;
+            const Clock::time_point start = Clock::now();
+            std::sort(draws.begin(), draws.end());
+            result.stdSortMilliseconds = std::min(result.stdSortMilliseconds,
+                std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+        RadixSorter sorter;
+        std::vector<std::uint64_t> sortedKeys;
+        std::vector<std::uint32_t> sortedIndices;
+        for (bool parallel : { false, true })
+        {
+            const unsigned threadCount = parallel ? HardwareThreadCount() : 1;
+            double& milliseconds = parallel ? result.parallelRadixSortMilliseconds : result.radixSortMilliseconds;
+            for (unsigned iteration = 0; iteration < iterations; ++iteration)
+            {
+                sortedKeys = keys;
+                sortedIndices = indices;
+                const Clock::time_point start = Clock::now();
+                sorter.Sort(sortedKeys, sortedIndices, threadCount);
+                milliseconds = std::min(milliseconds, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+            }
+            for (std::size_t draw = 0; draw < drawCount; ++draw)
+                result.identical &= sortedKeys[draw] == draws[draw].first && sortedIndices[draw] == draws[draw].second;
+        }
+        return result;
+    }
+}
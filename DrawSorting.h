@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "Parallel.h"
+
+// Orders the draws of a frame by 64 bit keys, so that draws sharing state follow each other and
+// draws are depth sorted the way their layer needs.
+namespace DrawSorting
+{
+    // Bits of every field of a key. The layer always comes first, then for depth tested layers the
+    // pipeline, material, mesh and depth front to back, and for blended ones the depth back to front
+    // before the rest.
+    constexpr unsigned layerBits = 4;
+    constexpr unsigned pipelineBits = 6;
+    constexpr unsigned materialBits = 16;
+    constexpr unsigned meshBits = 14;
+    constexpr unsigned depthBits = 24;
+    static_assert(layerBits + pipelineBits + materialBits + meshBits + depthBits == 64);
+
+    struct DrawDescription
+    {
+        std::uint32_t layer;
+        std::uint32_t pipeline;
+        std::uint32_t material;
+        std::uint32_t mesh;
+        // Distance along the view direction, quantised by QuantiseDepth.
+        std::uint32_t depth;
+        bool backToFront;
+    };
+
+    // View depth in [nearPlane, farPlane], clamped, as a depthBits integer growing with the depth.
+    std::uint32_t QuantiseDepth(float viewDepth, float nearPlane, float farPlane);
+    // Fields wider than their bits are truncated.
+    std::uint64_t MakeKey(const DrawDescription& draw);
+
+    // Stable least significant digit radix sort of keys, eight bits a pass, carrying values along.
+    // Passes whose digit is the same for every key are skipped. Keeps its scratch memory between sorts.
+    class RadixSorter
+    {
+    public:
+        // Sorts on up to threadCount threads, each histogramming then scattering its own block of the
+        // keys every pass, or on the calling thread alone under minimumBlockSize keys a thread.
+        void Sort(std::span<std::uint64_t> keys, std::span<std::uint32_t> values, unsigned threadCount = HardwareThreadCount());
+
+    private:
+        static constexpr std::size_t minimumBlockSize = 1 << 14;
+        std::vector<std::uint64_t> keyScratch;
+        std::vector<std::uint32_t> valueScratch;
+        std::vector<std::size_t> histograms;
+    };
+
+    struct SortBenchmarkResult
+    {
+        std::size_t drawCount;
+        double stdSortMilliseconds;
+        double radixSortMilliseconds;
+        double parallelRadixSortMilliseconds;
+        // Whether both radix sorts ordered the draws exactly as std::stable_sort does.
+        bool identical;
+    };
+
+    // Time to sort the keys of drawCount random draws, with their indices, through std::sort, the radix
+    // sort on one thread and on every hardware thread, the best of iterations runs each.
+    SortBenchmarkResult Benchmark(std::size_t drawCount, unsigned iterations);
+}
@@ -0,0 +1,176 @@
+#include "FilteredCommandList.h"
+#include <algorithm>
+#include <cstring>
+
+FilteredCommandList::FilteredCommandList() :
+    commandList{}, callCounts{}, pipelineState{}, rootSignature{}, rootArguments{}, vertexBufferViews{},
+    boundVertexBufferSlots{}, indexBufferView{}, indexBufferBound{}, primitiveTopology{}, stencilReference{},
+    stencilReferenceBound{}
+{
+    UnbindRootArguments();
+}
+
+void FilteredCommandList::Begin(Rhi::CommandList& commandList, Rhi::PipelineState* initialState)
+{
+    this->commandList = &commandList;
+    pipelineState = initialState;
+    rootSignature = nullptr;
+    UnbindRootArguments();
+    boundVertexBufferSlots = 0;
+    indexBufferBound = false;
+    primitiveTopology = Rhi::PrimitiveTopology::Undefined;
+    stencilReferenceBound = false;
+}
+
+void FilteredCommandList::SetPipelineState(Rhi::PipelineState* pipelineState)
+{
+    if (Submit(Call::PipelineState, pipelineState == this->pipelineState))
+    {
+        commandList->SetPipelineState(pipelineState);
+        this->pipelineState = pipelineState;
+    }
+}
+
+void FilteredCommandList::SetGraphicsRootSignature(Rhi::RootSignature* rootSignature)
+{
+    if (Submit(Call::RootSignature, rootSignature == this->rootSignature))
+    {
+        commandList->SetGraphicsRootSignature(rootSignature);
+        this->rootSignature = rootSignature;
+        UnbindRootArguments();
+    }
+}
+
+void FilteredCommandList::SetGraphicsRootConstantBufferView(std::uint32_t rootParameterIndex, Rhi::GpuAddress bufferLocation)
+{
+    const RootArgument& bound = rootArguments[rootParameterIndex];
+    if (Submit(Call::RootConstantBufferView, bound.kind == Call::RootConstantBufferView && bound.value == bufferLocation))
+    {
+        commandList->SetGraphicsRootConstantBufferView(rootParameterIndex, bufferLocation);
+        SetRootArgument(Call::RootConstantBufferView, rootParameterIndex, bufferLocation);
+    }
+}
+
+void FilteredCommandList::SetGraphicsRootShaderResourceView(std::uint32_t rootParameterIndex, Rhi::GpuAddress bufferLocation)
+{
+    const RootArgument& bound = rootArguments[rootParameterIndex];
+    if (Submit(Call::RootShaderResourceView, bound.kind == Call::RootShaderResourceView && bound.value == bufferLocation))
+    {
+        commandList->SetGraphicsRootShaderResourceView(rootParameterIndex, bufferLocation);
+        SetRootArgument(Call::RootShaderResourceView, rootParameterIndex, bufferLocation);
+    }
+}
+
+void FilteredCommandList::SetGraphicsRootDescriptorTable(std::uint32_t rootParameterIndex, Rhi::DescriptorHandle baseDescriptor)
+{
+    const RootArgument& bound = rootArguments[rootParameterIndex];
+    if (Submit(Call::RootDescriptorTable, bound.kind == Call::RootDescriptorTable && bound.value == baseDescriptor.ptr))
+    {
+        commandList->SetGraphicsRootDescriptorTable(rootParameterIndex, baseDescriptor);
+        SetRootArgument(Call::RootDescriptorTable, rootParameterIndex, baseDescriptor.ptr);
+    }
+}
+
+void FilteredCommandList::SetDescriptorHeaps(std::uint32_t descriptorHeapCount, Rhi::DescriptorHeap* const* descriptorHeaps)
+{
+    commandList->SetDescriptorHeaps(descriptorHeapCount, descriptorHeaps);
+    for (RootArgument& rootArgument : rootArguments)
+        if (rootArgument.kind == Call::RootDescriptorTable)
+            rootArgument.kind = Call::Count;
+}
+
+void FilteredCommandList::IASetVertexBuffers(std::uint32_t startSlot, std::uint32_t viewCount, const Rhi::VertexBufferView* views)
+{
+    const bool redundant = startSlot + viewCount <= boundVertexBufferSlots
+        && std::memcmp(&vertexBufferViews[startSlot], views, viewCount * sizeof(Rhi::VertexBufferView)) == 0;
+    if (Submit(Call::VertexBuffers, redundant))
+    {
+        commandList->IASetVertexBuffers(startSlot, viewCount, views);
+        // Slots skipped over between those bound and startSlot stay unknown.
+        if (startSlot <= boundVertexBufferSlots)
+        {
+            std::copy_n(views, viewCount, &vertexBufferViews[startSlot]);
+            boundVertexBufferSlots = std::max(boundVertexBufferSlots, startSlot + viewCount);
+        }
+    }
+}
+
+void FilteredCommandList::IASetIndexBuffer(const Rhi::IndexBufferView* view)
+{
+    if (Submit(Call::IndexBuffer, indexBufferBound && std::memcmp(&indexBufferView, view, sizeof(Rhi::IndexBufferView)) == 0))
+    {
+        commandList->IASetIndexBuffer(view);
+        indexBufferView = *view;
+        indexBufferBound = true;
+    }
+}
+
+void FilteredCommandList::IASetPrimitiveTopology(Rhi::PrimitiveTopology primitiveTopology)
+{
+    if (Submit(Call::PrimitiveTopology, primitiveTopology == this->primitiveTopology))
+    {
+        commandList->IASetPrimitiveTopology(primitiveTopology);
+        this->primitiveTopology = primitiveTopology;
+    }
+}
+
+void FilteredCommandList::OMSetStencilRef(std::uint32_t stencilReference)
+{
+    if (Submit(Call::StencilReference, stencilReferenceBound && stencilReference == this->stencilReference))
+    {
+        commandList->OMSetStencilRef(stencilReference);
+        this->stencilReference = stencilReference;
+        stencilReferenceBound = true;
+    }
+}
+
+void FilteredCommandList::DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+    std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation)
+{
+    commandList->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+}
+
+FilteredCommandList::CallCounts FilteredCommandList::TotalCounts() const
+{
+    CallCounts total{};
+    for (const CallCounts& counts : callCounts)
+    {
+        total.submitted += counts.submitted;
+        total.filtered += counts.filtered;
+    }
+    return total;
+}
+
+void FilteredCommandList::ResetCounts()
+{
+    callCounts = {};
+}
+
+const wchar_t* FilteredCommandList::CallName(Call call)
+{
+    constexpr std::array<const wchar_t*, static_cast<std::size_t>(Call::Count)> names
+    {
+        L"SetPipelineState", L"SetGraphicsRootSignature", L"SetGraphicsRootConstantBufferView",
+        L"SetGraphicsRootShaderResourceView", L"SetGraphicsRootDescriptorTable", L"IASetVertexBuffers",
+        L"IASetIndexBuffer", L"IASetPrimitiveTopology", L"OMSetStencilRef"
+    };
+    return names[static_cast<std::size_t>(call)];
+}
+
+bool FilteredCommandList::Submit(Call call, bool redundant)
+{
+    CallCounts& counts = callCounts[static_cast<std::size_t>(call)];
+    ++(redundant ? counts.filtered : counts.submitted);
+    return !redundant;
+}
+
+void FilteredCommandList::SetRootArgument(Call kind, std::uint32_t rootParameterIndex, std::uint64_t value)
+{
+    rootArguments[rootParameterIndex] = { kind, value };
+}
+
+void FilteredCommandList::UnbindRootArguments()
+{
+    // Call::Count marks root arguments that are not bound.
+    rootArguments.fill({ Call::Count, 0 });
+}
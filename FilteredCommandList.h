@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "Rhi.h"
+
+// Records into another command list, dropping the calls that would bind the state already bound:
+// pipeline state, graphics root signature and root arguments, vertex and index buffers, primitive
+// topology and stencil reference. State bound on the other command list directly is not seen, so
+// calls made that way must not change any of it.
+class FilteredCommandList final : public Rhi::CommandList
+{
+public:
+    enum class Call
+    {
+        PipelineState, RootSignature, RootConstantBufferView, RootShaderResourceView, RootDescriptorTable,
+        VertexBuffers, IndexBuffer, PrimitiveTopology, StencilReference, Count
+    };
+
+    struct CallCounts
+    {
+        std::uint64_t submitted;
+        std::uint64_t filtered;
+    };
+
+    FilteredCommandList();
+
+    // Starts filtering the calls recorded into commandList, just reset with initialState, nothing else
+    // being bound yet. The call counts carry on.
+    void Begin(Rhi::CommandList& commandList, Rhi::PipelineState* initialState);
+
+    void SetPipelineState(Rhi::PipelineState* pipelineState) override;
+    // Unbinds every root argument when the root signature changes.
+    void SetGraphicsRootSignature(Rhi::RootSignature* rootSignature) override;
+    void SetGraphicsRootConstantBufferView(std::uint32_t rootParameterIndex, Rhi::GpuAddress bufferLocation) override;
+    void SetGraphicsRootShaderResourceView(std::uint32_t rootParameterIndex, Rhi::GpuAddress bufferLocation) override;
+    void SetGraphicsRootDescriptorTable(std::uint32_t rootParameterIndex, Rhi::DescriptorHandle baseDescriptor) override;
+    // Never filtered, unbinding every descriptor table.
+    void SetDescriptorHeaps(std::uint32_t descriptorHeapCount, Rhi::DescriptorHeap* const* descriptorHeaps) override;
+    void IASetVertexBuffers(std::uint32_t startSlot, std::uint32_t viewCount, const Rhi::VertexBufferView* views) override;
+    void IASetIndexBuffer(const Rhi::IndexBufferView* view) override;
+    void IASetPrimitiveTopology(Rhi::PrimitiveTopology primitiveTopology) override;
+    void OMSetStencilRef(std::uint32_t stencilReference) override;
+    // Never filtered.
+    void DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+        std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation) override;
+
+    const CallCounts& Counts(Call call) const { return callCounts[static_cast<std::size_t>(call)]; }
+    CallCounts TotalCounts() const;
+    void ResetCounts();
+    static const wchar_t* CallName(Call call);
+
+    // Vertex buffer slots of D3D12.
+    static constexpr std::uint32_t vertexBufferSlotCount = 32;
+
+private:
+    // Root arguments are known by their kind and value, the descriptor tables by their handle.
+    struct RootArgument
+    {
+        Call kind;
+        std::uint64_t value;
+    };
+
+    Rhi::CommandList* commandList;
+    std::array<CallCounts, static_cast<std::size_t>(Call::Count)> callCounts;
+    Rhi::PipelineState* pipelineState;
+    Rhi::RootSignature* rootSignature;
+    std::array<RootArgument, 64> rootArguments;
+    std::array<Rhi::VertexBufferView, vertexBufferSlotCount> vertexBufferViews;
+    // Vertex buffer slots from boundVertexBufferSlots on have not been bound.
+    std::uint32_t boundVertexBufferSlots;
+    Rhi::IndexBufferView indexBufferView;
+    bool indexBufferBound;
+    Rhi::PrimitiveTopology primitiveTopology;
+    std::uint32_t stencilReference;
+    bool stencilReferenceBound;
+
+    // Counts the call, returning whether it is to be submitted.
+    bool Submit(Call call, bool redundant);
+    void SetRootArgument(Call kind, std::uint32_t rootParameterIndex, std::uint64_t value);
+    void UnbindRootArguments();
+};
@@ -31,15 +31,22 @@ cbuffer PerScene : register(b0)
 };
 #endif
 
-cbuffer PerModel : register(b1)
+struct PerInstance
 {
     matrix model;
     matrix textureTransform;
     float4 diffuseColour;
     float specularExponent;
     float specularIntensity;
+    float2 padding;
+    // Dequantisation of packed vertex positions, position = positionOffset + positionScale * packed.
+    float4 positionScale;
+    float4 positionOffset;
 };
 
+// Instances of the current draw, indexed by SV_InstanceID.
+StructuredBuffer<PerInstance> instances : register(t4);
+
 Texture2D<uint2> channelStencil : register(t0);
 SamplerState pointWrap : register(s0);
 Texture2D textures[3] : register(t1);
@@ -0,0 +1,143 @@
+#include "HierarchicalDepth.h"
+#include <algorithm>
+#include <cmath>
+
+namespace HierarchicalDepth
+{
+    std::vector<Level> MakeLevels(std::uint32_t width, std::uint32_t height)
+    {
+        std::vector<Level> levels{ { width, height, 0 } };
+        while (width > 1 || height > 1)
+        {
+            const std::uint32_t offset = levels.back().offset + width * height;
+            width = std::max(1u, width / 2);
+            height = std::max(1u, height / 2);
+            levels.push_back({ width, height, offset });
+        }
+        return levels;
+    }
+
+    std::size_t TexelCount(std::span<const Level> levels)
+    {
+        return levels.back().offset + static_cast<std::size_t>(levels.back().width) * levels.back().height;
+    }
+
+    std::uint32_t QuantiseDepth(float depth)
+    {
+        return static_cast<std::uint32_t>(std::nearbyint(depth * static_cast<float>(farDepth)));
+    }
+
+    void BuildPyramid(std::span<const Level> levels, std::span<DepthRange> texels)
+    {
+        for (std::size_t levelIndex = 1; levelIndex < levels.size(); ++levelIndex)
+        {
+            const Level& source = levels[levelIndex - 1];
+            const Level& destination = levels[levelIndex];
+            for (std::uint32_t y = 0; y < destination.height; ++y)
+            {
+                const std::uint32_t sourceBottom = y + 1 == destination.height ? source.height : 2 * y + 2;
+                for (std::uint32_t x = 0; x < destination.width; ++x)
+                {
+                    const std::uint32_t sourceRight = x + 1 == destination.width ? source.width : 2 * x + 2;
+                    DepthRange range{ farDepth, 0 };
+                    for (std::uint32_t sourceY = 2 * y; sourceY < sourceBottom; ++sourceY)
+                        for (std::uint32_t sourceX = 2 * x; sourceX < sourceRight; ++sourceX)
+                        {
+                            const DepthRange& sourceRange = texels[source.offset + sourceY * source.width + sourceX];
+                            range.nearest = std::min(range.nearest, sourceRange.nearest);
+                            range.farthest = std::max(range.farthest, sourceRange.farthest);
+                        }
+                    texels[destination.offset + y * destination.width + x] = range;
+                }
+            }
+        }
+    }
+
+    bool ProjectBox(const Box& box, const XMFLOAT4X4& viewProjection, std::uint32_t width, std::uint32_t height,
+        ScreenRectangle& rectangle)
+    {
+        float minX = static_cast<float>(width), minY = static_cast<float>(height), maxX = 0, maxY = 0, minZ = 1, maxZ = 0;
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            const float position[3]
+            {
+                box.centre.x + (corner & 1 ? box.extents.x : -box.extents.x),
+                box.centre.y + (corner & 2 ? box.extents.y : -box.extents.y),
+                box.centre.z + (corner & 4 ? box.extents.z : -box.extents.z)
+            };
+            float clip[4];
+            for (int column = 0; column < 4; ++column)
+                clip[column] = position[0] * viewProjection.m[0][column] + position[1] * viewProjection.m[1][column]
+                    + position[2] * viewProjection.m[2][column] + viewProjection.m[3][column];
+            if (clip[2] < 0 || clip[3] <= 0)
+                return false;
+            const float x = (0.5f + 0.5f * clip[0] / clip[3]) * width, y = (0.5f - 0.5f * clip[1] / clip[3]) * height, z = clip[2] / clip[3];
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            minZ = std::min(minZ, z);
+            maxZ = std::max(maxZ, z);
+        }
+        const std::uint32_t left = static_cast<std::uint32_t>(std::clamp(std::floor(minX), 0.0f, static_cast<float>(width)));
+        const std::uint32_t right = static_cast<std::uint32_t>(std::clamp(std::ceil(maxX), 0.0f, static_cast<float>(width)));
+        const std::uint32_t top = static_cast<std::uint32_t>(std::clamp(std::floor(minY), 0.0f, static_cast<float>(height)));
+        const std::uint32_t bottom = static_cast<std::uint32_t>(std::clamp(std::ceil(maxY), 0.0f, static_cast<float>(height)));
+        if (left >= right || top >= bottom)
+            return false;
+        rectangle.left = left;
+        rectangle.top = top;
+        rectangle.right = right;
+        rectangle.bottom = bottom;
+        rectangle.depth.nearest = static_cast<std::uint32_t>(std::floor(static_cast<double>(minZ) * farDepth));
+        rectangle.depth.farthest = static_cast<std::uint32_t>(std::min<double>(farDepth, std::ceil(static_cast<double>(maxZ) * farDepth)));
+        return true;
+    }
+
+    Visibility Test(std::span<const Level> levels, std::span<const DepthRange> texels, const ScreenRectangle& rectangle)
+    {
+        // The texel of a level covering a pixel is the pixel shifted by the level, the last texel of a row
+        // or column covering the rest of it.
+        std::size_t levelIndex = 0;
+        std::uint32_t left, top, right, bottom;
+        for (;; ++levelIndex)
+        {
+            const Level& level = levels[levelIndex];
+            const std::uint32_t shift = static_cast<std::uint32_t>(levelIndex);
+            left = std::min(rectangle.left >> shift, level.width - 1);
+            right = std::min((rectangle.right - 1) >> shift, level.width - 1);
+            top = std::min(rectangle.top >> shift, level.height - 1);
+            bottom = std::min((rectangle.bottom - 1) >> shift, level.height - 1);
+            if ((right - left <= 1 && bottom - top <= 1) || levelIndex + 1 == levels.size())
+                break;
+        }
+        const Level& level = levels[levelIndex];
+        DepthRange covered{ farDepth, 0 };
+        for (std::uint32_t y = top; y <= bottom; ++y)
+            for (std::uint32_t x = left; x <= right; ++x)
+            {
+                const DepthRange& range = texels[level.offset + y * level.width + x];
+                covered.nearest = std::min(covered.nearest, range.nearest);
+                covered.farthest = std::max(covered.farthest, range.farthest);
+            }
+        if (rectangle.depth.nearest > covered.farthest)
+            return Visibility::Occluded;
+        if (rectangle.depth.farthest < covered.nearest)
+            return Visibility::InFront;
+        return Visibility::Visible;
+    }
+
+    std::size_t CullBoxes(std::span<const Level> levels, std::span<const DepthRange> texels, const XMFLOAT4X4& viewProjection,
+        std::span<const Box> boxes, std::span<std::uint32_t> visible)
+    {
+        std::size_t visibleCount = 0;
+        for (std::uint32_t boxIndex : visible)
+        {
+            ScreenRectangle rectangle;
+            if (!ProjectBox(boxes[boxIndex], viewProjection, levels[0].width, levels[0].height, rectangle)
+                || Test(levels, texels, rectangle) != Visibility::Occluded)
+                visible[visibleCount++] = boxIndex;
+        }
+        return visibleCount;
+    }
+}
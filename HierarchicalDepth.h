@@ -0,0 +1,73 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include "MeshData.h"
+
+// Hierarchical depth (Hi-Z) occlusion: a pyramid of the nearest and farthest depth of ever larger
+// regions of a rendered depth buffer, against which the bounding boxes of models are tested the next
+// frame, reprojected through the view projection the depth was rendered with. This is the CPU
+// reference of HierarchicalDepth.hlsl: both only compare 24 bit integer depths once the depth buffer
+// and the boxes are quantised, so that the pyramids and test results they produce are bit exact.
+namespace HierarchicalDepth
+{
+    // Depth of the far plane, the largest value of a 24 bit unorm depth buffer.
+    constexpr std::uint32_t farDepth = 0xFFFFFF;
+
+    struct DepthRange
+    {
+        std::uint32_t nearest;
+        std::uint32_t farthest;
+    };
+
+    // Texels of one level of the pyramid, stored from offset on in the texels of the whole pyramid.
+    struct Level
+    {
+        std::uint32_t width;
+        std::uint32_t height;
+        std::uint32_t offset;
+    };
+
+    // Levels of the pyramid of a width x height depth buffer: the depth buffer itself, then levels of
+    // half the size of the previous one, rounded down, down to 1 x 1. The last texel of a row or column
+    // also covers the texel left over by an odd sized previous level.
+    std::vector<Level> MakeLevels(std::uint32_t width, std::uint32_t height);
+    std::size_t TexelCount(std::span<const Level> levels);
+    // Depth buffer value, in [0, 1], as an integer depth, rounded to nearest even as the GPU does.
+    std::uint32_t QuantiseDepth(float depth);
+    // Fills every level after the first from the one before it, the first level holding the depth buffer.
+    void BuildPyramid(std::span<const Level> levels, std::span<DepthRange> texels);
+
+    // Pixels of the depth buffer, [left, right) x [top, bottom), a box covers and the range of its depths,
+    // rounded outwards.
+    struct ScreenRectangle
+    {
+        std::uint32_t left;
+        std::uint32_t top;
+        std::uint32_t right;
+        std::uint32_t bottom;
+        DepthRange depth;
+    };
+
+    // Projects the world space box through viewProjection onto a width x height depth buffer. Returns false,
+    // leaving rectangle untouched, when the box crosses the near plane or covers no pixel, when it cannot be tested.
+    bool ProjectBox(const Box& box, const XMFLOAT4X4& viewProjection, std::uint32_t width, std::uint32_t height,
+        ScreenRectangle& rectangle);
+
+    enum class Visibility : std::uint32_t
+    {
+        // Some of the box may be in front of what the depth buffer holds.
+        Visible,
+        // The box is entirely behind what the depth buffer holds.
+        Occluded,
+        // The box is entirely in front of what the depth buffer holds.
+        InFront
+    };
+
+    // Tests the rectangle against the coarsest level at which it covers at most 2 x 2 texels.
+    Visibility Test(std::span<const Level> levels, std::span<const DepthRange> texels, const ScreenRectangle& rectangle);
+    // Removes the indices of the boxes that are occluded in the pyramid built from a depth buffer rendered
+    // through viewProjection from visible, keeping the order of the others, and returns how many are left.
+    std::size_t CullBoxes(std::span<const Level> levels, std::span<const DepthRange> texels, const XMFLOAT4X4& viewProjection,
+        std::span<const Box> boxes, std::span<std::uint32_t> visible);
+}
@@ -0,0 +1,101 @@
+// GPU side of HierarchicalDepth.h, whose CPU reference every function mirrors operation for operation.
+
+static const uint farDepth = 0xFFFFFF;
+
+struct Level
+{
+    uint width;
+    uint height;
+    uint offset;
+};
+
+struct ScreenRectangle
+{
+    uint left;
+    uint top;
+    uint right;
+    uint bottom;
+    // Nearest and farthest depth.
+    uint2 depth;
+};
+
+static const uint visible = 0;
+static const uint occluded = 1;
+static const uint inFront = 2;
+
+cbuffer Dispatch : register(b0)
+{
+    uint levelIndex;
+    uint levelCount;
+    uint rectangleCount;
+};
+
+Texture2D<float> depthBuffer : register(t0);
+StructuredBuffer<Level> levels : register(t1);
+StructuredBuffer<ScreenRectangle> rectangles : register(t2);
+// Nearest and farthest depth of every texel of every level.
+RWStructuredBuffer<uint2> texels : register(u0);
+RWStructuredBuffer<uint> visibilities : register(u1);
+
+[numthreads(8, 8, 1)]
+void BuildFirstLevel(uint3 texel : SV_DispatchThreadID)
+{
+    const Level level = levels[0];
+    if (texel.x >= level.width || texel.y >= level.height)
+        return;
+    const uint depth = (uint) round(depthBuffer.Load(int3(texel.xy, 0)) * 16777215.0f);
+    texels[texel.y * level.width + texel.x] = uint2(depth, depth);
+}
+
+[numthreads(8, 8, 1)]
+void BuildLevel(uint3 texel : SV_DispatchThreadID)
+{
+    const Level source = levels[levelIndex - 1];
+    const Level destination = levels[levelIndex];
+    if (texel.x >= destination.width || texel.y >= destination.height)
+        return;
+    const uint sourceRight = texel.x + 1 == destination.width ? source.width : 2 * texel.x + 2;
+    const uint sourceBottom = texel.y + 1 == destination.height ? source.height : 2 * texel.y + 2;
+    uint2 range = uint2(farDepth, 0);
+    for (uint sourceY = 2 * texel.y; sourceY < sourceBottom; ++sourceY)
+        for (uint sourceX = 2 * texel.x; sourceX < sourceRight; ++sourceX)
+        {
+            const uint2 sourceRange = texels[source.offset + sourceY * source.width + sourceX];
+            range = uint2(min(range.x, sourceRange.x), max(range.y, sourceRange.y));
+        }
+    texels[destination.offset + texel.y * destination.width + texel.x] = range;
+}
+
+[numthreads(64, 1, 1)]
+void TestRectangles(uint3 thread : SV_DispatchThreadID)
+{
+    if (thread.x >= rectangleCount)
+        return;
+    const ScreenRectangle rectangle = rectangles[thread.x];
+    uint testedLevel = 0;
+    uint left, top, right, bottom;
+    for (;; ++testedLevel)
+    {
+        const Level level = levels[testedLevel];
+        left = min(rectangle.left >> testedLevel, level.width - 1);
+        right = min((rectangle.right - 1) >> testedLevel, level.width - 1);
+        top = min(rectangle.top >> testedLevel, level.height - 1);
+        bottom = min((rectangle.bottom - 1) >> testedLevel, level.height - 1);
+        if ((right - left <= 1 && bottom - top <= 1) || testedLevel + 1 == levelCount)
+            break;
+    }
+    const Level level = levels[testedLevel];
+    uint2 covered = uint2(farDepth, 0);
+    for (uint y = top; y <= bottom; ++y)
+        for (uint x = left; x <= right; ++x)
+        {
+            const uint2 range = texels[level.offset + y * level.width + x];
+            covered = uint2(min(covered.x, range.x), max(covered.y, range.y));
+        }
+    uint visibility = visible;
+    if (rectangle.depth.x > covered.y)
+        visibility = occluded;
+    else if (rectangle.depth.y < covered.x)
+        visibility = inFront;
+    visibilities[thread.x] = visibility;
+}
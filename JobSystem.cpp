@@ -0,0 +1,312 @@
+#include "JobSystem.h"
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+
+namespace Jobs
+{
+    namespace
+    {
+        struct WorkerIdentity
+        {
+            const JobSystem* system;
+            unsigned index;
+        };
+
+        thread_local WorkerIdentity currentWorker{ nullptr, 0 };
+    }
+
+    void Job::Precede(Job& dependent)
+    {
+        if (dependentCount == maximumDependentCount)
+            throw std::runtime_error("Too many dependents of a job");
+        dependents[dependentCount++] = &dependent;
+        dependent.unfinishedDependencyCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Follows Le, Pop, Cohen and Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models".
+    bool WorkStealingDeque::Push(Job* job)
+    {
+        const std::int64_t bottomIndex = bottom.load(std::memory_order_relaxed);
+        const std::int64_t topIndex = top.load(std::memory_order_acquire);
+        if (bottomIndex - topIndex >= static_cast<std::int64_t>(capacity))
+            return false;
+        jobs[bottomIndex & (capacity - 1)].store(job, std::memory_order_relaxed);
+        bottom.store(bottomIndex + 1, std::memory_order_release);
+        return true;
+    }
+
+    Job* WorkStealingDeque::Pop()
+    {
+        const std::int64_t bottomIndex = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(bottomIndex, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t topIndex = top.load(std::memory_order_relaxed);
+        if (topIndex > bottomIndex)
+        {
+            bottom.store(bottomIndex + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        Job* job = jobs[bottomIndex & (capacity - 1)].load(std::memory_order_relaxed);
+        if (topIndex == bottomIndex)
+        {
+            // The last job, which thieves race for.
+            if (!top.compare_exchange_strong(topIndex, topIndex + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                job = nullptr;
+            bottom.store(bottomIndex + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job* WorkStealingDeque::Steal()
+    {
+        // Losing the race for a job means another thread took it, so trying again until the deque is empty
+        // still makes progress.
+        while (true)
+        {
+            std::int64_t topIndex = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const std::int64_t bottomIndex = bottom.load(std::memory_order_acquire);
+            if (topIndex >= bottomIndex)
+                return nullptr;
+            Job* job = jobs[topIndex & (capacity - 1)].load(std::memory_order_relaxed);
+            if (top.compare_exchange_strong(topIndex, topIndex + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return job;
+        }
+    }
+
+    JobSystem::JobSystem(unsigned threadCount) :
+        threadCount(std::max(1u, threadCount)),
+        ownerThread(std::this_thread::get_id()),
+        deques(std::make_unique<WorkStealingDeque[]>(this->threadCount)),
+        injectedJobCount(0),
+        workSignal(0),
+        sleepingWorkerCount(0),
+        stopping(false)
+    {
+        workers.reserve(this->threadCount - 1);
+        for (unsigned workerIndex = 1; workerIndex < this->threadCount; ++workerIndex)
+            workers.emplace_back([this, workerIndex]() { Work(workerIndex); });
+    }
+
+    JobSystem::~JobSystem()
+    {
+        stopping = true;
+        workSignal.fetch_add(1);
+        workSignal.notify_all();
+        workers.clear();
+    }
+
+    void JobSystem::Submit(Job& job, Counter& counter)
+    {
+        job.counter = &counter;
+        counter.pending.fetch_add(1, std::memory_order_relaxed);
+        if (job.unfinishedDependencyCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            Schedule(job);
+    }
+
+    void JobSystem::Wait(Counter& counter)
+    {
+        const unsigned workerIndex = WorkerIndex();
+        while (!counter.Done())
+        {
+            if (Job* job = FindJob(workerIndex))
+                Execute(*job);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    JobSystem& JobSystem::Shared()
+    {
+        static JobSystem shared;
+        return shared;
+    }
+
+    unsigned JobSystem::WorkerIndex() const
+    {
+        if (currentWorker.system == this)
+            return currentWorker.index;
+        return std::this_thread::get_id() == ownerThread ? 0 : threadCount;
+    }
+
+    void JobSystem::Schedule(Job& job)
+    {
+        const unsigned workerIndex = WorkerIndex();
+        if (workerIndex < threadCount)
+        {
+            // A full deque means there is plenty of work queued already, so the job is as well run right away.
+            if (!deques[workerIndex].Push(&job))
+            {
+                Execute(job);
+                return;
+            }
+        }
+        else
+        {
+            std::scoped_lock lock(injectedJobsMutex);
+            injectedJobs.push_back(&job);
+            ++injectedJobCount;
+        }
+        // Ordered against sleepingWorkerCount, so that a worker going to sleep either sees the job or is woken.
+        workSignal.fetch_add(1);
+        if (sleepingWorkerCount.load() > 0)
+            workSignal.notify_one();
+    }
+
+    Job* JobSystem::FindJob(unsigned workerIndex)
+    {
+        if (workerIndex < threadCount)
+            if (Job* job = deques[workerIndex].Pop())
+                return job;
+        if (injectedJobCount.load(std::memory_order_relaxed) > 0)
+        {
+            std::scoped_lock lock(injectedJobsMutex);
+            if (!injectedJobs.empty())
+            {
+                Job* job = injectedJobs.front();
+                injectedJobs.pop_front();
+                --injectedJobCount;
+                return job;
+            }
+        }
+        for (unsigned offset = 1; offset <= threadCount; ++offset)
+        {
+            const unsigned victimIndex = (workerIndex + offset) % threadCount;
+            if (victimIndex != workerIndex)
+                if (Job* job = deques[victimIndex].Steal())
+                    return job;
+        }
+        return nullptr;
+    }
+
+    void JobSystem::Execute(Job& job)
+    {
+        job.function(job.data, job.index);
+        for (std::uint32_t dependentIndex = 0; dependentIndex < job.dependentCount; ++dependentIndex)
+        {
+            Job& dependent = *job.dependents[dependentIndex];
+            if (dependent.unfinishedDependencyCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                Schedule(dependent);
+        }
+        // The job can be freed or submitted again as soon as its counter is done, so it is reset first.
+        Counter& counter = *job.counter;
+        job.dependentCount = 0;
+        job.unfinishedDependencyCount.store(1, std::memory_order_relaxed);
+        counter.pending.fetch_sub(1, std::memory_order_release);
+    }
+
+    void JobSystem::Work(unsigned workerIndex)
+    {
+        currentWorker = { this, workerIndex };
+        constexpr unsigned spinCount = 64;
+        unsigned idleCount = 0;
+        while (!stopping.load(std::memory_order_acquire))
+        {
+            if (Job* job = FindJob(workerIndex))
+            {
+                Execute(*job);
+                idleCount = 0;
+                continue;
+            }
+            if (++idleCount < spinCount)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            // Announced before the last look for a job, so that a job scheduled after it wakes the worker.
+            ++sleepingWorkerCount;
+            const std::uint32_t observedSignal = workSignal.load();
+            if (Job* job = FindJob(workerIndex))
+            {
+                --sleepingWorkerCount;
+                Execute(*job);
+                idleCount = 0;
+                continue;
+            }
+            if (!stopping.load())
+                workSignal.wait(observedSignal);
+            --sleepingWorkerCount;
+            idleCount = 0;
+        }
+    }
+
+    namespace
+    {
+        // A few hundred nanoseconds of arithmetic the compiler cannot fold away.
+        std::uint64_t Churn(std::uint64_t seed, unsigned rounds)
+        {
+            std::uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+            for (unsigned round = 0; round < rounds; ++round)
+            {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+            }
+            return state;
+        }
+    }
+
+    ScalingBenchmarkResult Benchmark(unsigned threadCount, unsigned iterations)
+    {
+        using Clock = std::chrono::steady_clock;
+        auto milliseconds = [](Clock::time_point start) { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); };
+        JobSystem jobSystem(threadCount);
+        ScalingBenchmarkResult result{ jobSystem.ThreadCount(), std::numeric_limits<double>::max(),
+            std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+
+        constexpr std::size_t taskCount = 1'000'000;
+        std::vector<std::uint64_t> outputs(taskCount);
+        for (unsigned iteration = 0; iteration < iterations; ++iteration)
+        {
+            const Clock::time_point start = Clock::now();
+            jobSystem.ParallelFor(taskCount, [&](std::size_t task) { outputs[task] = Churn(task, 200); });
+            result.parallelForMilliseconds = std::min(result.parallelForMilliseconds, milliseconds(start));
+        }
+
+        // Breadth first, so that the children of job n are 8n + 1 to 8n + 8.
+        constexpr std::size_t treeDepth = 5, treeJobCount = (1 << (3 * treeDepth)) / 7;
+        std::vector<std::uint64_t> treeOutputs(treeJobCount + 1);
+        auto treeTask = [&](std::size_t job) { treeOutputs[job] = Churn(job, 2000); };
+        const std::unique_ptr<Job[]> treeJobs = std::make_unique<Job[]>(treeJobCount + 1);
+        for (unsigned iteration = 0; iteration < iterations; ++iteration)
+        {
+            const Clock::time_point start = Clock::now();
+            for (std::size_t job = 0; job <= treeJobCount; ++job)
+                treeJobs[job].Bind(treeTask, job);
+            for (std::size_t job = 0; job < treeJobCount; ++job)
+            {
+                const std::size_t firstChild = 8 * job + 1;
+                if (firstChild < treeJobCount)
+                    for (std::size_t child = firstChild; child < firstChild + 8; ++child)
+                        treeJobs[job].Precede(treeJobs[child]);
+                else
+                    treeJobs[job].Precede(treeJobs[treeJobCount]);
+            }
+            Counter counter;
+            for (std::size_t job = 0; job <= treeJobCount; ++job)
+                jobSystem.Submit(treeJobs[job], counter);
+            jobSystem.Wait(counter);
+            result.dependencyGraphMilliseconds = std::min(result.dependencyGraphMilliseconds, milliseconds(start));
+        }
+
+        constexpr std::size_t emptyJobCount = 100'000, batchSize = 1000;
+        auto emptyTask = [](std::size_t) {};
+        const std::unique_ptr<Job[]> emptyJobs = std::make_unique<Job[]>(batchSize);
+        for (std::size_t job = 0; job < batchSize; ++job)
+            emptyJobs[job].Bind(emptyTask, job);
+        for (unsigned iteration = 0; iteration < iterations; ++iteration)
+        {
+            const Clock::time_point start = Clock::now();
+            for (std::size_t batch = 0; batch < emptyJobCount / batchSize; ++batch)
+            {
+                Counter counter;
+                for (std::size_t job = 0; job < batchSize; ++job)
+                    jobSystem.Submit(emptyJobs[job], counter);
+                jobSystem.Wait(counter);
+            }
+            result.nanosecondsPerEmptyJob = std::min(result.nanosecondsPerEmptyJob, 1e6 * milliseconds(start) / emptyJobCount);
+        }
+        return result;
+    }
+}
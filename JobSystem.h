@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+inline unsigned HardwareThreadCount()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Work stealing job system: every thread pushes the jobs it submits onto a deque of its own and pops them
+// back last in first out, while idle threads steal the oldest jobs of the others.
+namespace Jobs
+{
+    class JobSystem;
+
+    // Number of the jobs submitted against it not done yet. Once waited on, it can count the next jobs.
+    class Counter
+    {
+    public:
+        Counter() = default;
+        Counter(const Counter&) = delete;
+        Counter& operator=(const Counter&) = delete;
+
+        bool Done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class JobSystem;
+        std::atomic<std::size_t> pending = 0;
+    };
+
+    // Calls a task with an index once submitted and once every job preceding it is done. The caller owns
+    // it and keeps it alive until the counter it was submitted against is waited on, after which it can
+    // be submitted again. Tasks must not throw, as no one would catch it.
+    class Job
+    {
+    public:
+        static constexpr std::size_t maximumDependentCount = 8;
+
+        Job() = default;
+        Job(const Job&) = delete;
+        Job& operator=(const Job&) = delete;
+
+        // Makes the job call task(taskIndex).
+        template<typename Task>
+        void Bind(Task& task, std::size_t taskIndex = 0)
+        {
+            function = [](void* data, std::size_t index) { (*static_cast<Task*>(data))(index); };
+            data = &task;
+            index = taskIndex;
+        }
+
+        // Holds dependent back until this job is done. Neither can have been submitted yet.
+        void Precede(Job& dependent);
+
+    private:
+        friend class JobSystem;
+        void (*function)(void* data, std::size_t index) = nullptr;
+        void* data = nullptr;
+        std::size_t index = 0;
+        Counter* counter = nullptr;
+        std::array<Job*, maximumDependentCount> dependents{};
+        std::uint32_t dependentCount = 0;
+        // Jobs preceding this one not done yet, plus one until it is submitted; whoever brings it to zero
+        // schedules it.
+        std::atomic<std::uint32_t> unfinishedDependencyCount = 1;
+    };
+
+    // Chase-Lev deque of a fixed capacity, which only its owner pushes onto and pops from the bottom of
+    // and every other thread steals from the top of.
+    class WorkStealingDeque
+    {
+    public:
+        static constexpr std::size_t capacity = 1 << 12;
+
+        // False when full.
+        bool Push(Job* job);
+        // Null when empty.
+        Job* Pop();
+        Job* Steal();
+
+    private:
+        alignas(64) std::atomic<std::int64_t> top = 0;
+        alignas(64) std::atomic<std::int64_t> bottom = 0;
+        std::array<std::atomic<Job*>, capacity> jobs{};
+    };
+
+    class JobSystem
+    {
+    public:
+        // Starts threadCount - 1 worker threads. The constructing thread is the remaining worker, running
+        // jobs whenever it waits; any other thread submits through a shared queue.
+        explicit JobSystem(unsigned threadCount = HardwareThreadCount());
+        ~JobSystem();
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+
+        unsigned ThreadCount() const { return threadCount; }
+
+        // Counts job against counter and runs it on any thread once the jobs preceding it are done.
+        void Submit(Job& job, Counter& counter);
+        // Runs jobs until the ones counted by counter are done.
+        void Wait(Counter& counter);
+
+        // Calls task(index) for every index in [0, count) from up to maximumJobCount jobs, the calling thread
+        // running one of them, and returns once all of them are done. The first exception thrown by a task is
+        // rethrown on the calling thread.
+        template<typename Task>
+        void ParallelFor(std::size_t count, Task&& task, unsigned maximumJobCount = UINT_MAX);
+
+        // The system of the whole program, running on every hardware thread, its constructing thread being
+        // the first to use it.
+        static JobSystem& Shared();
+
+    private:
+        unsigned threadCount;
+        std::thread::id ownerThread;
+        std::unique_ptr<WorkStealingDeque[]> deques;
+        // Jobs submitted by threads that are not workers.
+        std::mutex injectedJobsMutex;
+        std::deque<Job*> injectedJobs;
+        std::atomic<std::size_t> injectedJobCount;
+        // Bumped whenever a job is scheduled, which sleeping workers wait on.
+        std::atomic<std::uint32_t> workSignal;
+        std::atomic<unsigned> sleepingWorkerCount;
+        std::atomic<bool> stopping;
+        std::vector<std::jthread> workers;
+
+        // Index of the calling thread among the workers, threadCount when it is none of them.
+        unsigned WorkerIndex() const;
+        void Schedule(Job& job);
+        Job* FindJob(unsigned workerIndex);
+        void Execute(Job& job);
+        void Work(unsigned workerIndex);
+    };
+
+    template<typename Task>
+    void JobSystem::ParallelFor(std::size_t count, Task&& task, unsigned maximumJobCount)
+    {
+        const std::size_t jobCount = std::min<std::size_t>({ count, threadCount, std::max(1u, maximumJobCount) });
+        if (jobCount <= 1)
+        {
+            for (std::size_t index = 0; index < count; ++index)
+                task(index);
+            return;
+        }
+        // Every job claims the next batch of indices until there are none left, balancing tasks of uneven
+        // cost. A batch is a sixteenth of the even share of a job, so that many small tasks claim rarely.
+        const std::size_t batchSize = std::max<std::size_t>(1, count / (jobCount * 16));
+        std::atomic<std::size_t> nextIndex = 0;
+        std::exception_ptr firstException;
+        std::mutex exceptionMutex;
+        auto claimIndices = [&](std::size_t)
+        {
+            for (std::size_t begin = nextIndex.fetch_add(batchSize); begin < count; begin = nextIndex.fetch_add(batchSize))
+            {
+                try
+                {
+                    for (std::size_t index = begin, end = std::min(begin + batchSize, count); index < end; ++index)
+                        task(index);
+                }
+                catch (...)
+                {
+                    std::scoped_lock lock(exceptionMutex);
+                    if (!firstException)
+                        firstException = std::current_exception();
+                    nextIndex = count;
+                }
+            }
+        };
+        const std::unique_ptr<Job[]> jobs = std::make_unique<Job[]>(jobCount - 1);
+        Counter counter;
+        for (std::size_t job = 0; job < jobCount - 1; ++job)
+        {
+            jobs[job].Bind(claimIndices, job);
+            Submit(jobs[job], counter);
+        }
+        claimIndices(jobCount - 1);
+        Wait(counter);
+        if (firstException)
+            std::rethrow_exception(firstException);
+    }
+
+    struct ScalingBenchmarkResult
+    {
+        unsigned threadCount;
+        // ParallelFor over a million independent tasks of a few hundred nanoseconds each.
+        double parallelForMilliseconds;
+        // Tree of jobs of a few microseconds each, every job preceding eight more down to a depth of five,
+        // whose leaves all precede a last job.
+        double dependencyGraphMilliseconds;
+        // Submitting and running a hundred thousand empty jobs, the overhead of a job.
+        double nanosecondsPerEmptyJob;
+    };
+
+    // Times the workloads above on a JobSystem of threadCount threads, the best of iterations runs each.
+    ScalingBenchmarkResult Benchmark(unsigned threadCount, unsigned iterations);
+}
@@ -0,0 +1,164 @@
+#include "LevelOfDetailSelection.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <random>
+#include <vector>
+#include <emmintrin.h>
+
+namespace LevelOfDetailSelection
+{
+    float ProjectionScale(const XMFLOAT4X4& projection, float viewportHeight)
+    {
+        return 0.5f * viewportHeight * projection.m[1][1];
+    }
+
+    float ProjectRadius(const Sphere& sphere, const XMFLOAT3& cameraPosition, float projectionScale)
+    {
+        // The cone from the camera tangent to the sphere has tan(half angle) = radius / sqrt(distance^2 - radius^2).
+        const float x = sphere.centre.x - cameraPosition.x;
+        const float y = sphere.centre.y - cameraPosition.y;
+        const float z = sphere.centre.z - cameraPosition.z;
+        const float tangentSquared = x * x + y * y + z * z - sphere.radius * sphere.radius;
+        if (tangentSquared <= 0)
+            return std::numeric_limits<float>::infinity();
+        return projectionScale * sphere.radius / std::sqrt(tangentSquared);
+    }
+
+    void ProjectRadii(std::span<const Sphere> spheres, const XMFLOAT3& cameraPosition, float projectionScale,
+        std::span<float> projectedRadii)
+    {
+        const __m128 cameraX = _mm_set1_ps(cameraPosition.x);
+        const __m128 cameraY = _mm_set1_ps(cameraPosition.y);
+        const __m128 cameraZ = _mm_set1_ps(cameraPosition.z);
+        const __m128 scale = _mm_set1_ps(projectionScale);
+        const __m128 infinity = _mm_set1_ps(std::numeric_limits<float>::infinity());
+        std::size_t sphereIndex = 0;
+        for (; sphereIndex + 4 <= spheres.size(); sphereIndex += 4)
+        {
+            // Four spheres, one per row, transposed so that each register holds one component of all four.
+            __m128 x = _mm_loadu_ps(&spheres[sphereIndex].centre.x);
+            __m128 y = _mm_loadu_ps(&spheres[sphereIndex + 1].centre.x);
+            __m128 z = _mm_loadu_ps(&spheres[sphereIndex + 2].centre.x);
+            __m128 radius = _mm_loadu_ps(&spheres[sphereIndex + 3].centre.x);
+            _MM_TRANSPOSE4_PS(x, y, z, radius);
+            x = _mm_sub_ps(x, cameraX);
+            y = _mm_sub_ps(y, cameraY);
+            z = _mm_sub_ps(z, cameraZ);
+            const __m128 tangentSquared = _mm_sub_ps(
+                _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)), _mm_mul_ps(radius, radius));
+            const __m128 projected = _mm_div_ps(_mm_mul_ps(scale, radius), _mm_sqrt_ps(tangentSquared));
+            const __m128 inside = _mm_cmple_ps(tangentSquared, _mm_setzero_ps());
+            _mm_storeu_ps(&projectedRadii[sphereIndex], _mm_or_ps(_mm_and_ps(inside, infinity), _mm_andnot_ps(inside, projected)));
+        }
+        for (; sphereIndex < spheres.size(); ++sphereIndex)
+            projectedRadii[sphereIndex] = ProjectRadius(spheres[sphereIndex], cameraPosition, projectionScale);
+    }
+
+    std::size_t SelectLevel(std::span<const LevelOfDetail> levels, float meshRadius, float projectedRadius,
+        std::size_t current, float coarseningRatio)
+    {
+        // A level of error e, in mesh units, strays e / meshRadius * projectedRadius pixels on screen.
+        const float allowedError = pixelErrorThreshold * meshRadius / projectedRadius;
+        std::size_t coarsestAllowed = 0, coarsestPreferred = 0;
+        for (std::size_t level = 1; level < levels.size(); ++level)
+        {
+            if (levels[level].error <= allowedError)
+                coarsestAllowed = level;
+            if (levels[level].error <= coarseningRatio * allowedError)
+                coarsestPreferred = level;
+        }
+        return std::min(std::max(current, coarsestPreferred), coarsestAllowed);
+    }
+
+    void SelectLevels(std::span<const LevelOfDetail> levels, float meshRadius, std::span<const float> projectedRadii,
+        std::span<std::uint32_t> currentLevels, float coarseningRatio)
+    {
+        // With errors that do not decrease, the coarsest level under an error is the number of coarser
+        // levels under it, counted in float lanes.
+        const __m128 scaledRadius = _mm_set1_ps(pixelErrorThreshold * meshRadius);
+        const __m128 ratio = _mm_set1_ps(coarseningRatio);
+        const __m128 one = _mm_set1_ps(1);
+        std::size_t modelIndex = 0;
+        for (; modelIndex + 4 <= projectedRadii.size(); modelIndex += 4)
+        {
+            const __m128 allowedError = _mm_div_ps(scaledRadius, _mm_loadu_ps(&projectedRadii[modelIndex]));
+            const __m128 preferredError = _mm_mul_ps(ratio, allowedError);
+            __m128 coarsestAllowed = _mm_setzero_ps(), coarsestPreferred = _mm_setzero_ps();
+            for (std::size_t level = 1; level < levels.size(); ++level)
+            {
+                const __m128 error = _mm_set1_ps(levels[level].error);
+                coarsestAllowed = _mm_add_ps(coarsestAllowed, _mm_and_ps(_mm_cmple_ps(error, allowedError), one));
+                coarsestPreferred = _mm_add_ps(coarsestPreferred, _mm_and_ps(_mm_cmple_ps(error, preferredError), one));
+            }
+            __m128i* current = reinterpret_cast<__m128i*>(&currentLevels[modelIndex]);
+            const __m128 selected = _mm_min_ps(_mm_max_ps(_mm_cvtepi32_ps(_mm_loadu_si128(current)), coarsestPreferred), coarsestAllowed);
+            _mm_storeu_si128(current, _mm_cvttps_epi32(selected));
+        }
+        for (; modelIndex < projectedRadii.size(); ++modelIndex)
+            currentLevels[modelIndex] = static_cast<std::uint32_t>(
+                SelectLevel(levels, meshRadius, projectedRadii[modelIndex], currentLevels[modelIndex], coarseningRatio));
+    }
+
+    BenchmarkResult Benchmark(std::size_t modelCount, unsigned frameCount)
+    {
+        using Clock = std::chrono::steady_clock;
+        // A handful of meshes of unit radius, scaled to the radius of each model, whose levels halve their
+        // triangles, and roughly double their error, from one to the next. Models are grouped by mesh.
+        const std::vector<LevelOfDetail> meshLevels[] =
+        {
+            { { 0, 0, 0 }, { 0, 0, 0.0005f }, { 0, 0, 0.0012f }, { 0, 0, 0.0026f }, { 0, 0, 0.0055f } },
+            { { 0, 0, 0 }, { 0, 0, 0.001f }, { 0, 0, 0.0022f }, { 0, 0, 0.005f } },
+            { { 0, 0, 0 }, { 0, 0, 0.0003f }, { 0, 0, 0.0008f } }
+        };
+        const std::size_t meshCount = std::size(meshLevels);
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> position(-200, 200);
+        std::uniform_real_distribution<float> radius(0.5f, 5);
+        std::vector<Sphere> spheres(modelCount);
+        for (Sphere& sphere : spheres)
+            sphere = { { position(random), position(random), position(random) }, radius(random) };
+        const float projectionScale = 0.5f * 1080 / std::tan(0.125f * std::numbers::pi_v<float>);
+        std::vector<float> projectedRadii(modelCount);
+        std::vector<std::uint32_t> levels(modelCount, 0), scalarLevels(modelCount, 0), levelsWithoutHysteresis(modelCount, 0);
+        BenchmarkResult result{};
+        std::size_t switchCount = 0, switchCountWithoutHysteresis = 0;
+        for (unsigned frame = 0; frame < frameCount; ++frame)
+        {
+            // Walking forwards a tenth of a unit a frame while shaking half a unit back and forth, as a hand held camera would.
+            const XMFLOAT3 cameraPosition{ 0, 0, 0.1f * frame + (frame % 2 == 0 ? 0.5f : -0.5f) };
+            const std::vector<std::uint32_t> previousLevels = levels;
+            const Clock::time_point scalarStart = Clock::now();
+            for (std::size_t model = 0; model < modelCount; ++model)
+                scalarLevels[model] = static_cast<std::uint32_t>(SelectLevel(meshLevels[model * meshCount / modelCount], 1,
+                    ProjectRadius(spheres[model], cameraPosition, projectionScale), scalarLevels[model]));
+            const Clock::time_point batchedStart = Clock::now();
+            ProjectRadii(spheres, cameraPosition, projectionScale, projectedRadii);
+            for (std::size_t mesh = 0; mesh < meshCount; ++mesh)
+            {
+                const std::size_t first = (mesh * modelCount + meshCount - 1) / meshCount;
+                const std::size_t end = ((mesh + 1) * modelCount + meshCount - 1) / meshCount;
+                SelectLevels(meshLevels[mesh], 1, std::span(projectedRadii).subspan(first, end - first), std::span(levels).subspan(first, end - first));
+            }
+            const Clock::time_point batchedEnd = Clock::now();
+            for (std::size_t model = 0; model < modelCount; ++model)
+            {
+                const std::uint32_t level = static_cast<std::uint32_t>(SelectLevel(meshLevels[model * meshCount / modelCount], 1,
+                    projectedRadii[model], levelsWithoutHysteresis[model], 1));
+                switchCount += frame > 0 && levels[model] != previousLevels[model];
+                switchCountWithoutHysteresis += frame > 0 && level != levelsWithoutHysteresis[model];
+                result.mismatchCount += levels[model] != scalarLevels[model];
+                levelsWithoutHysteresis[model] = level;
+            }
+            result.scalarMilliseconds += std::chrono::duration<double, std::milli>(batchedStart - scalarStart).count();
+            result.batchedMilliseconds += std::chrono::duration<double, std::milli>(batchedEnd - batchedStart).count();
+        }
+        result.scalarMilliseconds /= frameCount;
+        result.batchedMilliseconds /= frameCount;
+        result.switchesPerFrame = frameCount > 1 ? static_cast<double>(switchCount) / (frameCount - 1) : 0;
+        result.switchesPerFrameWithoutHysteresis = frameCount > 1 ? static_cast<double>(switchCountWithoutHysteresis) / (frameCount - 1) : 0;
+        return result;
+    }
+}
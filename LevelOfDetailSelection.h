@@ -0,0 +1,49 @@
+#pragma once
+
+#include <span>
+#include "MeshData.h"
+
+// Picks the level of detail of every model each frame from the size its bounding sphere takes on screen.
+namespace LevelOfDetailSelection
+{
+    // Largest error, in pixels, a level of detail may show on screen before a finer one replaces it.
+    constexpr float pixelErrorThreshold = 1;
+    // A coarser level only replaces the current one once its error falls under this fraction of the
+    // threshold, so that models hovering around a switching distance do not flicker between two levels.
+    constexpr float hysteresisRatio = 0.75f;
+
+    // Pixels covered by a unit of tan(angle) away from the view direction: half the viewport height times
+    // the y scale of the projection, both the same for every model of a frame.
+    float ProjectionScale(const XMFLOAT4X4& projection, float viewportHeight);
+    // Radius on screen, in pixels, of the world space sphere seen from cameraPosition, infinite when the
+    // camera is inside it.
+    float ProjectRadius(const Sphere& sphere, const XMFLOAT3& cameraPosition, float projectionScale);
+    // ProjectRadius of every sphere into projectedRadii, four spheres at a time.
+    void ProjectRadii(std::span<const Sphere> spheres, const XMFLOAT3& cameraPosition, float projectionScale,
+        std::span<float> projectedRadii);
+    // Coarsest level whose error, scaled from the mesh radius to projectedRadius, stays under the threshold,
+    // moving away from the current level only when it is too coarse or a coarser one is under the
+    // threshold times coarseningRatio. The errors of levels must not decrease, the first being the full mesh.
+    std::size_t SelectLevel(std::span<const LevelOfDetail> levels, float meshRadius, float projectedRadius,
+        std::size_t current, float coarseningRatio = hysteresisRatio);
+
+    // SelectLevel for every model drawing the same mesh, from its projected radius and current level,
+    // four models at a time.
+    void SelectLevels(std::span<const LevelOfDetail> levels, float meshRadius, std::span<const float> projectedRadii,
+        std::span<std::uint32_t> currentLevels, float coarseningRatio = hysteresisRatio);
+
+    struct BenchmarkResult
+    {
+        double scalarMilliseconds;
+        double batchedMilliseconds;
+        double switchesPerFrame;
+        double switchesPerFrameWithoutHysteresis;
+        // Models whose batched selection differed from the scalar one, over all frames.
+        std::size_t mismatchCount;
+    };
+
+    // Average time per frame to select the levels of modelCount models one model at a time and in batches,
+    // over a camera shaking while it walks through them, along with how many models change level each
+    // frame with and without hysteresis.
+    BenchmarkResult Benchmark(std::size_t modelCount, unsigned frameCount);
+}
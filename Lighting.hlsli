@@ -15,12 +15,12 @@ float3 CalculateDiffuseColour(float3 normalizedContactSurfaceNormal, float3 inve
     return lightColour * brightness;
 }
 
-float3 CalculateSpecularColour(float3 contactPoint, float3 normalizedContactSurfaceNormal, float3 invertedLightDirection, float3 lightColour)
+float3 CalculateSpecularColour(float3 contactPoint, float3 normalizedContactSurfaceNormal, float3 invertedLightDirection, float3 lightColour, uint instance)
 {
     float3 contactPointToCamera = normalize(cameraPosition - contactPoint);
     float3 halfWayVector = normalize(contactPointToCamera + invertedLightDirection);
     float brightness = saturate(dot(halfWayVector, normalizedContactSurfaceNormal));
-    return lightColour * pow(brightness, specularExponent) * specularIntensity;
+    return lightColour * pow(brightness, instances[instance].specularExponent) * instances[instance].specularIntensity;
 }
 
 float CalculateSquaredAttenuation(float distanceToLightSource, float lightRangeReciprocal)
@@ -36,41 +36,41 @@ float CalculateSquaredConeAttenuation(float3 contactPointToLightSource, float3 i
     return pow(coneAttenuation, 2);
 }
 
-float3 CalculateLightColour(float3 contactPoint, float3 normalizedContactSurfaceNormal, Light::Directional light)
+float3 CalculateLightColour(float3 contactPoint, float3 normalizedContactSurfaceNormal, Light::Directional light, uint instance)
 {
     float3 diffuseColour = CalculateDiffuseColour(normalizedContactSurfaceNormal, light.normalizedInvertedDirection, light.colour);
-    float3 specularColour = CalculateSpecularColour(contactPoint, normalizedContactSurfaceNormal, light.normalizedInvertedDirection, light.colour);
+    float3 specularColour = CalculateSpecularColour(contactPoint, normalizedContactSurfaceNormal, light.normalizedInvertedDirection, light.colour, instance);
     return diffuseColour + specularColour;
 }
 
-float3 CalculateLightColour(float3 contactPoint, float3 normalizedContactSurfaceNormal, Light::Point light)
+float3 CalculateLightColour(float3 contactPoint, float3 normalizedContactSurfaceNormal, Light::Point light, uint instance)
 {
     float distanceFromContactPointToLightSource;
     float3 contactPointToLightSource = NormalizedFromTo(contactPoint, light.position, distanceFromContactPointToLightSource);
     float3 diffuseColour = CalculateDiffuseColour(normalizedContactSurfaceNormal, contactPointToLightSource, light.colour);
-    float3 specularColour = CalculateSpecularColour(contactPoint, normalizedContactSurfaceNormal, contactPointToLightSource, light.colour);
+    float3 specularColour = CalculateSpecularColour(contactPoint, normalizedContactSurfaceNormal, contactPointToLightSource, light.colour, instance);
     float attenuation = CalculateSquaredAttenuation(distanceFromContactPointToLightSource, light.rangeReciprocal);
     return (diffuseColour + specularColour) * attenuation;
 }
 
-float3 CalculateLightColour(float3 contactPoint, float3 normalizedContactSurfaceNormal, Light::Spot light)
+float3 CalculateLightColour(float3 contactPoint, float3 normalizedContactSurfaceNormal, Light::Spot light, uint instance)
 {
     float distanceFromContactPointToLightSource;
     float3 contactPointToLightSource = NormalizedFromTo(contactPoint, light.position, distanceFromContactPointToLightSource);
     float3 diffuseColour = CalculateDiffuseColour(normalizedContactSurfaceNormal, contactPointToLightSource, light.colour);
-    float3 specularColour = CalculateSpecularColour(contactPoint, normalizedContactSurfaceNormal, contactPointToLightSource, light.colour);
+    float3 specularColour = CalculateSpecularColour(contactPoint, normalizedContactSurfaceNormal, contactPointToLightSource, light.colour, instance);
     float attenuation = CalculateSquaredAttenuation(distanceFromContactPointToLightSource, light.rangeReciprocal);
     float coneAttenuation = CalculateSquaredConeAttenuation(contactPointToLightSource, light.normalizedInvertedDirection, light.cosOuterCone, light.cosInnerConeReciprocal);
     return (diffuseColour + specularColour) * attenuation * coneAttenuation;
 }
 
-float3 CalculateLightColour(float3 contactPoint, float3 normalizedContactSurfaceNormal, Light::Capsule light)
+float3 CalculateLightColour(float3 contactPoint, float3 normalizedContactSurfaceNormal, Light::Capsule light, uint instance)
 {
     float3 lightSource = ClosestPointOnSegmentFromPoint(contactPoint, light.segmentStartPosition, light.normalizedSegmentStartToSegmentEnd, light.segmentLength);
     float distanceFromContactPointToLightSource;
     float3 contactPointToLightSource = NormalizedFromTo(contactPoint, lightSource, distanceFromContactPointToLightSource);
     float3 diffuseColour = CalculateDiffuseColour(normalizedContactSurfaceNormal, contactPointToLightSource, light.colour);
-    float3 specularColour = CalculateSpecularColour(contactPoint, normalizedContactSurfaceNormal, contactPointToLightSource, light.colour);
+    float3 specularColour = CalculateSpecularColour(contactPoint, normalizedContactSurfaceNormal, contactPointToLightSource, light.colour, instance);
     float attenuation = CalculateSquaredAttenuation(distanceFromContactPointToLightSource, light.rangeReciprocal);
     return (diffuseColour + specularColour) * attenuation;
 }
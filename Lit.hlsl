@@ -7,25 +7,46 @@ struct VertexInput
     local2 uv : UV;
 };
 
+struct PackedVertexInput
+{
+    float4 position : POSITION;
+    float2 normal : NORMAL;
+    float2 uv : UV;
+};
+
 struct PixelInput
 {
     world3 position : POSITION;
     world3 normal : NORMAL;
     float2 uv : UV;
+    nointerpolation uint instance : INSTANCE;
     clip4 screenPosition : SV_POSITION;
 };
 
-PixelInput Vertex(VertexInput input)
+PixelInput TransformVertex(local3 position, local3 normal, local2 uv, uint instance)
 {
     PixelInput result;
-    world4 worldPosition = mul(float4(input.position, 1), model);
+    world4 worldPosition = mul(float4(position, 1), instances[instance].model);
     result.position = worldPosition.xyz;
-    result.normal = mul(input.normal, (float3x3) model);
-    result.uv = mul(float4(input.uv, 0, 1), textureTransform).xy;
+    result.normal = mul(normal, (float3x3) instances[instance].model);
+    result.uv = mul(float4(uv, 0, 1), instances[instance].textureTransform).xy;
+    result.instance = instance;
     result.screenPosition = mul(worldPosition, viewProjection);
     return result;
 }
 
+PixelInput Vertex(VertexInput input, uint instance : SV_InstanceID)
+{
+    return TransformVertex(input.position, input.normal, input.uv, instance);
+}
+
+PixelInput PackedVertex(PackedVertexInput input, uint instance : SV_InstanceID)
+{
+    const PerInstance instanceData = instances[instance];
+    return TransformVertex(instanceData.positionOffset.xyz + instanceData.positionScale.xyz * input.position.xyz,
+        DecodeOctahedral(input.normal), input.uv, instance);
+}
+
 float4 LitPixel(PixelInput input) : SV_TARGET
 {
     float3 pixelLightColour = 0;
@@ -37,31 +58,31 @@ float4 LitPixel(PixelInput input) : SV_TARGET
     [unroll(8)]
     for (uint lightIndex = 0; lightIndex < MAX_NUMBER_DIRECTIONAL_LIGHTS; ++lightIndex)
     {
-        pixelLightColour += CalculateLightColour(input.position, normalizedNormal, directionalLights[lightIndex]);
+        pixelLightColour += CalculateLightColour(input.position, normalizedNormal, directionalLights[lightIndex], input.instance);
     }
     #endif
     #ifdef MAX_NUMBER_POINT_LIGHTS
     [unroll(8)]
     for (uint lightIndex = 0; lightIndex < MAX_NUMBER_POINT_LIGHTS; ++lightIndex)
     {
-        pixelLightColour += CalculateLightColour(input.position, normalizedNormal, pointLights[lightIndex]);
+        pixelLightColour += CalculateLightColour(input.position, normalizedNormal, pointLights[lightIndex], input.instance);
     }
     #endif
     #ifdef MAX_NUMBER_SPOT_LIGHTS
     [unroll(8)]
     for (uint lightIndex = 0; lightIndex < MAX_NUMBER_SPOT_LIGHTS; ++lightIndex)
     {
-        pixelLightColour += CalculateLightColour(input.position, normalizedNormal, spotLights[lightIndex]);
+        pixelLightColour += CalculateLightColour(input.position, normalizedNormal, spotLights[lightIndex], input.instance);
     }
     #endif
     #ifdef MAX_NUMBER_CAPSULE_LIGHTS
     [unroll(8)]
     for (uint lightIndex = 0; lightIndex < MAX_NUMBER_CAPSULE_LIGHTS; ++lightIndex)
     {
-        pixelLightColour += CalculateLightColour(input.position, normalizedNormal, capsuleLights[lightIndex]);
+        pixelLightColour += CalculateLightColour(input.position, normalizedNormal, capsuleLights[lightIndex], input.instance);
     }
     #endif
-    return saturate(float4(pixelLightColour, 1)) * diffuseColour * float4(textures[0].Sample(anisotropicWrap, input.uv).rgb, 1);
+    return saturate(float4(pixelLightColour, 1)) * instances[input.instance].diffuseColour * float4(textures[0].Sample(anisotropicWrap, input.uv).rgb, 1);
 }
 
 float4 ChannelStencilPixel(PixelInput input) : SV_TARGET
@@ -69,5 +90,5 @@ float4 ChannelStencilPixel(PixelInput input) : SV_TARGET
     uint stencil = channelStencil.Load(int3(input.screenPosition.xy, 0)).g;
     float4 colourMultiplier = float4(float((stencil & 1) != 0), float((stencil & 4) != 0), float((stencil & 16) != 0), 1);
     clip((float) stencil - 1);
-    return diffuseColour;
+    return instances[input.instance].diffuseColour;
 }
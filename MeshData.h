@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <DirectXMath.h>
+
+using namespace DirectX;
+
+struct PositionNormalUV
+{
+    XMFLOAT3 position;
+    XMFLOAT3 normal;
+    XMFLOAT2 uv;
+};
+
+struct Sphere
+{
+    XMFLOAT3 centre;
+    float radius;
+};
+
+struct Box
+{
+    XMFLOAT3 centre;
+    XMFLOAT3 extents;
+};
+
+// Extents of a mesh, in its own space or in world space once drawn by a model.
+struct Bounds
+{
+    Box box;
+    Sphere sphere;
+};
+
+// Run of triangles of a mesh index buffer over few enough distinct vertices to be culled as a whole.
+struct Meshlet
+{
+    std::uint32_t startIndex;
+    std::uint32_t triangleCount;
+    std::uint32_t vertexCount;
+    XMFLOAT3 centre;
+    float radius;
+    // Every triangle normal lies within the cone around coneAxis whose half angle has coneCutoff as its
+    // sine; a cutoff of 1 marks normals too spread out for the meshlet to ever be back facing as a whole.
+    XMFLOAT3 coneAxis;
+    float coneCutoff;
+};
+
+// Range of a mesh index buffer drawing the whole mesh at one level of detail. The error is the largest
+// distance its surface strays from the full mesh, in mesh units.
+struct LevelOfDetail
+{
+    std::uint32_t startIndex;
+    std::uint32_t indexCount;
+    float error;
+};
+
+struct MeshData
+{
+    std::vector<PositionNormalUV> vertices;
+    std::vector<std::uint32_t> indices;
+    // Empty unless built, in which case they cover the indices of the first level of detail in order.
+    std::vector<Meshlet> meshlets;
+    // Empty unless built, in which case the first is the full mesh and the indices hold all of them, one after the other.
+    std::vector<LevelOfDetail> levelsOfDetail;
+};
+
+// Range of a mesh index buffer drawn on its own, its indices relative to baseVertex.
+struct Submesh
+{
+    std::uint32_t startIndex;
+    std::uint32_t indexCount;
+    std::int32_t baseVertex;
+};
+
+struct MeshCounts
+{
+    std::uint32_t vertexCount;
+    std::uint32_t indexCount;
+};
+
+// Memory a mesh producer writes its vertices and indices into, sized from its MeshCounts. Producers must
+// write every element once and never read it back, as it is write combined upload memory whenever the
+// mesh needs no staging, and return the bounds of the vertices without reading them either. Indices are
+// std::uint16_t when every vertex fits them, written straight into the index buffer, std::uint32_t otherwise.
+template<typename Index>
+struct MeshSpans
+{
+    std::span<PositionNormalUV> vertices;
+    std::span<Index> indices;
+};
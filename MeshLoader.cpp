@@ -0,0 +1,426 @@
+#include "stdafx.h"
+#include "DXSampleHelper.h"
+#include "MeshLoader.h"
+#include "MeshTextParser.h"
+#include "Culling.h"
+#include <cassert>
+#include <fstream>
+#include <chrono>
+
+namespace MeshLoader
+{
+    MappedFile::MappedFile(const std::wstring& path) :
+        file(CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr)),
+        data{}, size{}
+    {
+        if (!file.IsValid())
+        {
+            ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file.Get(), &fileSize))
+        {
+            ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+        }
+        size = static_cast<std::size_t>(fileSize.QuadPart);
+        if (size == 0)
+            return;
+        mapping.Attach(CreateFileMappingW(file.Get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+        if (!mapping.IsValid())
+        {
+            ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+        }
+        data = static_cast<const std::byte*>(MapViewOfFile(mapping.Get(), FILE_MAP_READ, 0, 0, 0));
+        if (data == nullptr)
+        {
+            ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+        }
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (data != nullptr)
+            UnmapViewOfFile(data);
+    }
+
+    std::wstring BinaryPath(const std::wstring& textPath)
+    {
+        const std::size_t extension = textPath.find_last_of(L'.');
+        return textPath.substr(0, extension) + L".mesh";
+    }
+
+    bool TryGetSourceStamp(const std::wstring& textPath, SourceStamp& stamp)
+    {
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if (!GetFileAttributesExW(textPath.c_str(), GetFileExInfoStandard, &attributes))
+            return false;
+        stamp.size = (static_cast<std::uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+        stamp.lastWriteTime = (static_cast<std::uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+        return true;
+    }
+
+    namespace
+    {
+        enum ProcessingFlags : std::uint32_t
+        {
+            Welded = 1 << 0,
+            VertexCacheOptimised = 1 << 1,
+            OverdrawOptimised = 1 << 2,
+            MeshletsBuilt = 1 << 3,
+            LevelsOfDetailBuilt = 1 << 4
+        };
+
+        std::uint32_t Flags(const ProcessingOptions& processing)
+        {
+            return (processing.weld ? Welded : 0) | (processing.optimiseVertexCache ? VertexCacheOptimised : 0) |
+                (processing.optimiseOverdraw ? OverdrawOptimised : 0) | (processing.buildMeshlets ? MeshletsBuilt : 0) |
+                (processing.buildLevelsOfDetail ? LevelsOfDetailBuilt : 0);
+        }
+
+        ProcessingReport Report(const BinaryHeader& header)
+        {
+            ProcessingReport report{};
+            report.weld = { header.sourceVertexCount, header.vertexCount };
+            report.vertexCache.before = { header.sourceAverageCacheMissRatio, header.sourceAverageTransformToVertexRatio };
+            report.vertexCache.after = { header.averageCacheMissRatio, header.averageTransformToVertexRatio };
+            return report;
+        }
+
+        // Header of a mapped binary cache, or nullptr when it is not a complete cache of the expected source.
+        const BinaryHeader* ValidateBinary(const MappedFile& binary, const SourceStamp* expectedStamp, const ProcessingOptions& processing)
+        {
+            if (binary.Size() < sizeof(BinaryHeader))
+                return nullptr;
+            const auto header = reinterpret_cast<const BinaryHeader*>(binary.Data());
+            if (header->magic != binaryMagic || header->version != binaryVersion ||
+                header->vertexStride != sizeof(PositionNormalUV) || header->indexStride != sizeof(std::uint32_t) ||
+                header->meshletStride != sizeof(Meshlet) || header->levelOfDetailStride != sizeof(LevelOfDetail))
+                return nullptr;
+            if (expectedStamp != nullptr &&
+                (header->sourceSize != expectedStamp->size || header->sourceLastWriteTime != expectedStamp->lastWriteTime))
+                return nullptr;
+            if (header->processingFlags != Flags(processing) || (processing.weld && header->weldEpsilon != processing.weldEpsilon) ||
+                (processing.optimiseOverdraw && header->overdrawThreshold != processing.overdrawThreshold))
+                return nullptr;
+            const std::size_t vertexBytes = static_cast<std::size_t>(header->vertexCount) * header->vertexStride;
+            const std::size_t indexBytes = static_cast<std::size_t>(header->indexCount) * header->indexStride;
+            const std::size_t meshletBytes = static_cast<std::size_t>(header->meshletCount) * header->meshletStride;
+            const std::size_t levelOfDetailBytes = static_cast<std::size_t>(header->levelOfDetailCount) * header->levelOfDetailStride;
+            if (binary.Size() != sizeof(BinaryHeader) + vertexBytes + indexBytes + meshletBytes + levelOfDetailBytes)
+                return nullptr;
+            return header;
+        }
+
+        const PositionNormalUV* BinaryVertices(const BinaryHeader* header)
+        {
+            return reinterpret_cast<const PositionNormalUV*>(header + 1);
+        }
+
+        const std::uint32_t* BinaryIndices(const BinaryHeader* header)
+        {
+            return reinterpret_cast<const std::uint32_t*>(BinaryVertices(header) + header->vertexCount);
+        }
+
+        const Meshlet* BinaryMeshlets(const BinaryHeader* header)
+        {
+            return reinterpret_cast<const Meshlet*>(BinaryIndices(header) + header->indexCount);
+        }
+
+        const LevelOfDetail* BinaryLevelsOfDetail(const BinaryHeader* header)
+        {
+            return reinterpret_cast<const LevelOfDetail*>(BinaryMeshlets(header) + header->meshletCount);
+        }
+
+        std::string_view Text(const MappedFile& text)
+        {
+            return std::string_view(reinterpret_cast<const char*>(text.Data()), text.Size());
+        }
+    }
+
+    void LoadFromText(const std::wstring& textPath, MeshData& mesh)
+    {
+        MappedFile text(textPath);
+        MeshTextParser::Parse(Text(text), mesh);
+    }
+
+    void LoadFromTextStream(const std::wstring& textPath, MeshData& mesh)
+    {
+        std::ifstream meshLoader(textPath);
+        if (!meshLoader)
+            throw std::runtime_error("Could not open text mesh");
+        std::string ignore;
+        UINT triangleCount;
+        UINT vertexCount;
+        meshLoader >> ignore >> vertexCount;
+        meshLoader >> ignore >> triangleCount;
+        meshLoader >> ignore >> ignore >> ignore >> ignore;
+        std::vector<PositionNormalUV>& vertices = mesh.vertices;
+        vertices.resize(vertexCount);
+        for (UINT i = 0; i < vertexCount; ++i)
+        {
+            meshLoader >> vertices[i].position.x >> vertices[i].position.y >> vertices[i].position.z;
+            meshLoader >> vertices[i].normal.x >> vertices[i].normal.y >> vertices[i].normal.z;
+            vertices[i].uv = { 0.0f, 0.0f };
+        }
+        meshLoader >> ignore >> ignore >> ignore;
+        std::vector<std::uint32_t>& indices = mesh.indices;
+        indices.resize(3 * triangleCount);
+        for (UINT i = 0; i < triangleCount; ++i)
+        {
+            meshLoader >> indices[i * 3U + 0] >> indices[i * 3U + 1] >> indices[i * 3U + 2];
+        }
+        if (!meshLoader)
+            throw std::runtime_error("Malformed text mesh");
+    }
+
+    ProcessingReport Process(MeshData& mesh, const ProcessingOptions& processing)
+    {
+        ProcessingReport report{};
+        report.weld = { mesh.vertices.size(), mesh.vertices.size() };
+        if (processing.weld)
+            report.weld = MeshOptimiser::Weld(mesh, processing.weldEpsilon);
+        if (processing.optimiseVertexCache)
+            report.vertexCache = MeshOptimiser::OptimiseVertexCacheAndFetch(mesh);
+        if (processing.optimiseOverdraw)
+        {
+            MeshOptimiser::OptimiseOverdraw(mesh.indices, mesh.vertices, processing.overdrawThreshold);
+            MeshOptimiser::OptimiseVertexFetch(mesh);
+            if (processing.optimiseVertexCache)
+                report.vertexCache.after = MeshOptimiser::SimulateVertexCache(mesh.indices, mesh.vertices.size());
+        }
+        if (processing.buildMeshlets)
+        {
+            MeshOptimiser::BuildMeshlets(mesh);
+            MeshOptimiser::OptimiseVertexFetch(mesh);
+            if (processing.optimiseVertexCache)
+                report.vertexCache.after = MeshOptimiser::SimulateVertexCache(mesh.indices, mesh.vertices.size());
+        }
+        if (processing.buildLevelsOfDetail)
+        {
+            MeshOptimiser::BuildLevelsOfDetail(mesh);
+            MeshOptimiser::OptimiseVertexFetch(mesh);
+        }
+        return report;
+    }
+
+    bool LoadFromBinary(const std::wstring& binaryPath, const SourceStamp* expectedStamp, const ProcessingOptions& processing, MeshData& mesh)
+    {
+        if (GetFileAttributesW(binaryPath.c_str()) == INVALID_FILE_ATTRIBUTES)
+            return false;
+        MappedFile binary(binaryPath);
+        const BinaryHeader* header = ValidateBinary(binary, expectedStamp, processing);
+        if (header == nullptr)
+            return false;
+        mesh.vertices.assign(BinaryVertices(header), BinaryVertices(header) + header->vertexCount);
+        mesh.indices.assign(BinaryIndices(header), BinaryIndices(header) + header->indexCount);
+        mesh.meshlets.assign(BinaryMeshlets(header), BinaryMeshlets(header) + header->meshletCount);
+        mesh.levelsOfDetail.assign(BinaryLevelsOfDetail(header), BinaryLevelsOfDetail(header) + header->levelOfDetailCount);
+        return true;
+    }
+
+    void SaveToBinary(const std::wstring& binaryPath, const SourceStamp& stamp, const ProcessingOptions& processing,
+        const ProcessingReport& report, const MeshData& mesh)
+    {
+        BinaryHeader header{};
+        header.magic = binaryMagic;
+        header.version = binaryVersion;
+        header.vertexStride = sizeof(PositionNormalUV);
+        header.indexStride = sizeof(std::uint32_t);
+        header.vertexCount = static_cast<std::uint32_t>(mesh.vertices.size());
+        header.indexCount = static_cast<std::uint32_t>(mesh.indices.size());
+        header.meshletStride = sizeof(Meshlet);
+        header.meshletCount = static_cast<std::uint32_t>(mesh.meshlets.size());
+        header.levelOfDetailStride = sizeof(LevelOfDetail);
+        header.levelOfDetailCount = static_cast<std::uint32_t>(mesh.levelsOfDetail.size());
+        header.sourceSize = stamp.size;
+        header.sourceLastWriteTime = stamp.lastWriteTime;
+        header.processingFlags = Flags(processing);
+        header.weldEpsilon = processing.weld ? processing.weldEpsilon : 0;
+        header.sourceVertexCount = static_cast<std::uint32_t>(report.weld.originalVertexCount);
+        header.sourceAverageCacheMissRatio = static_cast<float>(report.vertexCache.before.averageCacheMissRatio);
+        header.sourceAverageTransformToVertexRatio = static_cast<float>(report.vertexCache.before.averageTransformToVertexRatio);
+        header.averageCacheMissRatio = static_cast<float>(report.vertexCache.after.averageCacheMissRatio);
+        header.averageTransformToVertexRatio = static_cast<float>(report.vertexCache.after.averageTransformToVertexRatio);
+        header.overdrawThreshold = processing.optimiseOverdraw ? processing.overdrawThreshold : 0;
+        header.bounds = Culling::ComputeBounds(mesh.vertices);
+        std::ofstream meshWriter(binaryPath, std::ios::binary | std::ios::trunc);
+        meshWriter.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        meshWriter.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(PositionNormalUV));
+        meshWriter.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(std::uint32_t));
+        meshWriter.write(reinterpret_cast<const char*>(mesh.meshlets.data()), mesh.meshlets.size() * sizeof(Meshlet));
+        meshWriter.write(reinterpret_cast<const char*>(mesh.levelsOfDetail.data()), mesh.levelsOfDetail.size() * sizeof(LevelOfDetail));
+        meshWriter.close();
+        // A cache that could not be written completely is removed so that it is rebuilt on the next run.
+        if (!meshWriter)
+            DeleteFileW(binaryPath.c_str());
+    }
+
+    void Load(const std::wstring& textPath, MeshData& mesh, const ProcessingOptions& processing)
+    {
+        const std::wstring binaryPath = BinaryPath(textPath);
+        SourceStamp stamp;
+        if (!TryGetSourceStamp(textPath, stamp))
+        {
+            // Shipping without the text source is allowed, the cache is then trusted as long as it was processed alike.
+            if (!LoadFromBinary(binaryPath, nullptr, processing, mesh))
+                throw std::runtime_error("Missing mesh");
+            return;
+        }
+        if (LoadFromBinary(binaryPath, &stamp, processing, mesh))
+            return;
+        LoadFromText(textPath, mesh);
+        const ProcessingReport report = Process(mesh, processing);
+        SaveToBinary(binaryPath, stamp, processing, report, mesh);
+    }
+
+    MeshSource::MeshSource(const std::wstring& textPath, const ProcessingOptions& processing, CachePolicy cachePolicy) :
+        binaryHeader{}, textHeader{}, counts{}, report{}
+    {
+        if (cachePolicy == CachePolicy::Bypass)
+        {
+            file = std::make_unique<MappedFile>(textPath);
+            textHeader = MeshTextParser::ParseHeader(Text(*file));
+            counts = { textHeader.vertexCount, 3 * textHeader.triangleCount };
+            report.weld = { counts.vertexCount, counts.vertexCount };
+            return;
+        }
+        const std::wstring binaryPath = BinaryPath(textPath);
+        SourceStamp stamp;
+        const bool hasSource = TryGetSourceStamp(textPath, stamp);
+        if (GetFileAttributesW(binaryPath.c_str()) != INVALID_FILE_ATTRIBUTES)
+        {
+            file = std::make_unique<MappedFile>(binaryPath);
+            binaryHeader = ValidateBinary(*file, hasSource ? &stamp : nullptr, processing);
+            if (binaryHeader != nullptr)
+            {
+                counts = { binaryHeader->vertexCount, binaryHeader->indexCount };
+                report = Report(*binaryHeader);
+                return;
+            }
+            file.reset();
+        }
+        if (!hasSource)
+            throw std::runtime_error("Missing mesh");
+        LoadFromText(textPath, rebuiltMesh);
+        report = Process(rebuiltMesh, processing);
+        SaveToBinary(binaryPath, stamp, processing, report, rebuiltMesh);
+        counts = { static_cast<std::uint32_t>(rebuiltMesh.vertices.size()), static_cast<std::uint32_t>(rebuiltMesh.indices.size()) };
+    }
+
+    std::span<const Meshlet> MeshSource::Meshlets() const
+    {
+        if (binaryHeader != nullptr)
+            return { BinaryMeshlets(binaryHeader), binaryHeader->meshletCount };
+        return rebuiltMesh.meshlets;
+    }
+
+    std::span<const LevelOfDetail> MeshSource::LevelsOfDetail() const
+    {
+        if (binaryHeader != nullptr)
+            return { BinaryLevelsOfDetail(binaryHeader), binaryHeader->levelOfDetailCount };
+        return rebuiltMesh.levelsOfDetail;
+    }
+
+    namespace
+    {
+        void CopyIndices(const std::uint32_t* source, std::span<std::uint32_t> destination)
+        {
+            memcpy(destination.data(), source, destination.size_bytes());
+        }
+
+        void CopyIndices(const std::uint32_t* source, std::span<std::uint16_t> destination)
+        {
+            for (std::uint16_t& index : destination)
+                index = static_cast<std::uint16_t>(*source++);
+        }
+    }
+
+    template<typename Index>
+    Bounds MeshSource::ProduceAs(MeshSpans<Index> destination) const
+    {
+        assert(destination.vertices.size() == counts.vertexCount && destination.indices.size() == counts.indexCount);
+        assert(sizeof(Index) == sizeof(std::uint32_t) || counts.vertexCount <= MeshOptimiser::shortIndexVertexCount);
+        if (binaryHeader != nullptr)
+        {
+            memcpy(destination.vertices.data(), BinaryVertices(binaryHeader), destination.vertices.size_bytes());
+            CopyIndices(BinaryIndices(binaryHeader), destination.indices);
+            return binaryHeader->bounds;
+        }
+        if (file)
+        {
+            MeshTextParser::Parse(Text(*file), textHeader, destination.vertices, destination.indices);
+            return Culling::ComputeBounds(destination.vertices);
+        }
+        memcpy(destination.vertices.data(), rebuiltMesh.vertices.data(), destination.vertices.size_bytes());
+        CopyIndices(rebuiltMesh.indices.data(), destination.indices);
+        return Culling::ComputeBounds(rebuiltMesh.vertices);
+    }
+
+    Bounds MeshSource::Produce(MeshSpans<std::uint16_t> destination) const
+    {
+        return ProduceAs(destination);
+    }
+
+    Bounds MeshSource::Produce(MeshSpans<std::uint32_t> destination) const
+    {
+        return ProduceAs(destination);
+    }
+
+    BenchmarkResult Benchmark(const std::wstring& textPath, unsigned iterations)
+    {
+        using Clock = std::chrono::steady_clock;
+        // A binary of its own, as the cache next to the text was written with the options of whoever loaded it.
+        const std::wstring binaryPath = textPath.substr(0, textPath.find_last_of(L'.')) + L".benchmark.mesh";
+        MeshData mesh;
+        SourceStamp stamp;
+        if (!TryGetSourceStamp(textPath, stamp))
+            throw std::runtime_error("Missing text mesh");
+        LoadFromText(textPath, mesh);
+        SaveToBinary(binaryPath, stamp, {}, Process(mesh, {}), mesh);
+
+        BenchmarkResult result{};
+        for (unsigned iteration = 0; iteration < iterations; ++iteration)
+        {
+            MeshData textMesh;
+            const Clock::time_point textStart = Clock::now();
+            LoadFromText(textPath, textMesh);
+            const Clock::time_point binaryStart = Clock::now();
+            MeshData binaryMesh;
+            const bool binaryLoaded = LoadFromBinary(binaryPath, &stamp, {}, binaryMesh);
+            const Clock::time_point binaryEnd = Clock::now();
+            if (!binaryLoaded)
+            {
+                DeleteFileW(binaryPath.c_str());
+                throw std::runtime_error("Binary mesh written by the benchmark failed to load");
+            }
+            result.textMilliseconds += std::chrono::duration<double, std::milli>(binaryStart - textStart).count();
+            result.binaryMilliseconds += std::chrono::duration<double, std::milli>(binaryEnd - binaryStart).count();
+        }
+        DeleteFileW(binaryPath.c_str());
+        result.textMilliseconds /= iterations;
+        result.binaryMilliseconds /= iterations;
+        return result;
+    }
+
+    ParserBenchmarkResult BenchmarkParsers(const std::wstring& textPath, unsigned iterations)
+    {
+        using Clock = std::chrono::steady_clock;
+        SourceStamp stamp;
+        if (!TryGetSourceStamp(textPath, stamp))
+            throw std::runtime_error("Missing text mesh");
+        double streamSeconds = 0, parserSeconds = 0;
+        for (unsigned iteration = 0; iteration < iterations; ++iteration)
+        {
+            MeshData streamMesh, parserMesh;
+            const Clock::time_point streamStart = Clock::now();
+            LoadFromTextStream(textPath, streamMesh);
+            const Clock::time_point parserStart = Clock::now();
+            LoadFromText(textPath, parserMesh);
+            const Clock::time_point parserEnd = Clock::now();
+            streamSeconds += std::chrono::duration<double>(parserStart - streamStart).count();
+            parserSeconds += std::chrono::duration<double>(parserEnd - parserStart).count();
+        }
+        const double megabytes = iterations * (stamp.size / (1024.0 * 1024.0));
+        return { megabytes / streamSeconds, megabytes / parserSeconds };
+    }
+}
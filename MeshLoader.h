@@ -0,0 +1,163 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "MeshData.h"
+#include "MeshTextParser.h"
+#include "MeshOptimiser.h"
+
+namespace MeshLoader
+{
+    // Layout of the binary mesh cache written next to a text mesh (Models/skull.txt -> Models/skull.mesh).
+    // The header is followed by vertexCount tightly packed PositionNormalUV, indexCount 32 bit indices,
+    // meshletCount Meshlet and levelOfDetailCount LevelOfDetail.
+    struct BinaryHeader
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t vertexStride;
+        std::uint32_t indexStride;
+        std::uint32_t vertexCount;
+        std::uint32_t indexCount;
+        std::uint32_t meshletStride;
+        std::uint32_t meshletCount;
+        std::uint32_t levelOfDetailStride;
+        std::uint32_t levelOfDetailCount;
+        std::uint64_t sourceSize;
+        std::uint64_t sourceLastWriteTime;
+        std::uint32_t processingFlags;
+        float weldEpsilon;
+        std::uint32_t sourceVertexCount;
+        float sourceAverageCacheMissRatio;
+        float sourceAverageTransformToVertexRatio;
+        float averageCacheMissRatio;
+        float averageTransformToVertexRatio;
+        float overdrawThreshold;
+        // Of the vertices, so that producing them from the cache never reads them back.
+        Bounds bounds;
+    };
+
+    constexpr std::uint32_t binaryMagic = 0x4853454D; // "MESH"
+    constexpr std::uint32_t binaryVersion = 7;
+
+    // CPU processing applied to a parsed mesh before its binary cache is written. The options are
+    // stored in the cache header, so changing them rebuilds the cache on the next load.
+    struct ProcessingOptions
+    {
+        bool weld = false;
+        float weldEpsilon = 0;
+        bool optimiseVertexCache = false;
+        // Best run after the vertex cache optimisation, whose order it clusters.
+        bool optimiseOverdraw = false;
+        float overdrawThreshold = 1.05f;
+        // Reorders triangles into meshlets after the stages above, keeping as much of their orders as fits them.
+        bool buildMeshlets = false;
+        // Appends the coarser levels of detail last, after the full mesh every other stage works on.
+        bool buildLevelsOfDetail = false;
+    };
+
+    struct ProcessingReport
+    {
+        MeshOptimiser::WeldReport weld;
+        // Only filled in when the vertex cache optimisation ran.
+        MeshOptimiser::VertexCacheReport vertexCache;
+    };
+
+    ProcessingReport Process(MeshData& mesh, const ProcessingOptions& processing);
+
+    // Size and last write time of the text mesh a cache was built from, used to detect stale caches.
+    struct SourceStamp
+    {
+        std::uint64_t size;
+        std::uint64_t lastWriteTime;
+    };
+
+    // Read only view of a whole file mapped into the address space.
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const std::wstring& path);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const std::byte* Data() const { return data; }
+        std::size_t Size() const { return size; }
+
+    private:
+        Microsoft::WRL::Wrappers::FileHandle file;
+        Microsoft::WRL::Wrappers::HandleT<Microsoft::WRL::Wrappers::HandleTraits::HANDLENullTraits> mapping;
+        const std::byte* data;
+        std::size_t size;
+    };
+
+    enum class CachePolicy
+    {
+        Use, Bypass
+    };
+
+    // Mesh opened so that its counts are known before anything is parsed or copied, letting the caller
+    // size the destination that Produce then fills in a single pass. An up to date binary cache is copied
+    // from its mapping; with CachePolicy::Bypass the text is parsed straight into the destination, unprocessed.
+    // A missing or stale cache is rebuilt on construction, which is the only case where the mesh goes
+    // through an intermediate MeshData. The bounds of the vertices come from the cache or the rebuilt mesh,
+    // except with CachePolicy::Bypass, which reads the destination back for them, slowly, being only meant
+    // for measuring the parser.
+    class MeshSource
+    {
+    public:
+        explicit MeshSource(const std::wstring& textPath, const ProcessingOptions& processing = {}, CachePolicy cachePolicy = CachePolicy::Use);
+        MeshCounts Counts() const { return counts; }
+        const ProcessingReport& Report() const { return report; }
+        // Empty unless the mesh was processed with buildMeshlets; valid as long as the source is.
+        std::span<const Meshlet> Meshlets() const;
+        // Empty unless the mesh was processed with buildLevelsOfDetail; valid as long as the source is.
+        std::span<const LevelOfDetail> LevelsOfDetail() const;
+        // Returns the bounds of the vertices. 16 bit indices need Counts().vertexCount to fit them.
+        Bounds Produce(MeshSpans<std::uint16_t> destination) const;
+        Bounds Produce(MeshSpans<std::uint32_t> destination) const;
+
+    private:
+        template<typename Index>
+        Bounds ProduceAs(MeshSpans<Index> destination) const;
+
+        std::unique_ptr<MappedFile> file;
+        const BinaryHeader* binaryHeader;
+        MeshTextParser::Header textHeader;
+        MeshData rebuiltMesh;
+        MeshCounts counts;
+        ProcessingReport report;
+    };
+
+    std::wstring BinaryPath(const std::wstring& textPath);
+    bool TryGetSourceStamp(const std::wstring& textPath, SourceStamp& stamp);
+
+    void LoadFromText(const std::wstring& textPath, MeshData& mesh);
+    // Reference iostream extraction loop the text parser replaced, kept for benchmarking.
+    void LoadFromTextStream(const std::wstring& textPath, MeshData& mesh);
+    bool LoadFromBinary(const std::wstring& binaryPath, const SourceStamp* expectedStamp, const ProcessingOptions& processing, MeshData& mesh);
+    void SaveToBinary(const std::wstring& binaryPath, const SourceStamp& stamp, const ProcessingOptions& processing,
+        const ProcessingReport& report, const MeshData& mesh);
+
+    // Loads the binary cache of textPath when it is up to date, otherwise parses and processes the text and writes the cache.
+    void Load(const std::wstring& textPath, MeshData& mesh, const ProcessingOptions& processing = {});
+
+    struct BenchmarkResult
+    {
+        double textMilliseconds;
+        double binaryMilliseconds;
+    };
+
+    // Average load time of textPath through the text parser and through a binary of it written next to it for
+    // the benchmark, leaving the cache of textPath as it was. Throws if the binary does not load back.
+    BenchmarkResult Benchmark(const std::wstring& textPath, unsigned iterations);
+
+    struct ParserBenchmarkResult
+    {
+        double streamMegabytesPerSecond;
+        double parserMegabytesPerSecond;
+    };
+
+    // Text parsing throughput of the iostream loop against MeshTextParser on textPath.
+    ParserBenchmarkResult BenchmarkParsers(const std::wstring& textPath, unsigned iterations);
+}
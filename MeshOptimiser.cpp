@@ -0,0 +1,1243 @@
+#include "MeshOptimiser.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+namespace MeshOptimiser
+{
+    namespace
+    {
+        constexpr std::uint32_t emptySlot = ~0u;
+        constexpr std::size_t floatsPerVertex = sizeof(PositionNormalUV) / sizeof(float);
+
+        // Power of two open addressing table size keeping the load factor at or under one half.
+        std::size_t TableSize(std::size_t elementCount)
+        {
+            return std::bit_ceil(std::max<std::size_t>(16, 2 * elementCount));
+        }
+
+        std::uint32_t HashWords(const std::uint32_t* words, std::size_t count)
+        {
+            constexpr std::uint32_t multiplier = 0x5BD1E995;
+            std::uint32_t hash = 0x9747B28C;
+            for (std::size_t wordIndex = 0; wordIndex < count; ++wordIndex)
+            {
+                std::uint32_t word = words[wordIndex] * multiplier;
+                word ^= word >> 24;
+                hash = (hash * multiplier) ^ (word * multiplier);
+            }
+            hash ^= hash >> 13;
+            hash *= multiplier;
+            return hash ^ (hash >> 15);
+        }
+
+        bool WithinEpsilon(const PositionNormalUV& first, const PositionNormalUV& second, float epsilon)
+        {
+            const float* firstComponents = &first.position.x;
+            const float* secondComponents = &second.position.x;
+            for (std::size_t component = 0; component < floatsPerVertex; ++component)
+                if (!(std::fabs(firstComponents[component] - secondComponents[component]) <= epsilon))
+                    return false;
+            return true;
+        }
+
+        // Index of the kept vertex bit identical to vertex, inserting keptIndex for it when there is none.
+        std::uint32_t FindOrInsertExact(std::vector<std::uint32_t>& table, const std::vector<PositionNormalUV>& vertices,
+            const PositionNormalUV& vertex, std::uint32_t keptIndex)
+        {
+            std::uint32_t words[floatsPerVertex];
+            std::memcpy(words, &vertex, sizeof(vertex));
+            const std::size_t mask = table.size() - 1;
+            for (std::size_t slot = HashWords(words, floatsPerVertex) & mask;; slot = (slot + 1) & mask)
+            {
+                if (table[slot] == emptySlot)
+                {
+                    table[slot] = keptIndex;
+                    return keptIndex;
+                }
+                if (std::memcmp(&vertices[table[slot]], &vertex, sizeof(vertex)) == 0)
+                    return table[slot];
+            }
+        }
+
+        struct Cell
+        {
+            std::int32_t x, y, z;
+            std::uint32_t firstVertex;
+        };
+
+        std::int32_t CellCoordinate(float value, float cellSize)
+        {
+            return static_cast<std::int32_t>(std::clamp(std::floor(static_cast<double>(value) / cellSize), -2e9, 2e9));
+        }
+
+        // Spatial hash over the positions of the kept vertices, with cells twice as large as epsilon so
+        // that every vertex within epsilon of a position lies in one of the 2x2x2 cells closest to it.
+        class CellGrid
+        {
+        public:
+            CellGrid(std::size_t vertexCount, float epsilon) :
+                cells(TableSize(vertexCount), Cell{ 0, 0, 0, emptySlot }), nextInCell(vertexCount, emptySlot), cellSize(2 * epsilon)
+            {
+            }
+
+            template<typename Visitor>
+            bool AnyNeighbour(const XMFLOAT3& position, Visitor&& visitor) const
+            {
+                const float coordinates[3] = { position.x, position.y, position.z };
+                std::int32_t cell[3], step[3];
+                for (std::size_t axis = 0; axis < 3; ++axis)
+                {
+                    cell[axis] = CellCoordinate(coordinates[axis], cellSize);
+                    const double fraction = coordinates[axis] / static_cast<double>(cellSize) - cell[axis];
+                    step[axis] = fraction < 0.5 ? -1 : 1;
+                }
+                for (std::uint32_t neighbour = 0; neighbour < 8; ++neighbour)
+                {
+                    const std::uint32_t head = Find(cell[0] + ((neighbour & 1) ? step[0] : 0),
+                        cell[1] + ((neighbour & 2) ? step[1] : 0), cell[2] + ((neighbour & 4) ? step[2] : 0));
+                    for (std::uint32_t vertex = head; vertex != emptySlot; vertex = nextInCell[vertex])
+                        if (visitor(vertex))
+                            return true;
+                }
+                return false;
+            }
+
+            void Insert(const XMFLOAT3& position, std::uint32_t vertex)
+            {
+                const std::int32_t x = CellCoordinate(position.x, cellSize);
+                const std::int32_t y = CellCoordinate(position.y, cellSize);
+                const std::int32_t z = CellCoordinate(position.z, cellSize);
+                const std::size_t mask = cells.size() - 1;
+                for (std::size_t slot = Hash(x, y, z) & mask;; slot = (slot + 1) & mask)
+                {
+                    Cell& current = cells[slot];
+                    if (current.firstVertex == emptySlot)
+                        current = { x, y, z, emptySlot };
+                    if (current.x == x && current.y == y && current.z == z)
+                    {
+                        nextInCell[vertex] = current.firstVertex;
+                        current.firstVertex = vertex;
+                        return;
+                    }
+                }
+            }
+
+        private:
+            std::vector<Cell> cells;
+            std::vector<std::uint32_t> nextInCell;
+            float cellSize;
+
+            static std::uint32_t Hash(std::int32_t x, std::int32_t y, std::int32_t z)
+            {
+                const std::uint32_t words[3] = { static_cast<std::uint32_t>(x), static_cast<std::uint32_t>(y), static_cast<std::uint32_t>(z) };
+                return HashWords(words, 3);
+            }
+
+            std::uint32_t Find(std::int32_t x, std::int32_t y, std::int32_t z) const
+            {
+                const std::size_t mask = cells.size() - 1;
+                for (std::size_t slot = Hash(x, y, z) & mask;; slot = (slot + 1) & mask)
+                {
+                    const Cell& current = cells[slot];
+                    if (current.firstVertex == emptySlot)
+                        return emptySlot;
+                    if (current.x == x && current.y == y && current.z == z)
+                        return current.firstVertex;
+                }
+            }
+        };
+
+        // FIFO post-transform cache: a vertex is cached while fewer than cacheSize vertices were
+        // inserted after it. Reset ages every entry out instead of clearing the table.
+        class FifoCache
+        {
+        public:
+            FifoCache(std::size_t vertexCount, std::uint32_t cacheSize) :
+                insertedAt(vertexCount, neverInserted), clock(0), cacheSize(cacheSize)
+            {
+            }
+
+            // Whether vertex had to be inserted.
+            bool Miss(std::uint32_t vertex)
+            {
+                if (insertedAt[vertex] != neverInserted && clock - insertedAt[vertex] < cacheSize)
+                    return false;
+                insertedAt[vertex] = clock++;
+                return true;
+            }
+
+            std::uint32_t Misses(const std::uint32_t* triangle)
+            {
+                return Miss(triangle[0]) + Miss(triangle[1]) + Miss(triangle[2]);
+            }
+
+            void Reset()
+            {
+                clock += cacheSize;
+            }
+
+            std::size_t NeverInsertedCount() const
+            {
+                return std::count(insertedAt.begin(), insertedAt.end(), neverInserted);
+            }
+
+        private:
+            static constexpr std::size_t neverInserted = ~std::size_t{};
+            std::vector<std::size_t> insertedAt;
+            std::size_t clock;
+            std::uint32_t cacheSize;
+        };
+
+        struct Float3
+        {
+            float x, y, z;
+
+            Float3 operator+(const Float3& other) const { return { x + other.x, y + other.y, z + other.z }; }
+            Float3 operator-(const Float3& other) const { return { x - other.x, y - other.y, z - other.z }; }
+            Float3 operator*(float scale) const { return { x * scale, y * scale, z * scale }; }
+            float Dot(const Float3& other) const { return x * other.x + y * other.y + z * other.z; }
+            Float3 Cross(const Float3& other) const { return { y * other.z - z * other.y, z * other.x - x * other.z, x * other.y - y * other.x }; }
+            Float3 Normalised() const
+            {
+                const float length = std::sqrt(Dot(*this));
+                return length > 0 ? *this * (1 / length) : Float3{};
+            }
+        };
+
+        Float3 Position(const PositionNormalUV& vertex)
+        {
+            return { vertex.position.x, vertex.position.y, vertex.position.z };
+        }
+
+        // Triangles around every vertex, stored contiguously: the triangles of vertex v are
+        // triangles[offsets[v]] up to triangles[offsets[v + 1]].
+        struct VertexTriangles
+        {
+            std::vector<std::uint32_t> offsets;
+            std::vector<std::uint32_t> triangles;
+
+            VertexTriangles(std::span<const std::uint32_t> indices, std::size_t vertexCount) :
+                offsets(vertexCount + 1, 0), triangles(indices.size())
+            {
+                for (std::uint32_t index : indices)
+                    ++offsets[index + 1];
+                std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+                std::vector<std::uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+                for (std::size_t corner = 0; corner < indices.size(); ++corner)
+                    triangles[cursors[indices[corner]]++] = static_cast<std::uint32_t>(corner / 3);
+            }
+
+            std::span<const std::uint32_t> Of(std::uint32_t vertex) const
+            {
+                return { triangles.data() + offsets[vertex], triangles.data() + offsets[vertex + 1] };
+            }
+        };
+    }
+
+    WeldReport Weld(MeshData& mesh, float epsilon)
+    {
+        std::vector<PositionNormalUV>& vertices = mesh.vertices;
+        const std::size_t vertexCount = vertices.size();
+        // Kept vertices are compacted in place: the kept index never exceeds the index being visited,
+        // and every vertex before it has already been visited.
+        std::vector<std::uint32_t> remap(vertexCount);
+        std::uint32_t keptCount = 0;
+        if (epsilon <= 0)
+        {
+            std::vector<std::uint32_t> table(TableSize(vertexCount), emptySlot);
+            for (std::size_t vertexIndex = 0; vertexIndex < vertexCount; ++vertexIndex)
+            {
+                const PositionNormalUV vertex = vertices[vertexIndex];
+                remap[vertexIndex] = FindOrInsertExact(table, vertices, vertex, keptCount);
+                if (remap[vertexIndex] == keptCount)
+                    vertices[keptCount++] = vertex;
+            }
+        }
+        else
+        {
+            CellGrid grid(vertexCount, epsilon);
+            for (std::size_t vertexIndex = 0; vertexIndex < vertexCount; ++vertexIndex)
+            {
+                const PositionNormalUV vertex = vertices[vertexIndex];
+                std::uint32_t match = emptySlot;
+                grid.AnyNeighbour(vertex.position, [&](std::uint32_t kept)
+                {
+                    if (!WithinEpsilon(vertices[kept], vertex, epsilon))
+                        return false;
+                    match = kept;
+                    return true;
+                });
+                if (match == emptySlot)
+                {
+                    grid.Insert(vertex.position, keptCount);
+                    match = keptCount;
+                    vertices[keptCount++] = vertex;
+                }
+                remap[vertexIndex] = match;
+            }
+        }
+        for (std::uint32_t& index : mesh.indices)
+            index = remap[index];
+        vertices.resize(keptCount);
+        vertices.shrink_to_fit();
+        return { vertexCount, keptCount };
+    }
+
+    VertexCacheStatistics SimulateVertexCache(std::span<const std::uint32_t> indices, std::size_t vertexCount, std::uint32_t cacheSize)
+    {
+        FifoCache cache(vertexCount, cacheSize);
+        std::size_t misses = 0;
+        for (std::uint32_t index : indices)
+            misses += cache.Miss(index);
+        const std::size_t referencedCount = vertexCount - cache.NeverInsertedCount();
+        const std::size_t triangleCount = indices.size() / 3;
+        return { triangleCount == 0 ? 0.0 : static_cast<double>(misses) / triangleCount,
+            referencedCount == 0 ? 0.0 : static_cast<double>(misses) / referencedCount };
+    }
+
+    void OptimiseVertexCache(std::span<std::uint32_t> indices, std::size_t vertexCount, std::uint32_t cacheSize)
+    {
+        const std::size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+        const VertexTriangles adjacency(indices.first(triangleCount * 3), vertexCount);
+        std::vector<std::uint32_t> liveTriangles(vertexCount);
+        for (std::uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+            liveTriangles[vertex] = static_cast<std::uint32_t>(adjacency.Of(vertex).size());
+        std::vector<std::size_t> cacheTime(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<std::uint32_t> deadEnd;
+        std::vector<std::uint32_t> candidates;
+        std::vector<std::uint32_t> optimised;
+        optimised.reserve(triangleCount * 3);
+        std::size_t time = cacheSize + 1;
+        std::uint32_t scanCursor = 0;
+        const auto nextLiveVertex = [&]() -> std::int64_t
+        {
+            // Dead end: fall back to recently emitted vertices, then to the lowest index still in use.
+            while (!deadEnd.empty())
+            {
+                const std::uint32_t vertex = deadEnd.back();
+                deadEnd.pop_back();
+                if (liveTriangles[vertex] > 0)
+                    return vertex;
+            }
+            for (; scanCursor < vertexCount; ++scanCursor)
+                if (liveTriangles[scanCursor] > 0)
+                    return scanCursor;
+            return -1;
+        };
+        for (std::int64_t fanning = nextLiveVertex(); fanning >= 0;)
+        {
+            candidates.clear();
+            for (std::uint32_t triangle : adjacency.Of(static_cast<std::uint32_t>(fanning)))
+            {
+                if (emitted[triangle])
+                    continue;
+                emitted[triangle] = true;
+                for (std::size_t corner = 0; corner < 3; ++corner)
+                {
+                    const std::uint32_t vertex = indices[3 * triangle + corner];
+                    optimised.push_back(vertex);
+                    deadEnd.push_back(vertex);
+                    candidates.push_back(vertex);
+                    --liveTriangles[vertex];
+                    if (time - cacheTime[vertex] > cacheSize)
+                        cacheTime[vertex] = time++;
+                }
+            }
+            // Prefer the candidate that stays cached while its remaining triangles are fanned, and of
+            // those the one that entered the cache first.
+            std::int64_t best = -1;
+            std::size_t bestPriority = 0;
+            for (std::uint32_t vertex : candidates)
+            {
+                if (liveTriangles[vertex] == 0)
+                    continue;
+                std::size_t priority = 0;
+                if (time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+                    priority = time - cacheTime[vertex];
+                if (best < 0 || priority > bestPriority)
+                {
+                    best = vertex;
+                    bestPriority = priority;
+                }
+            }
+            fanning = best >= 0 ? best : nextLiveVertex();
+        }
+        // Trailing indices of an incomplete triangle are left where they are.
+        std::copy(optimised.begin(), optimised.end(), indices.begin());
+    }
+
+    void OptimiseVertexFetch(MeshData& mesh)
+    {
+        const std::size_t vertexCount = mesh.vertices.size();
+        std::vector<std::uint32_t> remap(vertexCount, emptySlot);
+        std::uint32_t nextVertex = 0;
+        const auto walk = [&](std::span<std::uint32_t> indices)
+        {
+            for (std::uint32_t& index : indices)
+            {
+                if (remap[index] == emptySlot)
+                    remap[index] = nextVertex++;
+                index = remap[index];
+            }
+        };
+        // Coarser levels of detail only use vertices of finer ones, so walking them from the coarsest
+        // on gives every level a prefix of the vertex buffer.
+        if (mesh.levelsOfDetail.empty())
+            walk(mesh.indices);
+        for (auto level = mesh.levelsOfDetail.rbegin(); level != mesh.levelsOfDetail.rend(); ++level)
+            walk(std::span(mesh.indices).subspan(level->startIndex, level->indexCount));
+        for (std::uint32_t& newIndex : remap)
+            if (newIndex == emptySlot)
+                newIndex = nextVertex++;
+        std::vector<PositionNormalUV> reordered(vertexCount);
+        for (std::size_t vertex = 0; vertex < vertexCount; ++vertex)
+            reordered[remap[vertex]] = mesh.vertices[vertex];
+        mesh.vertices = std::move(reordered);
+    }
+
+    VertexCacheReport OptimiseVertexCacheAndFetch(MeshData& mesh, std::uint32_t cacheSize)
+    {
+        VertexCacheReport report{};
+        report.before = SimulateVertexCache(mesh.indices, mesh.vertices.size(), cacheSize);
+        // Exported meshes may already come in a cache friendly order (the skull does), which a greedy
+        // reordering is not guaranteed to beat, so the original order is kept when it simulates better.
+        std::vector<std::uint32_t> originalIndices = mesh.indices;
+        OptimiseVertexCache(mesh.indices, mesh.vertices.size(), cacheSize);
+        report.after = SimulateVertexCache(mesh.indices, mesh.vertices.size(), cacheSize);
+        if (report.after.averageCacheMissRatio > report.before.averageCacheMissRatio)
+        {
+            mesh.indices = std::move(originalIndices);
+            report.after = report.before;
+        }
+        OptimiseVertexFetch(mesh);
+        return report;
+    }
+
+    void OptimiseOverdraw(std::span<std::uint32_t> indices, std::span<const PositionNormalUV> vertices, float threshold, std::uint32_t cacheSize)
+    {
+        const std::size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+        // Hard boundaries are where the cache order restarts, a triangle missing all of its vertices.
+        std::vector<std::size_t> hardBoundaries;
+        {
+            FifoCache cache(vertices.size(), cacheSize);
+            for (std::size_t triangle = 0; triangle < triangleCount; ++triangle)
+                if (cache.Misses(&indices[3 * triangle]) == 3)
+                    hardBoundaries.push_back(triangle);
+            hardBoundaries.push_back(triangleCount);
+        }
+        // Soft boundaries split every hard cluster further, wherever the cache efficiency from the
+        // cluster start is already within threshold of that of the whole hard cluster.
+        std::vector<std::size_t> boundaries;
+        FifoCache cache(vertices.size(), cacheSize);
+        for (std::size_t hard = 0; hard + 1 < hardBoundaries.size(); ++hard)
+        {
+            const std::size_t begin = hardBoundaries[hard], end = hardBoundaries[hard + 1];
+            cache.Reset();
+            std::size_t clusterMisses = 0;
+            for (std::size_t triangle = begin; triangle < end; ++triangle)
+                clusterMisses += cache.Misses(&indices[3 * triangle]);
+            const double acceptedRatio = threshold * static_cast<double>(clusterMisses) / (end - begin);
+            cache.Reset();
+            boundaries.push_back(begin);
+            std::size_t start = begin, misses = 0;
+            for (std::size_t triangle = begin; triangle < end; ++triangle)
+            {
+                misses += cache.Misses(&indices[3 * triangle]);
+                if (triangle + 1 < end && static_cast<double>(misses) / (triangle + 1 - start) <= acceptedRatio)
+                {
+                    boundaries.push_back(triangle + 1);
+                    start = triangle + 1;
+                    misses = 0;
+                    cache.Reset();
+                }
+            }
+        }
+        boundaries.push_back(triangleCount);
+
+        // Clusters facing away from the mesh centre occlude the rest from most viewpoints, so they are
+        // drawn first: the key is the distance of the cluster along its own normal from the centroid.
+        const std::size_t clusterCount = boundaries.size() - 1;
+        std::vector<Float3> clusterCentroids(clusterCount), clusterNormals(clusterCount);
+        Float3 meshCentroid{};
+        float meshArea = 0;
+        for (std::size_t cluster = 0; cluster < clusterCount; ++cluster)
+        {
+            Float3 centroid{}, normal{};
+            float area = 0;
+            for (std::size_t triangle = boundaries[cluster]; triangle < boundaries[cluster + 1]; ++triangle)
+            {
+                const Float3 a = Position(vertices[indices[3 * triangle]]);
+                const Float3 b = Position(vertices[indices[3 * triangle + 1]]);
+                const Float3 c = Position(vertices[indices[3 * triangle + 2]]);
+                const Float3 doubleAreaNormal = (b - a).Cross(c - a);
+                const float doubleArea = std::sqrt(doubleAreaNormal.Dot(doubleAreaNormal));
+                centroid = centroid + (a + b + c) * (doubleArea / 3);
+                normal = normal + doubleAreaNormal;
+                area += doubleArea;
+            }
+            meshCentroid = meshCentroid + centroid;
+            meshArea += area;
+            clusterCentroids[cluster] = area > 0 ? centroid * (1 / area) : centroid;
+            clusterNormals[cluster] = normal.Normalised();
+        }
+        if (meshArea > 0)
+            meshCentroid = meshCentroid * (1 / meshArea);
+        std::vector<float> sortKeys(clusterCount);
+        for (std::size_t cluster = 0; cluster < clusterCount; ++cluster)
+            sortKeys[cluster] = (clusterCentroids[cluster] - meshCentroid).Dot(clusterNormals[cluster]);
+        std::vector<std::uint32_t> order(clusterCount);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&sortKeys](std::uint32_t first, std::uint32_t second)
+        {
+            return sortKeys[first] > sortKeys[second];
+        });
+        std::vector<std::uint32_t> sorted;
+        sorted.reserve(triangleCount * 3);
+        for (std::uint32_t cluster : order)
+            sorted.insert(sorted.end(), indices.begin() + 3 * boundaries[cluster], indices.begin() + 3 * boundaries[cluster + 1]);
+        std::copy(sorted.begin(), sorted.end(), indices.begin());
+    }
+
+    OverdrawStatistics EstimateOverdraw(std::span<const std::uint32_t> indices, std::span<const PositionNormalUV> vertices,
+        std::uint32_t viewpointCount, std::uint32_t resolution, unsigned threadCount)
+    {
+        const std::size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0 || viewpointCount == 0 || resolution == 0)
+            return {};
+        Float3 minimum = Position(vertices[indices[0]]), maximum = minimum;
+        for (std::uint32_t index : indices)
+        {
+            const Float3 position = Position(vertices[index]);
+            minimum = { std::min(minimum.x, position.x), std::min(minimum.y, position.y), std::min(minimum.z, position.z) };
+            maximum = { std::max(maximum.x, position.x), std::max(maximum.y, position.y), std::max(maximum.z, position.z) };
+        }
+        const Float3 centre = (minimum + maximum) * 0.5f;
+        const float radius = std::max(std::sqrt((maximum - centre).Dot(maximum - centre)), 1e-6f);
+
+        std::vector<OverdrawStatistics> perViewpoint(viewpointCount);
+        ParallelFor(viewpointCount, [&](std::size_t viewpoint)
+        {
+            // Viewpoints on a Fibonacci sphere around the mesh, each looking at its centre with an
+            // orthographic projection of the bounding sphere onto the render target.
+            constexpr float goldenAngle = 2.39996323f;
+            const float z = 1 - (2 * viewpoint + 1) / static_cast<float>(viewpointCount);
+            const float ring = std::sqrt(std::max(0.0f, 1 - z * z));
+            const Float3 forward = Float3{ ring * std::cos(goldenAngle * viewpoint), ring * std::sin(goldenAngle * viewpoint), z } * -1;
+            const Float3 worldUp = std::fabs(forward.y) < 0.99f ? Float3{ 0, 1, 0 } : Float3{ 0, 0, 1 };
+            const Float3 right = worldUp.Cross(forward).Normalised();
+            const Float3 up = forward.Cross(right);
+            const float scale = 0.5f * resolution / radius;
+
+            std::vector<float> depthBuffer(static_cast<std::size_t>(resolution) * resolution, std::numeric_limits<float>::infinity());
+            OverdrawStatistics& statistics = perViewpoint[viewpoint];
+            for (std::size_t triangle = 0; triangle < triangleCount; ++triangle)
+            {
+                // Render target space: x right, y down, depth growing away from the viewer.
+                float x[3], y[3], depth[3];
+                for (std::size_t corner = 0; corner < 3; ++corner)
+                {
+                    const Float3 relative = Position(vertices[indices[3 * triangle + corner]]) - centre;
+                    x[corner] = 0.5f * resolution + relative.Dot(right) * scale;
+                    y[corner] = 0.5f * resolution - relative.Dot(up) * scale;
+                    depth[corner] = relative.Dot(forward);
+                }
+                // Back faces are culled like D3D12_CULL_MODE_BACK with clockwise front faces.
+                const float doubleArea = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+                if (!(doubleArea > 0))
+                    continue;
+                const std::uint32_t columnBegin = static_cast<std::uint32_t>(std::max(0.0f, std::ceil(std::min({ x[0], x[1], x[2] }) - 0.5f)));
+                const std::uint32_t columnEnd = static_cast<std::uint32_t>(std::clamp(std::ceil(std::max({ x[0], x[1], x[2] }) - 0.5f), 0.0f, static_cast<float>(resolution)));
+                const std::uint32_t rowBegin = static_cast<std::uint32_t>(std::max(0.0f, std::ceil(std::min({ y[0], y[1], y[2] }) - 0.5f)));
+                const std::uint32_t rowEnd = static_cast<std::uint32_t>(std::clamp(std::ceil(std::max({ y[0], y[1], y[2] }) - 0.5f), 0.0f, static_cast<float>(resolution)));
+                const float inverseDoubleArea = 1 / doubleArea;
+                for (std::uint32_t row = rowBegin; row < rowEnd; ++row)
+                    for (std::uint32_t column = columnBegin; column < columnEnd; ++column)
+                    {
+                        const float sampleX = column + 0.5f, sampleY = row + 0.5f;
+                        const float weight0 = (x[2] - x[1]) * (sampleY - y[1]) - (y[2] - y[1]) * (sampleX - x[1]);
+                        const float weight1 = (x[0] - x[2]) * (sampleY - y[2]) - (y[0] - y[2]) * (sampleX - x[2]);
+                        const float weight2 = (x[1] - x[0]) * (sampleY - y[0]) - (y[1] - y[0]) * (sampleX - x[0]);
+                        if (weight0 < 0 || weight1 < 0 || weight2 < 0)
+                            continue;
+                        const float sampleDepth = (weight0 * depth[0] + weight1 * depth[1] + weight2 * depth[2]) * inverseDoubleArea;
+                        float& stored = depthBuffer[static_cast<std::size_t>(row) * resolution + column];
+                        if (sampleDepth < stored)
+                        {
+                            stored = sampleDepth;
+                            ++statistics.shadedFragments;
+                        }
+                    }
+            }
+            statistics.coveredPixels = depthBuffer.size() - std::count(depthBuffer.begin(), depthBuffer.end(), std::numeric_limits<float>::infinity());
+        }, threadCount);
+
+        OverdrawStatistics total{};
+        for (const OverdrawStatistics& statistics : perViewpoint)
+        {
+            total.coveredPixels += statistics.coveredPixels;
+            total.shadedFragments += statistics.shadedFragments;
+        }
+        return total;
+    }
+
+    ShortIndexMesh SplitForShortIndices(std::span<const std::uint32_t> indices, std::size_t vertexCount)
+    {
+        ShortIndexMesh split;
+        const std::size_t indexCount = indices.size() - indices.size() % 3;
+        split.indices.resize(indexCount);
+        // Index of every source vertex in the current submesh, valid while its stamp matches the submesh.
+        std::vector<std::uint32_t> localIndices(vertexCount);
+        std::vector<std::uint32_t> stamps(vertexCount, emptySlot);
+        std::uint32_t submeshIndex = 0;
+        Submesh current{ 0, 0, 0 };
+        for (std::size_t triangle = 0; triangle < indexCount; triangle += 3)
+        {
+            std::uint32_t newVertexCount = 0;
+            for (std::size_t corner = 0; corner < 3; ++corner)
+            {
+                const std::uint32_t vertex = indices[triangle + corner];
+                newVertexCount += stamps[vertex] != submeshIndex &&
+                    (corner < 1 || vertex != indices[triangle]) && (corner < 2 || vertex != indices[triangle + 1]);
+            }
+            if (split.vertexRemap.size() - current.baseVertex + newVertexCount > shortIndexVertexCount)
+            {
+                split.submeshes.push_back(current);
+                current = { static_cast<std::uint32_t>(triangle), 0, static_cast<std::int32_t>(split.vertexRemap.size()) };
+                ++submeshIndex;
+            }
+            for (std::size_t corner = 0; corner < 3; ++corner)
+            {
+                const std::uint32_t vertex = indices[triangle + corner];
+                if (stamps[vertex] != submeshIndex)
+                {
+                    stamps[vertex] = submeshIndex;
+                    localIndices[vertex] = static_cast<std::uint32_t>(split.vertexRemap.size());
+                    split.vertexRemap.push_back(vertex);
+                }
+                split.indices[triangle + corner] = localIndices[vertex];
+            }
+            current.indexCount += 3;
+        }
+        if (current.indexCount > 0)
+            split.submeshes.push_back(current);
+        return split;
+    }
+
+    void WriteShortIndices(std::span<const std::uint32_t> indices, std::span<const Submesh> submeshes, std::span<std::uint16_t> destination)
+    {
+        for (const Submesh& submesh : submeshes)
+            for (std::uint32_t index = submesh.startIndex; index < submesh.startIndex + submesh.indexCount; ++index)
+                destination[index] = static_cast<std::uint16_t>(indices[index] - submesh.baseVertex);
+    }
+
+    void BuildMeshlets(MeshData& mesh)
+    {
+        const std::span<const PositionNormalUV> vertices = mesh.vertices;
+        const std::size_t indexCount = mesh.levelsOfDetail.empty() ? mesh.indices.size() : mesh.levelsOfDetail[0].indexCount;
+        const std::span<std::uint32_t> indices(mesh.indices.data(), indexCount - indexCount % 3);
+        const std::size_t triangleCount = indices.size() / 3;
+        mesh.meshlets.clear();
+        if (triangleCount == 0)
+            return;
+        const VertexTriangles adjacency(indices, vertices.size());
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<std::uint32_t> liveTriangles(vertices.size());
+        for (std::uint32_t vertex = 0; vertex < vertices.size(); ++vertex)
+            liveTriangles[vertex] = static_cast<std::uint32_t>(adjacency.Of(vertex).size());
+        // Meshlet each vertex was last added to, so that membership needs no clearing between meshlets.
+        std::vector<std::uint32_t> vertexMeshlet(vertices.size(), emptySlot);
+        std::vector<std::uint32_t> meshletVertices;
+        std::vector<std::uint32_t> reordered;
+        reordered.reserve(indices.size());
+        std::size_t firstLeft = 0;
+        std::size_t meshletStart = 0;
+        Float3 positionSum{}, normalSum{};
+        std::vector<Float3> triangleNormals(triangleCount);
+        float scaleSquared = 0;
+        for (std::size_t triangle = 0; triangle < triangleCount; ++triangle)
+        {
+            const Float3 a = Position(vertices[indices[3 * triangle]]);
+            const Float3 b = Position(vertices[indices[3 * triangle + 1]]);
+            triangleNormals[triangle] = (b - a).Cross(Position(vertices[indices[3 * triangle + 2]]) - a).Normalised();
+            scaleSquared += (b - a).Dot(b - a);
+        }
+        scaleSquared = std::max(64 * scaleSquared / triangleCount, std::numeric_limits<float>::min());
+        const float coneWeight = 0.5f;
+
+        const auto closeMeshlet = [&]()
+        {
+            Meshlet meshlet{};
+            meshlet.startIndex = static_cast<std::uint32_t>(meshletStart);
+            meshlet.triangleCount = static_cast<std::uint32_t>((reordered.size() - meshletStart) / 3);
+            meshlet.vertexCount = static_cast<std::uint32_t>(meshletVertices.size());
+            Float3 minimum = Position(vertices[meshletVertices[0]]), maximum = minimum;
+            for (std::uint32_t vertex : meshletVertices)
+            {
+                const Float3 position = Position(vertices[vertex]);
+                minimum = { std::min(minimum.x, position.x), std::min(minimum.y, position.y), std::min(minimum.z, position.z) };
+                maximum = { std::max(maximum.x, position.x), std::max(maximum.y, position.y), std::max(maximum.z, position.z) };
+            }
+            const Float3 centre = (minimum + maximum) * 0.5f;
+            float radiusSquared = 0;
+            for (std::uint32_t vertex : meshletVertices)
+                radiusSquared = std::max(radiusSquared, (Position(vertices[vertex]) - centre).Dot(Position(vertices[vertex]) - centre));
+            meshlet.centre = { centre.x, centre.y, centre.z };
+            meshlet.radius = std::sqrt(radiusSquared);
+            // Triangle normals follow the clockwise front faces of D3D12 in a left handed space.
+            std::vector<Float3> normals;
+            normals.reserve(meshlet.triangleCount);
+            Float3 unitNormalSum{};
+            for (std::size_t corner = meshlet.startIndex; corner < reordered.size(); corner += 3)
+            {
+                const Float3 a = Position(vertices[reordered[corner]]);
+                const Float3 normal = (Position(vertices[reordered[corner + 1]]) - a).Cross(Position(vertices[reordered[corner + 2]]) - a).Normalised();
+                normals.push_back(normal);
+                unitNormalSum = unitNormalSum + normal;
+            }
+            const Float3 axis = unitNormalSum.Normalised();
+            float minimumDot = axis.Dot(axis) > 0 ? 1.0f : -1.0f;
+            for (const Float3& normal : normals)
+                if (normal.Dot(normal) > 0)
+                    minimumDot = std::min(minimumDot, normal.Dot(axis));
+            meshlet.coneAxis = { axis.x, axis.y, axis.z };
+            meshlet.coneCutoff = minimumDot <= 0 ? 1.0f : std::sqrt(std::max(0.0f, 1 - minimumDot * minimumDot));
+            mesh.meshlets.push_back(meshlet);
+            meshletStart = reordered.size();
+            meshletVertices.clear();
+            positionSum = {};
+            normalSum = {};
+        };
+
+        // Triangles not emitted yet around the corners of triangle, the fewer the more likely it is to be left isolated.
+        const auto leftAround = [&](std::size_t triangle)
+        {
+            return liveTriangles[indices[3 * triangle]] + liveTriangles[indices[3 * triangle + 1]] + liveTriangles[indices[3 * triangle + 2]];
+        };
+
+        const auto newVertexCount = [&](std::size_t triangle)
+        {
+            const std::uint32_t meshletIndex = static_cast<std::uint32_t>(mesh.meshlets.size());
+            const std::uint32_t* corners = &indices[3 * triangle];
+            return static_cast<std::uint32_t>((vertexMeshlet[corners[0]] != meshletIndex) +
+                (vertexMeshlet[corners[1]] != meshletIndex && corners[1] != corners[0]) +
+                (vertexMeshlet[corners[2]] != meshletIndex && corners[2] != corners[0] && corners[2] != corners[1]));
+        };
+
+        for (std::size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+        {
+            std::int64_t best = -1;
+            if (!meshletVertices.empty() && reordered.size() - meshletStart < 3 * meshletTriangleCount)
+            {
+                const Float3 centroid = positionSum * (1.0f / meshletVertices.size());
+                const Float3 axis = normalSum.Normalised();
+                std::uint32_t bestNewVertexCount = 4;
+                std::uint32_t bestLeft = 0;
+                float bestScore = 0;
+                for (std::uint32_t vertex : meshletVertices)
+                    for (std::uint32_t triangle : adjacency.Of(vertex))
+                    {
+                        if (emitted[triangle])
+                            continue;
+                        const std::uint32_t added = newVertexCount(triangle);
+                        if (meshletVertices.size() + added > meshletVertexCount || added > bestNewVertexCount)
+                            continue;
+                        const std::uint32_t left = leftAround(triangle);
+                        if (added == bestNewVertexCount && left > bestLeft)
+                            continue;
+                        const Float3 triangleCentre = (Position(vertices[indices[3 * triangle]]) + Position(vertices[indices[3 * triangle + 1]]) +
+                            Position(vertices[indices[3 * triangle + 2]])) * (1.0f / 3);
+                        const float score = (triangleCentre - centroid).Dot(triangleCentre - centroid) / scaleSquared +
+                            coneWeight * (1 - triangleNormals[triangle].Dot(axis));
+                        if (added < bestNewVertexCount || left < bestLeft || score < bestScore)
+                        {
+                            best = triangle;
+                            bestNewVertexCount = added;
+                            bestLeft = left;
+                            bestScore = score;
+                        }
+                    }
+            }
+            if (best < 0)
+            {
+                // The next meshlet starts next to the one just closed, from the triangle with the fewest
+                // triangles left around it, so that growth does not leave isolated triangles behind.
+                std::uint32_t fewestLeft = std::numeric_limits<std::uint32_t>::max();
+                for (std::uint32_t vertex : meshletVertices)
+                    for (std::uint32_t triangle : adjacency.Of(vertex))
+                    {
+                        if (emitted[triangle])
+                            continue;
+                        const std::uint32_t left = leftAround(triangle);
+                        if (left < fewestLeft)
+                        {
+                            best = triangle;
+                            fewestLeft = left;
+                        }
+                    }
+                if (!meshletVertices.empty())
+                    closeMeshlet();
+                if (best < 0)
+                {
+                    while (emitted[firstLeft])
+                        ++firstLeft;
+                    best = static_cast<std::int64_t>(firstLeft);
+                }
+            }
+            emitted[best] = true;
+            normalSum = normalSum + triangleNormals[best];
+            const std::uint32_t meshletIndex = static_cast<std::uint32_t>(mesh.meshlets.size());
+            for (std::size_t corner = 0; corner < 3; ++corner)
+            {
+                const std::uint32_t vertex = indices[3 * best + corner];
+                reordered.push_back(vertex);
+                --liveTriangles[vertex];
+                if (vertexMeshlet[vertex] != meshletIndex)
+                {
+                    vertexMeshlet[vertex] = meshletIndex;
+                    meshletVertices.push_back(vertex);
+                    positionSum = positionSum + Position(vertices[vertex]);
+                }
+            }
+        }
+        closeMeshlet();
+        std::copy(reordered.begin(), reordered.end(), indices.begin());
+    }
+
+    namespace
+    {
+        // Sum of the squared distances to a set of planes, each weighted by the area it stands for
+        // (Garland and Heckbert, 1997). Dividing by the total weight turns it into an average squared distance.
+        struct Quadric
+        {
+            double xx, xy, xz, yy, yz, zz, x, y, z, constant, weight;
+
+            static Quadric FromPlane(const Float3& normal, float distance, double weight)
+            {
+                const double a = normal.x, b = normal.y, c = normal.z, d = distance;
+                return { weight * a * a, weight * a * b, weight * a * c, weight * b * b, weight * b * c, weight * c * c,
+                    weight * a * d, weight * b * d, weight * c * d, weight * d * d, weight };
+            }
+
+            Quadric operator+(const Quadric& other) const
+            {
+                return { xx + other.xx, xy + other.xy, xz + other.xz, yy + other.yy, yz + other.yz, zz + other.zz,
+                    x + other.x, y + other.y, z + other.z, constant + other.constant, weight + other.weight };
+            }
+
+            double Error(const Float3& position) const
+            {
+                const double px = position.x, py = position.y, pz = position.z;
+                const double sum = xx * px * px + yy * py * py + zz * pz * pz + 2 * (xy * px * py + xz * px * pz + yz * py * pz) +
+                    2 * (x * px + y * py + z * pz) + constant;
+                return weight > 0 ? std::max(sum, 0.0) / weight : 0;
+            }
+        };
+
+        // Vertices at the same position are wedges of one surface point, split where its normal or uv
+        // changes. Seam vertices have two wedges joined along a seam of open edges; border vertices have
+        // one wedge on an open border. Both only move along their seam or border, taking every wedge along.
+        enum class VertexKind : std::uint8_t
+        {
+            Manifold, Border, Seam, Locked
+        };
+
+        struct Collapse
+        {
+            std::uint32_t from;
+            std::uint32_t to;
+            float error;
+            std::uint32_t removedTriangleCount;
+        };
+
+        // Edge collapser that only ever moves a vertex onto another one, so that every simplified index
+        // buffer keeps indexing the source vertices. Quadrics accumulate over every collapse, so errors
+        // stay measured against the source surface however many times CollapseTo is called.
+        class EdgeCollapser
+        {
+        public:
+            EdgeCollapser(std::span<const std::uint32_t> sourceIndices, std::span<const PositionNormalUV> vertices, unsigned threadCount) :
+                vertices(vertices), positionOf(vertices.size()), nextWedge(vertices.size()), kinds(vertices.size(), VertexKind::Manifold),
+                openNext(vertices.size(), emptySlot), openPrevious(vertices.size(), emptySlot), quadrics(vertices.size(), Quadric{}),
+                remap(vertices.size()), locked(vertices.size()), largestError(0), threadCount(threadCount)
+            {
+                FindWedges(sourceIndices);
+                for (std::size_t corner = 0; corner + 2 < sourceIndices.size(); corner += 3)
+                    if (!Degenerate(&sourceIndices[corner]))
+                        indices.insert(indices.end(), &sourceIndices[corner], &sourceIndices[corner] + 3);
+                std::iota(remap.begin(), remap.end(), 0);
+                ClassifyVertices();
+                AccumulateQuadrics();
+            }
+
+            // Collapses the cheapest edges first until at most targetTriangleCount triangles are left or
+            // no edge can be collapsed without breaking a seam, a border or flipping a triangle.
+            void CollapseTo(std::size_t targetTriangleCount)
+            {
+                while (indices.size() / 3 > targetTriangleCount && CollapsePass(targetTriangleCount))
+                    ;
+            }
+
+            std::span<const std::uint32_t> Indices() const { return indices; }
+            // Largest distance of a collapsed vertex from the planes of the source triangles it stands for.
+            float Error() const { return static_cast<float>(std::sqrt(largestError)); }
+
+        private:
+            static constexpr float boundaryWeight = 10;
+            static constexpr std::size_t trianglesPerTask = 4096;
+
+            std::span<const PositionNormalUV> vertices;
+            std::vector<std::uint32_t> indices;
+            // First vertex at the same position, which holds the quadric of all of them.
+            std::vector<std::uint32_t> positionOf;
+            // Circular list of the wedges at the same position.
+            std::vector<std::uint32_t> nextWedge;
+            std::vector<VertexKind> kinds;
+            // Vertex across the open edge leaving or entering a border or seam vertex.
+            std::vector<std::uint32_t> openNext;
+            std::vector<std::uint32_t> openPrevious;
+            std::vector<Quadric> quadrics;
+            std::vector<std::uint32_t> remap;
+            std::vector<bool> locked;
+            double largestError;
+            unsigned threadCount;
+
+            bool Degenerate(const std::uint32_t* triangle) const
+            {
+                return positionOf[triangle[0]] == positionOf[triangle[1]] || positionOf[triangle[1]] == positionOf[triangle[2]] ||
+                    positionOf[triangle[0]] == positionOf[triangle[2]];
+            }
+
+            // Unreferenced vertices are left out, so that they are never taken for a wedge.
+            void FindWedges(std::span<const std::uint32_t> sourceIndices)
+            {
+                std::vector<bool> referenced(vertices.size(), false);
+                for (std::uint32_t index : sourceIndices)
+                    referenced[index] = true;
+                std::vector<std::uint32_t> table(TableSize(vertices.size()), emptySlot);
+                const std::size_t mask = table.size() - 1;
+                for (std::uint32_t vertex = 0; vertex < vertices.size(); ++vertex)
+                {
+                    positionOf[vertex] = nextWedge[vertex] = vertex;
+                    if (!referenced[vertex])
+                        continue;
+                    std::uint32_t words[3];
+                    std::memcpy(words, &vertices[vertex].position, sizeof(words));
+                    std::size_t slot = HashWords(words, 3) & mask;
+                    while (table[slot] != emptySlot && std::memcmp(&vertices[table[slot]].position, words, sizeof(words)) != 0)
+                        slot = (slot + 1) & mask;
+                    if (table[slot] == emptySlot)
+                        table[slot] = vertex;
+                    const std::uint32_t first = table[slot];
+                    positionOf[vertex] = first;
+                    nextWedge[vertex] = first == vertex ? vertex : nextWedge[first];
+                    if (first != vertex)
+                        nextWedge[first] = vertex;
+                }
+            }
+
+            static std::uint32_t EdgeCount(const VertexTriangles& adjacency, std::span<const std::uint32_t> indices, std::uint32_t from, std::uint32_t to)
+            {
+                std::uint32_t count = 0;
+                for (std::uint32_t triangle : adjacency.Of(from))
+                    for (std::size_t corner = 0; corner < 3; ++corner)
+                        count += indices[3 * triangle + corner] == from && indices[3 * triangle + (corner + 1) % 3] == to;
+                return count;
+            }
+
+            void ClassifyVertices()
+            {
+                const VertexTriangles adjacency(indices, vertices.size());
+                std::vector<std::uint8_t> openEdgeCounts(vertices.size(), 0), seamEdgeCounts(vertices.size(), 0);
+                std::vector<bool> complex(vertices.size(), false);
+                for (std::size_t corner = 0; corner < indices.size(); ++corner)
+                {
+                    const std::uint32_t from = indices[corner], to = indices[corner - corner % 3 + (corner % 3 + 1) % 3];
+                    if (EdgeCount(adjacency, indices, from, to) > 1)
+                        complex[from] = complex[to] = true;
+                    if (EdgeCount(adjacency, indices, to, from) > 0)
+                        continue;
+                    // Open between these two vertices; a seam when the reverse edge joins two other wedges at the same positions.
+                    bool seam = false;
+                    for (std::uint32_t toWedge = nextWedge[to]; toWedge != to && !seam; toWedge = nextWedge[toWedge])
+                        for (std::uint32_t fromWedge = nextWedge[from]; fromWedge != from && !seam; fromWedge = nextWedge[fromWedge])
+                            seam = EdgeCount(adjacency, indices, toWedge, fromWedge) > 0;
+                    if (openNext[from] != emptySlot || openPrevious[to] != emptySlot)
+                        complex[from] = complex[to] = true;
+                    openNext[from] = to;
+                    openPrevious[to] = from;
+                    openEdgeCounts[from] = static_cast<std::uint8_t>(std::min(openEdgeCounts[from] + 1, 255));
+                    openEdgeCounts[to] = static_cast<std::uint8_t>(std::min(openEdgeCounts[to] + 1, 255));
+                    seamEdgeCounts[from] = static_cast<std::uint8_t>(std::min(seamEdgeCounts[from] + seam, 255));
+                    seamEdgeCounts[to] = static_cast<std::uint8_t>(std::min(seamEdgeCounts[to] + seam, 255));
+                }
+                for (std::uint32_t vertex = 0; vertex < vertices.size(); ++vertex)
+                {
+                    if (positionOf[vertex] != vertex)
+                        continue;
+                    std::uint32_t wedgeCount = 0;
+                    bool allManifold = true, allBorder = true, allSeam = true;
+                    std::uint32_t wedge = vertex;
+                    do
+                    {
+                        ++wedgeCount;
+                        const bool linked = openNext[wedge] != emptySlot && openPrevious[wedge] != emptySlot && !complex[wedge];
+                        allManifold &= openEdgeCounts[wedge] == 0 && !complex[wedge];
+                        allBorder &= linked && openEdgeCounts[wedge] == 2 && seamEdgeCounts[wedge] == 0;
+                        allSeam &= linked && openEdgeCounts[wedge] == 2 && seamEdgeCounts[wedge] == 2;
+                        wedge = nextWedge[wedge];
+                    } while (wedge != vertex);
+                    const VertexKind kind = wedgeCount == 1 && allManifold ? VertexKind::Manifold :
+                        wedgeCount == 1 && allBorder ? VertexKind::Border : wedgeCount == 2 && allSeam ? VertexKind::Seam : VertexKind::Locked;
+                    do
+                    {
+                        kinds[wedge] = kind;
+                        wedge = nextWedge[wedge];
+                    } while (wedge != vertex);
+                }
+            }
+
+            void AccumulateQuadrics()
+            {
+                for (std::size_t corner = 0; corner < indices.size(); corner += 3)
+                {
+                    const Float3 positions[3] = { Position(vertices[indices[corner]]), Position(vertices[indices[corner + 1]]),
+                        Position(vertices[indices[corner + 2]]) };
+                    const Float3 normal = (positions[1] - positions[0]).Cross(positions[2] - positions[0]);
+                    const float doubleArea = std::sqrt(normal.Dot(normal));
+                    if (doubleArea == 0)
+                        continue;
+                    const Float3 unitNormal = normal * (1 / doubleArea);
+                    const Quadric plane = Quadric::FromPlane(unitNormal, -unitNormal.Dot(positions[0]), 0.5 * doubleArea);
+                    for (std::size_t edge = 0; edge < 3; ++edge)
+                    {
+                        const std::uint32_t from = indices[corner + edge], to = indices[corner + (edge + 1) % 3];
+                        quadrics[positionOf[from]] = quadrics[positionOf[from]] + plane;
+                        if (openNext[from] != to)
+                            continue;
+                        // Open edges also hold on to the plane through them perpendicular to their triangle,
+                        // which keeps borders and seams from drifting inwards.
+                        const Float3 direction = positions[(edge + 1) % 3] - positions[edge];
+                        const Float3 perpendicular = direction.Cross(unitNormal).Normalised();
+                        const Quadric side = Quadric::FromPlane(perpendicular, -perpendicular.Dot(positions[edge]),
+                            boundaryWeight * direction.Dot(direction));
+                        quadrics[positionOf[from]] = quadrics[positionOf[from]] + side;
+                        quadrics[positionOf[to]] = quadrics[positionOf[to]] + side;
+                    }
+                }
+            }
+
+            bool ShortOpenLoop(std::uint32_t vertex) const
+            {
+                const std::uint32_t second = openNext[vertex], third = openNext[second];
+                return second == vertex || third == vertex || openNext[third] == vertex;
+            }
+
+            // Vertex a wedge moves onto when its position collapses towards the position of to, or
+            // emptySlot when that would tear a seam or a border.
+            std::uint32_t Target(std::uint32_t wedge, std::uint32_t to) const
+            {
+                switch (kinds[wedge])
+                {
+                case VertexKind::Manifold:
+                    return to;
+                case VertexKind::Border:
+                case VertexKind::Seam:
+                    // Open edges leaving and entering through the same position would leave no side to move along.
+                    if (ShortOpenLoop(wedge) || positionOf[openNext[wedge]] == positionOf[openPrevious[wedge]])
+                        return emptySlot;
+                    if (positionOf[openNext[wedge]] == positionOf[to])
+                        return openNext[wedge];
+                    if (positionOf[openPrevious[wedge]] == positionOf[to])
+                        return openPrevious[wedge];
+                    return emptySlot;
+                default:
+                    return emptySlot;
+                }
+            }
+
+            Collapse Evaluate(const VertexTriangles& adjacency, std::uint32_t from, std::uint32_t to) const
+            {
+                constexpr Collapse rejected{ emptySlot, emptySlot, std::numeric_limits<float>::infinity(), 0 };
+                const std::uint32_t fromPosition = positionOf[from], toPosition = positionOf[to];
+                const Float3 destination = Position(vertices[to]);
+                std::uint32_t removedTriangleCount = 0;
+                std::uint32_t wedge = from;
+                do
+                {
+                    if (Target(wedge, to) == emptySlot)
+                        return rejected;
+                    for (std::uint32_t triangle : adjacency.Of(wedge))
+                    {
+                        const std::uint32_t* corners = &indices[3 * triangle];
+                        if (positionOf[corners[0]] == toPosition || positionOf[corners[1]] == toPosition || positionOf[corners[2]] == toPosition)
+                        {
+                            // A third corner left without triangles would keep its place on a border it no longer bounds.
+                            for (std::size_t corner = 0; corner < 3; ++corner)
+                                if (positionOf[corners[corner]] != fromPosition && adjacency.Of(corners[corner]).size() <= 1)
+                                    return rejected;
+                            ++removedTriangleCount;
+                            continue;
+                        }
+                        Float3 before[3], after[3];
+                        for (std::size_t corner = 0; corner < 3; ++corner)
+                        {
+                            before[corner] = Position(vertices[corners[corner]]);
+                            after[corner] = positionOf[corners[corner]] == fromPosition ? destination : before[corner];
+                        }
+                        const Float3 normalBefore = (before[1] - before[0]).Cross(before[2] - before[0]);
+                        const Float3 normalAfter = (after[1] - after[0]).Cross(after[2] - after[0]);
+                        // Rejects folds along with large swings of the triangle normal.
+                        if (normalBefore.Dot(normalAfter) <= 0.25f * std::sqrt(normalBefore.Dot(normalBefore) * normalAfter.Dot(normalAfter)))
+                            return rejected;
+                    }
+                    wedge = nextWedge[wedge];
+                } while (wedge != from);
+                const float error = static_cast<float>((quadrics[fromPosition] + quadrics[toPosition]).Error(destination));
+                return { from, to, error, removedTriangleCount };
+            }
+
+            bool CollapsePass(std::size_t targetTriangleCount)
+            {
+                const std::size_t triangleCount = indices.size() / 3;
+                const VertexTriangles adjacency(indices, vertices.size());
+                // Every edge is evaluated from the triangle where it goes towards the later position, or
+                // from both sides when it is open, in both directions.
+                std::vector<Collapse> candidates(indices.size());
+                ParallelFor((triangleCount + trianglesPerTask - 1) / trianglesPerTask, [&](std::size_t task)
+                {
+                    const std::size_t end = std::min(triangleCount, (task + 1) * trianglesPerTask);
+                    for (std::size_t corner = 3 * task * trianglesPerTask; corner < 3 * end; ++corner)
+                    {
+                        const std::uint32_t first = indices[corner], second = indices[corner - corner % 3 + (corner % 3 + 1) % 3];
+                        candidates[corner] = { emptySlot, emptySlot, std::numeric_limits<float>::infinity(), 0 };
+                        if (positionOf[first] > positionOf[second] && openNext[first] != second)
+                            continue;
+                        const Collapse forwards = Evaluate(adjacency, first, second);
+                        const Collapse backwards = Evaluate(adjacency, second, first);
+                        candidates[corner] = backwards.error < forwards.error ? backwards : forwards;
+                    }
+                }, threadCount);
+
+                // Counting sort on the upper half of the error bits, which order like the errors themselves
+                // for non negative floats.
+                std::vector<std::uint32_t> bucketStarts((1 << 16) + 1, 0);
+                std::size_t candidateCount = 0;
+                for (const Collapse& candidate : candidates)
+                    if (candidate.from != emptySlot)
+                    {
+                        ++bucketStarts[(std::bit_cast<std::uint32_t>(candidate.error) >> 16) + 1];
+                        ++candidateCount;
+                    }
+                if (candidateCount == 0)
+                    return false;
+                std::partial_sum(bucketStarts.begin(), bucketStarts.end(), bucketStarts.begin());
+                std::vector<std::uint32_t> order(candidateCount);
+                for (std::uint32_t candidate = 0; candidate < candidates.size(); ++candidate)
+                    if (candidates[candidate].from != emptySlot)
+                        order[bucketStarts[std::bit_cast<std::uint32_t>(candidates[candidate].error) >> 16]++] = candidate;
+
+                // Each collapse removes about two triangles, so about half as many as there are triangles
+                // to remove are needed; collapses much costlier than the last of those wait for a later pass.
+                const std::size_t excessTriangleCount = triangleCount - targetTriangleCount;
+                const float errorLimit = 1.5f * candidates[order[std::min(candidateCount - 1, excessTriangleCount / 2)]].error;
+                std::fill(locked.begin(), locked.end(), false);
+                std::size_t removedTriangleCount = 0, collapseCount = 0;
+                for (std::uint32_t candidate : order)
+                {
+                    const Collapse& collapse = candidates[candidate];
+                    if (removedTriangleCount >= excessTriangleCount || collapse.error > errorLimit)
+                        break;
+                    const std::uint32_t fromPosition = positionOf[collapse.from];
+                    if (locked[fromPosition] || locked[positionOf[collapse.to]])
+                        continue;
+                    // Every triangle around the collapsed vertex changes, so nothing they touch may collapse
+                    // again in this pass, whose candidates were evaluated on the triangles as they were.
+                    std::uint32_t wedge = collapse.from;
+                    do
+                    {
+                        for (std::uint32_t triangle : adjacency.Of(wedge))
+                            for (std::size_t corner = 0; corner < 3; ++corner)
+                                locked[positionOf[indices[3 * triangle + corner]]] = true;
+                        wedge = nextWedge[wedge];
+                    } while (wedge != collapse.from);
+                    do
+                    {
+                        const std::uint32_t target = Target(wedge, collapse.to);
+                        if (kinds[wedge] != VertexKind::Manifold)
+                        {
+                            if (target == openNext[wedge])
+                            {
+                                openNext[openPrevious[wedge]] = target;
+                                openPrevious[target] = openPrevious[wedge];
+                            }
+                            else
+                            {
+                                openPrevious[openNext[wedge]] = target;
+                                openNext[target] = openNext[wedge];
+                            }
+                        }
+                        remap[wedge] = target;
+                        wedge = nextWedge[wedge];
+                    } while (wedge != collapse.from);
+                    quadrics[positionOf[collapse.to]] = quadrics[positionOf[collapse.to]] + quadrics[fromPosition];
+                    largestError = std::max(largestError, static_cast<double>(collapse.error));
+                    removedTriangleCount += collapse.removedTriangleCount;
+                    ++collapseCount;
+                }
+
+                std::size_t keptCount = 0;
+                for (std::size_t corner = 0; corner < indices.size(); corner += 3)
+                {
+                    const std::uint32_t triangle[3] = { remap[indices[corner]], remap[indices[corner + 1]], remap[indices[corner + 2]] };
+                    if (!Degenerate(triangle))
+                    {
+                        std::copy(triangle, triangle + 3, &indices[keptCount]);
+                        keptCount += 3;
+                    }
+                }
+                indices.resize(keptCount);
+                return collapseCount > 0;
+            }
+        };
+    }
+
+    std::size_t Simplify(std::span<std::uint32_t> indices, std::span<const PositionNormalUV> vertices, std::size_t targetTriangleCount,
+        float& error, unsigned threadCount)
+    {
+        EdgeCollapser collapser(indices, vertices, threadCount);
+        collapser.CollapseTo(targetTriangleCount);
+        const std::span<const std::uint32_t> simplified = collapser.Indices();
+        std::copy(simplified.begin(), simplified.end(), indices.begin());
+        error = collapser.Error();
+        return simplified.size();
+    }
+
+    void BuildLevelsOfDetail(MeshData& mesh, unsigned threadCount)
+    {
+        const std::size_t fullIndexCount = mesh.levelsOfDetail.empty() ? mesh.indices.size() - mesh.indices.size() % 3 :
+            mesh.levelsOfDetail[0].indexCount;
+        mesh.indices.resize(fullIndexCount);
+        mesh.levelsOfDetail = { { 0, static_cast<std::uint32_t>(fullIndexCount), 0 } };
+        EdgeCollapser collapser(mesh.indices, mesh.vertices, threadCount);
+        for (float triangleRatio : levelOfDetailTriangleRatios)
+        {
+            collapser.CollapseTo(static_cast<std::size_t>(triangleRatio * (fullIndexCount / 3)));
+            const std::span<const std::uint32_t> simplified = collapser.Indices();
+            if (simplified.empty() || simplified.size() >= mesh.levelsOfDetail.back().indexCount)
+                break;
+            const std::size_t startIndex = mesh.indices.size();
+            mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+            OptimiseVertexCache(std::span(mesh.indices).subspan(startIndex), mesh.vertices.size());
+            mesh.levelsOfDetail.push_back({ static_cast<std::uint32_t>(startIndex), static_cast<std::uint32_t>(simplified.size()), collapser.Error() });
+        }
+    }
+}
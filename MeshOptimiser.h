@@ -0,0 +1,128 @@
+#pragma once
+
+#include <span>
+#include "MeshData.h"
+#include "Parallel.h"
+
+namespace MeshOptimiser
+{
+    struct WeldReport
+    {
+        std::size_t originalVertexCount;
+        std::size_t weldedVertexCount;
+
+        std::size_t SavedVertexCount() const { return originalVertexCount - weldedVertexCount; }
+        std::size_t SavedBytes() const { return SavedVertexCount() * sizeof(PositionNormalUV); }
+    };
+
+    // Merges duplicate vertices and remaps the indices, keeping the first occurrence of each vertex in
+    // its original order. With an epsilon of 0 only bit identical vertices are merged; otherwise vertices
+    // whose position, normal and uv components all lie within epsilon of an already kept vertex are
+    // merged into it. Both run in expected linear time through hashing.
+    WeldReport Weld(MeshData& mesh, float epsilon = 0);
+
+    // Size of the post-transform vertex cache the triangle order is tuned for and simulated with.
+    constexpr std::uint32_t defaultVertexCacheSize = 16;
+
+    // Vertex shader invocations of an indexed triangle list: the average cache miss ratio is per
+    // triangle (0.5 at best for a large regular mesh, 3 at worst) and the average transform to vertex
+    // ratio is per referenced vertex (1 at best).
+    struct VertexCacheStatistics
+    {
+        double averageCacheMissRatio;
+        double averageTransformToVertexRatio;
+    };
+
+    struct VertexCacheReport
+    {
+        VertexCacheStatistics before;
+        VertexCacheStatistics after;
+    };
+
+    // Replays indices through a FIFO post-transform cache of cacheSize entries, counting every index
+    // not found in it as a vertex shader invocation.
+    VertexCacheStatistics SimulateVertexCache(std::span<const std::uint32_t> indices, std::size_t vertexCount,
+        std::uint32_t cacheSize = defaultVertexCacheSize);
+    // Reorders the triangles of indices for a post-transform cache of cacheSize entries, following
+    // Tipsify (Sander, Nehab and Barczak, 2007): triangles are fanned around a vertex at a time and the
+    // next fanning vertex is the one still expected to be cached. Runs in linear time.
+    void OptimiseVertexCache(std::span<std::uint32_t> indices, std::size_t vertexCount, std::uint32_t cacheSize = defaultVertexCacheSize);
+    // Reorders the vertices in the order the indices first reference them, so that fetches walk the
+    // vertex buffer forwards. Unreferenced vertices are moved to the end and levels of detail are
+    // walked from the coarsest on.
+    void OptimiseVertexFetch(MeshData& mesh);
+    // Both of the above, reporting the simulated cache efficiency before and after. The triangle order
+    // is only changed when that lowers the simulated cache miss ratio.
+    VertexCacheReport OptimiseVertexCacheAndFetch(MeshData& mesh, std::uint32_t cacheSize = defaultVertexCacheSize);
+
+    // Splits the triangles of indices, expected in vertex cache order, into clusters that each keep
+    // close to the cache efficiency of that order (within threshold of it), then sorts the clusters so
+    // that those most likely to occlude the others from any viewpoint come first. This trades a little
+    // vertex cache efficiency for fewer pixels shaded and then overwritten (Sander, Nehab and Barczak, 2007).
+    void OptimiseOverdraw(std::span<std::uint32_t> indices, std::span<const PositionNormalUV> vertices,
+        float threshold = 1.05f, std::uint32_t cacheSize = defaultVertexCacheSize);
+
+    struct OverdrawStatistics
+    {
+        std::size_t coveredPixels;
+        std::size_t shadedFragments;
+
+        // Shaded fragments per covered pixel, 1 when nothing is shaded twice.
+        double Overdraw() const { return coveredPixels == 0 ? 0.0 : static_cast<double>(shadedFragments) / coveredPixels; }
+    };
+
+    // Rasterises the mesh with back face culling and a less than depth test from viewpointCount views
+    // spread evenly around it, each a resolution x resolution orthographic projection of its bounding
+    // sphere, counting every fragment that passes the depth test as shaded. Viewpoints run on threadCount threads.
+    OverdrawStatistics EstimateOverdraw(std::span<const std::uint32_t> indices, std::span<const PositionNormalUV> vertices,
+        std::uint32_t viewpointCount = 16, std::uint32_t resolution = 256, unsigned threadCount = HardwareThreadCount());
+
+    // Vertex count up to which every index of a mesh fits in 16 bits (primitive restart is never enabled).
+    constexpr std::size_t shortIndexVertexCount = 1 << 16;
+
+    struct ShortIndexMesh
+    {
+        // Source vertex of every vertex of the split mesh.
+        std::vector<std::uint32_t> vertexRemap;
+        // Indices into the split mesh vertices, every one within shortIndexVertexCount of the base vertex of its submesh.
+        std::vector<std::uint32_t> indices;
+        std::vector<Submesh> submeshes;
+    };
+
+    // Splits indices into consecutive runs of whole triangles that reference at most
+    // shortIndexVertexCount vertices each. Every run gets its own copy of the vertices it uses, in first
+    // use order from its base vertex on, so vertices shared by neighbouring runs are duplicated and
+    // unreferenced vertices are dropped. Runs in linear time.
+    ShortIndexMesh SplitForShortIndices(std::span<const std::uint32_t> indices, std::size_t vertexCount);
+    // Writes indices rebased onto the base vertex of their submesh.
+    void WriteShortIndices(std::span<const std::uint32_t> indices, std::span<const Submesh> submeshes, std::span<std::uint16_t> destination);
+
+    constexpr std::uint32_t meshletVertexCount = 64;
+    constexpr std::uint32_t meshletTriangleCount = 124;
+
+    // Reorders the triangles of the mesh, or of its first level of detail, into meshlets of at most
+    // meshletVertexCount vertices and meshletTriangleCount triangles and stores them in mesh.meshlets,
+    // with their bounding spheres and normal cones. Every meshlet grows greedily over adjacent
+    // triangles, preferring the one that adds the fewest vertices, then the one with the fewest
+    // triangles left around it, then the one closest to the meshlet in position and normal; the next
+    // meshlet starts next to the one just closed.
+    void BuildMeshlets(MeshData& mesh);
+
+    // Fractions of the triangle count of a mesh its coarser levels of detail aim for.
+    constexpr float levelOfDetailTriangleRatios[] = { 0.5f, 0.25f, 0.125f, 0.0625f };
+
+    // Collapses the edges of indices in order of quadric error (Garland and Heckbert, 1997) until at most
+    // targetTriangleCount triangles are left, moving every collapsed vertex onto one of its neighbours
+    // so that the result still indexes vertices. Vertices sharing a position with different normals or
+    // uvs only move along the seam between them, taking all of them along, and border vertices only
+    // move along their border. Writes the remaining triangles to the front of indices, returns their
+    // index count and sets error to the largest distance a collapsed vertex moved off the source surface.
+    // Candidate collapses are evaluated on threadCount threads.
+    std::size_t Simplify(std::span<std::uint32_t> indices, std::span<const PositionNormalUV> vertices, std::size_t targetTriangleCount,
+        float& error, unsigned threadCount = HardwareThreadCount());
+    // Appends the index buffers of ever coarser levels of detail of the mesh, each simplified from the
+    // previous one towards the next of levelOfDetailTriangleRatios and optimised for the vertex cache,
+    // and stores their ranges in mesh.levelsOfDetail after the full mesh. Stops early once a level
+    // cannot be simplified any further.
+    void BuildLevelsOfDetail(MeshData& mesh, unsigned threadCount = HardwareThreadCount());
+}
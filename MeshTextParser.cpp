@@ -0,0 +1,446 @@
+#include "MeshTextParser.h"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include <emmintrin.h>
+
+namespace MeshTextParser
+{
+    namespace
+    {
+        struct Cursor
+        {
+            const char* current;
+            const char* end;
+            std::size_t line;
+        };
+
+        bool IsWhitespace(char character)
+        {
+            return character == ' ' || character == '\t' || character == '\r' || character == '\n';
+        }
+
+        // Skips 16 bytes at a time with SSE2, counting the new lines it steps over.
+        void SkipWhitespace(Cursor& cursor)
+        {
+            if (cursor.current == cursor.end || !IsWhitespace(*cursor.current))
+                return;
+            const __m128i space = _mm_set1_epi8(' ');
+            const __m128i tab = _mm_set1_epi8('\t');
+            const __m128i carriageReturn = _mm_set1_epi8('\r');
+            const __m128i newLine = _mm_set1_epi8('\n');
+            while (cursor.end - cursor.current >= 16)
+            {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor.current));
+                const __m128i newLines = _mm_cmpeq_epi8(block, newLine);
+                const __m128i whitespace = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab)),
+                    _mm_or_si128(_mm_cmpeq_epi8(block, carriageReturn), newLines));
+                const unsigned whitespaceMask = static_cast<unsigned>(_mm_movemask_epi8(whitespace));
+                const unsigned newLineMask = static_cast<unsigned>(_mm_movemask_epi8(newLines));
+                if (whitespaceMask != 0xFFFF)
+                {
+                    const int skipped = std::countr_zero(~whitespaceMask);
+                    cursor.line += std::popcount(newLineMask & ((1u << skipped) - 1));
+                    cursor.current += skipped;
+                    return;
+                }
+                cursor.line += std::popcount(newLineMask);
+                cursor.current += 16;
+            }
+            for (; cursor.current != cursor.end && IsWhitespace(*cursor.current); ++cursor.current)
+                cursor.line += *cursor.current == '\n';
+        }
+
+        void ExpectSeparator(const Cursor& cursor, const char* what)
+        {
+            if (cursor.current != cursor.end && !IsWhitespace(*cursor.current))
+                throw ParseError(cursor.line, std::string("unexpected character after ") + what);
+        }
+
+        float ParseFloat(Cursor& cursor, const char* what)
+        {
+            SkipWhitespace(cursor);
+            float value;
+            const std::from_chars_result result = std::from_chars(cursor.current, cursor.end, value);
+            if (result.ec != std::errc())
+                throw ParseError(cursor.line, std::string("expected ") + what);
+            cursor.current = result.ptr;
+            ExpectSeparator(cursor, what);
+            return value;
+        }
+
+        std::uint32_t ParseUnsigned(Cursor& cursor, const char* what)
+        {
+            SkipWhitespace(cursor);
+            std::uint32_t value;
+            const std::from_chars_result result = std::from_chars(cursor.current, cursor.end, value);
+            if (result.ec != std::errc())
+                throw ParseError(cursor.line, std::string("expected ") + what);
+            cursor.current = result.ptr;
+            ExpectSeparator(cursor, what);
+            return value;
+        }
+
+        // Skips to the next value of a record, which must be on the line the record starts on.
+        void SkipToRecordValue(Cursor& cursor, std::size_t recordLine, const char* what)
+        {
+            SkipWhitespace(cursor);
+            if (cursor.line != recordLine || cursor.current == cursor.end)
+                throw ParseError(recordLine, std::string("line ends before ") + what);
+        }
+
+        // Checks that nothing but whitespace follows the last value of a record on its line.
+        void ExpectEndOfRecord(Cursor& cursor, std::size_t recordLine, const char* record)
+        {
+            while (cursor.current != cursor.end && IsWhitespace(*cursor.current) && *cursor.current != '\n')
+                ++cursor.current;
+            if (cursor.current != cursor.end && *cursor.current != '\n')
+                throw ParseError(recordLine, std::string("too many values on ") + record + " line");
+        }
+
+        void ExpectKeyword(Cursor& cursor, std::string_view keyword)
+        {
+            SkipWhitespace(cursor);
+            if (static_cast<std::size_t>(cursor.end - cursor.current) < keyword.size() ||
+                std::memcmp(cursor.current, keyword.data(), keyword.size()) != 0)
+                throw ParseError(cursor.line, "expected " + std::string(keyword));
+            cursor.current += keyword.size();
+        }
+
+        void ExpectEnd(Cursor& cursor, const char* message)
+        {
+            SkipWhitespace(cursor);
+            if (cursor.current != cursor.end)
+                throw ParseError(cursor.line, message);
+        }
+
+        std::size_t CountNewLines(const char* begin, const char* end)
+        {
+            std::size_t newLines = 0;
+            const __m128i newLine = _mm_set1_epi8('\n');
+            for (; end - begin >= 16; begin += 16)
+            {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+                newLines += std::popcount(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newLine))));
+            }
+            for (; begin != end; ++begin)
+                newLines += *begin == '\n';
+            return newLines;
+        }
+
+        std::size_t CountNewLines(const char* begin, const char* end, unsigned threadCount)
+        {
+            const std::size_t size = end - begin;
+            if (size < parallelThreshold || threadCount <= 1)
+                return CountNewLines(begin, end);
+            const std::size_t rangeCount = 4 * static_cast<std::size_t>(threadCount);
+            std::atomic<std::size_t> newLines = 0;
+            ParallelFor(rangeCount, [&](std::size_t range)
+            {
+                newLines += CountNewLines(begin + size * range / rangeCount, begin + size * (range + 1) / rangeCount);
+            }, threadCount);
+            return newLines;
+        }
+
+        // Counts the whitespace separated values and the new lines in [begin, end), which must start a line.
+        void CountValuesAndNewLines(const char* begin, const char* end, std::size_t& values, std::size_t& newLines)
+        {
+            values = 0;
+            newLines = 0;
+            const __m128i space = _mm_set1_epi8(' ');
+            const __m128i tab = _mm_set1_epi8('\t');
+            const __m128i carriageReturn = _mm_set1_epi8('\r');
+            const __m128i newLine = _mm_set1_epi8('\n');
+            unsigned previousIsValue = 0;
+            for (; end - begin >= 16; begin += 16)
+            {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+                const __m128i newLines16 = _mm_cmpeq_epi8(block, newLine);
+                const __m128i whitespace = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab)),
+                    _mm_or_si128(_mm_cmpeq_epi8(block, carriageReturn), newLines16));
+                const unsigned valueMask = ~static_cast<unsigned>(_mm_movemask_epi8(whitespace)) & 0xFFFF;
+                const unsigned valueStarts = valueMask & ~((valueMask << 1) | previousIsValue);
+                values += std::popcount(valueStarts);
+                newLines += std::popcount(static_cast<unsigned>(_mm_movemask_epi8(newLines16)));
+                previousIsValue = valueMask >> 15;
+            }
+            for (; begin != end; ++begin)
+            {
+                const unsigned isValue = !IsWhitespace(*begin);
+                values += isValue & ~previousIsValue;
+                newLines += *begin == '\n';
+                previousIsValue = isValue;
+            }
+        }
+
+        struct Chunk
+        {
+            std::size_t begin;
+            std::size_t end;
+            std::size_t values;
+            std::size_t newLines;
+        };
+
+        // Parses text in chunks that end right after a new line on threadCount threads. Each chunk is
+        // counted first so that it can be written straight into its own slot of destination, and parsed
+        // record by record, so that a chunk whose values add up despite malformed lines still fails.
+        // Returns false when a chunk does not hold whole lines of valuesPerLine values or fails to parse,
+        // in which case the serial parser is left to find and report the first malformed line, which the
+        // chunks running in parallel may not have been the first to.
+        template<std::size_t valuesPerElement, std::size_t valuesPerLine, typename Element, typename ParseChunk>
+        bool ParseChunked(std::string_view text, std::size_t firstLine, std::span<Element> destination, unsigned threadCount, ParseChunk parseChunk)
+        {
+            const std::size_t chunkCount = 8 * static_cast<std::size_t>(threadCount);
+            std::vector<Chunk> chunks;
+            chunks.reserve(chunkCount);
+            for (std::size_t chunk = 1, begin = 0; chunk <= chunkCount && begin < text.size(); ++chunk)
+            {
+                std::size_t end = text.find('\n', std::max(begin, text.size() * chunk / chunkCount));
+                end = chunk == chunkCount || end == std::string_view::npos ? text.size() : end + 1;
+                chunks.push_back({ begin, end, 0, 0 });
+                begin = end;
+            }
+            ParallelFor(chunks.size(), [&](std::size_t chunk)
+            {
+                CountValuesAndNewLines(text.data() + chunks[chunk].begin, text.data() + chunks[chunk].end, chunks[chunk].values, chunks[chunk].newLines);
+            }, threadCount);
+            std::size_t totalValues = 0;
+            for (const Chunk& chunk : chunks)
+            {
+                if (chunk.values % valuesPerLine != 0)
+                    return false;
+                totalValues += chunk.values;
+            }
+            if (totalValues != destination.size() * valuesPerElement)
+                return false;
+            std::vector<std::size_t> firstElements(chunks.size()), firstLines(chunks.size());
+            for (std::size_t chunk = 0, element = 0, line = firstLine; chunk < chunks.size(); ++chunk)
+            {
+                firstElements[chunk] = element;
+                firstLines[chunk] = line;
+                element += chunks[chunk].values / valuesPerElement;
+                line += chunks[chunk].newLines;
+            }
+            try
+            {
+                ParallelFor(chunks.size(), [&](std::size_t chunk)
+                {
+                    parseChunk(text.substr(chunks[chunk].begin, chunks[chunk].end - chunks[chunk].begin), firstLines[chunk],
+                        destination.subspan(firstElements[chunk], chunks[chunk].values / valuesPerElement));
+                }, threadCount);
+            }
+            catch (const ParseError&)
+            {
+                return false;
+            }
+            return true;
+        }
+
+        // Moves the cursor past the closing brace of the section whose header keyword was just read.
+        Section ParseSection(Cursor& cursor, std::string_view text, const char* name, unsigned threadCount)
+        {
+            const char* openingBrace = static_cast<const char*>(std::memchr(cursor.current, '{', cursor.end - cursor.current));
+            if (openingBrace == nullptr)
+                throw ParseError(cursor.line, std::string("expected { opening ") + name);
+            cursor.line += CountNewLines(cursor.current, openingBrace);
+            const char* closingBrace = static_cast<const char*>(std::memchr(openingBrace + 1, '}', cursor.end - openingBrace - 1));
+            if (closingBrace == nullptr)
+                throw ParseError(cursor.line, std::string("unterminated ") + name);
+            Section section{ static_cast<std::size_t>(openingBrace + 1 - text.data()), static_cast<std::size_t>(closingBrace - text.data()), cursor.line };
+            cursor.line += CountNewLines(openingBrace, closingBrace, threadCount);
+            cursor.current = closingBrace + 1;
+            return section;
+        }
+
+        // Every record of a section takes at least recordBytes of it, counting the new line ending it, bar the
+        // last one's, so that a count the section cannot hold is rejected before anything is sized from it.
+        void ExpectCountFits(std::uint32_t count, const Section& section, std::size_t recordBytes, std::size_t countLine,
+            const char* what)
+        {
+            if (static_cast<std::uint64_t>(count) * recordBytes > section.end - section.begin + 1)
+                throw ParseError(countLine, std::string(what) + " " + std::to_string(count) + " larger than its list holds");
+        }
+
+        template<typename Index>
+        void ParseTrianglesAs(std::string_view text, std::size_t firstLine, std::uint32_t vertexCount, std::span<Index> indices)
+        {
+            assert(sizeof(Index) == sizeof(std::uint32_t) || vertexCount <= (1u << 16));
+            Cursor cursor{ text.data(), text.data() + text.size(), firstLine };
+            for (std::size_t triangle = 0; triangle < indices.size(); triangle += 3)
+            {
+                SkipWhitespace(cursor);
+                const std::size_t recordLine = cursor.line;
+                for (std::size_t corner = 0; corner < 3; ++corner)
+                {
+                    if (corner > 0)
+                        SkipToRecordValue(cursor, recordLine, "vertex index");
+                    const std::uint32_t index = ParseUnsigned(cursor, "vertex index");
+                    if (index >= vertexCount)
+                        throw ParseError(recordLine, "vertex index " + std::to_string(index) + " out of range");
+                    indices[triangle + corner] = static_cast<Index>(index);
+                }
+                ExpectEndOfRecord(cursor, recordLine, "a triangle");
+            }
+            ExpectEnd(cursor, "more triangles than TriangleCount");
+        }
+
+        template<typename Index>
+        void ParseAs(std::string_view text, const Header& header, std::span<PositionNormalUV> vertices, std::span<Index> indices,
+            unsigned threadCount)
+        {
+            const std::string_view vertexList = text.substr(header.vertexList.begin, header.vertexList.end - header.vertexList.begin);
+            const std::string_view triangleList = text.substr(header.triangleList.begin, header.triangleList.end - header.triangleList.begin);
+            const bool parallel = text.size() >= parallelThreshold && threadCount > 1;
+            if (!parallel || !ParseChunked<6, 6>(vertexList, header.vertexList.line, vertices, threadCount,
+                [](std::string_view chunk, std::size_t firstLine, std::span<PositionNormalUV> chunkVertices)
+                {
+                    ParseVertices(chunk, firstLine, chunkVertices);
+                }))
+                ParseVertices(vertexList, header.vertexList.line, vertices);
+            const std::uint32_t vertexCount = header.vertexCount;
+            if (!parallel || !ParseChunked<1, 3>(triangleList, header.triangleList.line, indices, threadCount,
+                [vertexCount](std::string_view chunk, std::size_t firstLine, std::span<Index> chunkIndices)
+                {
+                    ParseTrianglesAs(chunk, firstLine, vertexCount, chunkIndices);
+                }))
+                ParseTrianglesAs(triangleList, header.triangleList.line, vertexCount, indices);
+        }
+    }
+
+    ParseError::ParseError(std::size_t line, const std::string& message) :
+        std::runtime_error("line " + std::to_string(line) + ": " + message), line(line)
+    {
+    }
+
+    Header ParseHeader(std::string_view text, unsigned threadCount)
+    {
+        Header header{};
+        Cursor cursor{ text.data(), text.data() + text.size(), 1 };
+        ExpectKeyword(cursor, "VertexCount:");
+        header.vertexCount = ParseUnsigned(cursor, "vertex count");
+        const std::size_t vertexCountLine = cursor.line;
+        ExpectKeyword(cursor, "TriangleCount:");
+        header.triangleCount = ParseUnsigned(cursor, "triangle count");
+        const std::size_t triangleCountLine = cursor.line;
+        ExpectKeyword(cursor, "VertexList");
+        header.vertexList = ParseSection(cursor, text, "VertexList", threadCount);
+        ExpectKeyword(cursor, "TriangleList");
+        header.triangleList = ParseSection(cursor, text, "TriangleList", threadCount);
+        ExpectEnd(cursor, "unexpected data after TriangleList");
+        // Six values and their separators, and three.
+        ExpectCountFits(header.vertexCount, header.vertexList, 12, vertexCountLine, "VertexCount");
+        ExpectCountFits(header.triangleCount, header.triangleList, 6, triangleCountLine, "TriangleCount");
+        return header;
+    }
+
+    void ParseVertices(std::string_view text, std::size_t firstLine, std::span<PositionNormalUV> vertices)
+    {
+        Cursor cursor{ text.data(), text.data() + text.size(), firstLine };
+        for (PositionNormalUV& vertex : vertices)
+        {
+            SkipWhitespace(cursor);
+            const std::size_t recordLine = cursor.line;
+            vertex.position.x = ParseFloat(cursor, "position x");
+            SkipToRecordValue(cursor, recordLine, "position y");
+            vertex.position.y = ParseFloat(cursor, "position y");
+            SkipToRecordValue(cursor, recordLine, "position z");
+            vertex.position.z = ParseFloat(cursor, "position z");
+            SkipToRecordValue(cursor, recordLine, "normal x");
+            vertex.normal.x = ParseFloat(cursor, "normal x");
+            SkipToRecordValue(cursor, recordLine, "normal y");
+            vertex.normal.y = ParseFloat(cursor, "normal y");
+            SkipToRecordValue(cursor, recordLine, "normal z");
+            vertex.normal.z = ParseFloat(cursor, "normal z");
+            ExpectEndOfRecord(cursor, recordLine, "a vertex");
+            vertex.uv = { 0.0f, 0.0f };
+        }
+        ExpectEnd(cursor, "more vertices than VertexCount");
+    }
+
+    void ParseTriangles(std::string_view text, std::size_t firstLine, std::uint32_t vertexCount, std::span<std::uint32_t> indices)
+    {
+        ParseTrianglesAs(text, firstLine, vertexCount, indices);
+    }
+
+    void ParseTriangles(std::string_view text, std::size_t firstLine, std::uint32_t vertexCount, std::span<std::uint16_t> indices)
+    {
+        ParseTrianglesAs(text, firstLine, vertexCount, indices);
+    }
+
+    void Parse(std::string_view text, const Header& header, std::span<PositionNormalUV> vertices, std::span<std::uint32_t> indices,
+        unsigned threadCount)
+    {
+        ParseAs(text, header, vertices, indices, threadCount);
+    }
+
+    void Parse(std::string_view text, const Header& header, std::span<PositionNormalUV> vertices, std::span<std::uint16_t> indices,
+        unsigned threadCount)
+    {
+        ParseAs(text, header, vertices, indices, threadCount);
+    }
+
+    void Parse(std::string_view text, MeshData& mesh, unsigned threadCount)
+    {
+        const Header header = ParseHeader(text, threadCount);
+        mesh.vertices.resize(header.vertexCount);
+        mesh.indices.resize(3 * static_cast<std::size_t>(header.triangleCount));
+        Parse(text, header, mesh.vertices, mesh.indices, threadCount);
+    }
+
+    std::string GenerateSyntheticText(std::size_t triangleCount)
+    {
+        const std::size_t columnCount = 1024;
+        const std::size_t rowCount = std::max<std::size_t>(2, (triangleCount + 2 * (columnCount - 1) - 1) / (2 * (columnCount - 1)) + 1);
+        const std::size_t vertexCount = columnCount * rowCount;
+        const std::size_t gridTriangleCount = 2 * (columnCount - 1) * (rowCount - 1);
+        std::string text;
+        text.reserve(vertexCount * 48 + gridTriangleCount * 24 + 128);
+        char line[128];
+        auto appendValues = [&](auto... values)
+        {
+            char* end = line;
+            ((end = std::to_chars(end, line + sizeof(line) - 1, values).ptr, *end++ = ' '), ...);
+            end[-1] = '\n';
+            text.append(line, end);
+        };
+        text += "VertexCount: " + std::to_string(vertexCount) + "\n";
+        text += "TriangleCount: " + std::to_string(gridTriangleCount) + "\n";
+        text += "VertexList (pos, normal)\n{\n";
+        for (std::size_t row = 0; row < rowCount; ++row)
+            for (std::size_t column = 0; column < columnCount; ++column)
+                appendValues(0.01f * column, 0.0f, 0.01f * row, 0.0f, 1.0f, 0.0f);
+        text += "}\nTriangleList\n{\n";
+        for (std::size_t row = 0; row + 1 < rowCount; ++row)
+            for (std::size_t column = 0; column + 1 < columnCount; ++column)
+            {
+                const std::size_t corner = row * columnCount + column;
+                appendValues(corner, corner + 1, corner + columnCount);
+                appendValues(corner + columnCount, corner + 1, corner + columnCount + 1);
+            }
+        text += "}\n";
+        return text;
+    }
+
+    std::vector<ScalingBenchmarkResult> BenchmarkScaling(std::size_t triangleCount)
+    {
+        using Clock = std::chrono::steady_clock;
+        const std::string text = GenerateSyntheticText(triangleCount);
+        std::vector<ScalingBenchmarkResult> results;
+        MeshData mesh;
+        for (unsigned threadCount = 1;; threadCount = std::min(2 * threadCount, HardwareThreadCount()))
+        {
+            const Clock::time_point start = Clock::now();
+            Parse(text, mesh, threadCount);
+            results.push_back({ threadCount, std::chrono::duration<double, std::milli>(Clock::now() - start).count() });
+            if (threadCount == HardwareThreadCount())
+                break;
+        }
+        return results;
+    }
+}
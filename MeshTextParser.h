@@ -0,0 +1,82 @@
+#pragma once
+
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "MeshData.h"
+#include "Parallel.h"
+
+// Parser for the text meshes in Models/, laid out as
+//     VertexCount: N
+//     TriangleCount: M
+//     VertexList (pos, normal)
+//     {
+//         px py pz nx ny nz      (N lines)
+//     }
+//     TriangleList
+//     {
+//         i0 i1 i2               (M lines)
+//     }
+// Every vertex and triangle is a line of its own, errors being reported on the line of the record.
+// It works on the whole file in memory, does not depend on the locale and does not allocate per value.
+// Texts of at least parallelThreshold bytes have their lists split at line boundaries and parsed
+// on threadCount threads, every chunk straight into its slot of the destination.
+namespace MeshTextParser
+{
+    constexpr std::size_t parallelThreshold = 1 << 20;
+
+    class ParseError : public std::runtime_error
+    {
+    public:
+        ParseError(std::size_t line, const std::string& message);
+        std::size_t Line() const { return line; }
+    private:
+        std::size_t line;
+    };
+
+    // Byte range of a list section, between (not including) its braces, and the line it starts on.
+    struct Section
+    {
+        std::size_t begin;
+        std::size_t end;
+        std::size_t line;
+    };
+
+    struct Header
+    {
+        std::uint32_t vertexCount;
+        std::uint32_t triangleCount;
+        Section vertexList;
+        Section triangleList;
+    };
+
+    // Checks the layout of text and that its lists can hold the counts it declares, which destinations can
+    // then safely be sized from.
+    Header ParseHeader(std::string_view text, unsigned threadCount = HardwareThreadCount());
+    // Parses exactly vertices.size() vertex lines out of text, which starts on line firstLine.
+    void ParseVertices(std::string_view text, std::size_t firstLine, std::span<PositionNormalUV> vertices);
+    // Parses exactly indices.size() / 3 triangle lines out of text, which starts on line firstLine. 16 bit
+    // indices need every vertex index to fit them, which a vertexCount of at most 65536 ensures.
+    void ParseTriangles(std::string_view text, std::size_t firstLine, std::uint32_t vertexCount, std::span<std::uint32_t> indices);
+    void ParseTriangles(std::string_view text, std::size_t firstLine, std::uint32_t vertexCount, std::span<std::uint16_t> indices);
+    // Parses both lists of text into destinations sized from its header.
+    void Parse(std::string_view text, const Header& header, std::span<PositionNormalUV> vertices, std::span<std::uint32_t> indices,
+        unsigned threadCount = HardwareThreadCount());
+    void Parse(std::string_view text, const Header& header, std::span<PositionNormalUV> vertices, std::span<std::uint16_t> indices,
+        unsigned threadCount = HardwareThreadCount());
+    void Parse(std::string_view text, MeshData& mesh, unsigned threadCount = HardwareThreadCount());
+
+    // Mesh text in the Models/ layout describing a flat grid with at least triangleCount triangles.
+    std::string GenerateSyntheticText(std::size_t triangleCount);
+
+    struct ScalingBenchmarkResult
+    {
+        unsigned threadCount;
+        double milliseconds;
+    };
+
+    // Parse time of a synthetic triangleCount triangle mesh with 1, 2, 4... up to all hardware threads.
+    std::vector<ScalingBenchmarkResult> BenchmarkScaling(std::size_t triangleCount);
+}
@@ -0,0 +1,349 @@
+#include "OcclusionCulling.h"
+#include "Culling.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numbers>
+#include <random>
+#include <emmintrin.h>
+
+namespace OcclusionCulling
+{
+    namespace
+    {
+        constexpr std::uint32_t tileColumnCount = depthWidth / tileWidth;
+        constexpr std::uint32_t binColumnCount = depthWidth / binWidth;
+        constexpr std::uint32_t binRowCount = depthHeight / binHeight;
+
+        // Triangle in pixel coordinates, y down, with depths in [0, 1].
+        struct ScreenTriangle
+        {
+            float x[3];
+            float y[3];
+            float z[3];
+            float minX, minY, maxX, maxY;
+        };
+
+        XMFLOAT4X4 Multiply(const XMFLOAT4X4& first, const XMFLOAT4X4& second)
+        {
+            XMFLOAT4X4 product;
+            for (int row = 0; row < 4; ++row)
+                for (int column = 0; column < 4; ++column)
+                    product.m[row][column] = first.m[row][0] * second.m[0][column] + first.m[row][1] * second.m[1][column]
+                        + first.m[row][2] * second.m[2][column] + first.m[row][3] * second.m[3][column];
+            return product;
+        }
+
+        // Clip space position of the point, its x, y, z and w in the lanes, under the matrix loaded row by row.
+        __m128 Transform(const XMFLOAT3& point, const __m128 rows[4])
+        {
+            return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(point.x), rows[0]), _mm_mul_ps(_mm_set1_ps(point.y), rows[1])),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(point.z), rows[2]), rows[3]));
+        }
+
+        void LoadRows(const XMFLOAT4X4& matrix, __m128 rows[4])
+        {
+            for (int row = 0; row < 4; ++row)
+                rows[row] = _mm_loadu_ps(matrix.m[row]);
+        }
+
+        void SetupTriangles(const Occluder& occluder, const XMFLOAT4X4& viewProjection, std::vector<ScreenTriangle>& triangles)
+        {
+            __m128 rows[4];
+            LoadRows(Multiply(occluder.model, viewProjection), rows);
+            const std::vector<XMFLOAT3>& positions = occluder.mesh->positions;
+            const std::vector<std::uint32_t>& indices = occluder.mesh->indices;
+            std::vector<XMFLOAT4> clipPositions(positions.size());
+            for (std::size_t vertex = 0; vertex < positions.size(); ++vertex)
+                _mm_storeu_ps(&clipPositions[vertex].x, Transform(positions[vertex], rows));
+            triangles.reserve(indices.size() / 3);
+            for (std::size_t triangle = 0; triangle + 2 < indices.size(); triangle += 3)
+            {
+                ScreenTriangle screen;
+                bool behindNearPlane = false;
+                for (int corner = 0; corner < 3; ++corner)
+                {
+                    const XMFLOAT4& clip = clipPositions[indices[triangle + corner]];
+                    if (clip.z < 0 || clip.w <= 0)
+                    {
+                        behindNearPlane = true;
+                        break;
+                    }
+                    screen.x[corner] = (0.5f + 0.5f * clip.x / clip.w) * depthWidth;
+                    screen.y[corner] = (0.5f - 0.5f * clip.y / clip.w) * depthHeight;
+                    screen.z[corner] = clip.z / clip.w;
+                }
+                if (behindNearPlane)
+                    continue;
+                screen.minX = std::min({ screen.x[0], screen.x[1], screen.x[2] });
+                screen.maxX = std::max({ screen.x[0], screen.x[1], screen.x[2] });
+                screen.minY = std::min({ screen.y[0], screen.y[1], screen.y[2] });
+                screen.maxY = std::max({ screen.y[0], screen.y[1], screen.y[2] });
+                if (screen.maxX > 0 && screen.maxY > 0 && screen.minX < depthWidth && screen.minY < depthHeight)
+                    triangles.push_back(screen);
+            }
+        }
+
+        // Writes the farthest depth of the triangle over every pixel of [left, right) x [top, bottom) it
+        // covers entirely where that is nearer than the depth already there, four pixels at a time.
+        void RasteriseTriangle(const ScreenTriangle& triangle, std::uint32_t left, std::uint32_t top, std::uint32_t right,
+            std::uint32_t bottom, float* depths)
+        {
+            const float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0])
+                - (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+            if (area == 0)
+                return;
+            // Edge functions a x + b y + c, positive inside whatever the winding. A pixel lies entirely inside
+            // an edge when the function is positive at its worst corner, half of |a| + |b| under its centre.
+            const float sign = area > 0 ? 1.0f : -1.0f;
+            float a[3], b[3], c[3];
+            for (int edge = 0; edge < 3; ++edge)
+            {
+                const int next = (edge + 1) % 3;
+                a[edge] = sign * (triangle.y[edge] - triangle.y[next]);
+                b[edge] = sign * (triangle.x[next] - triangle.x[edge]);
+                c[edge] = -a[edge] * triangle.x[edge] - b[edge] * triangle.y[edge] - 0.5f * (std::fabs(a[edge]) + std::fabs(b[edge]));
+            }
+            // Depth plane, raised to its farthest over a pixel and capped by the farthest corner.
+            const float depthX = ((triangle.z[1] - triangle.z[0]) * (triangle.y[2] - triangle.y[0])
+                - (triangle.z[2] - triangle.z[0]) * (triangle.y[1] - triangle.y[0])) / area;
+            const float depthY = ((triangle.z[2] - triangle.z[0]) * (triangle.x[1] - triangle.x[0])
+                - (triangle.z[1] - triangle.z[0]) * (triangle.x[2] - triangle.x[0])) / area;
+            const float depthOffset = triangle.z[0] - depthX * triangle.x[0] - depthY * triangle.y[0] + 0.5f * (std::fabs(depthX) + std::fabs(depthY));
+            const __m128 farthestDepth = _mm_set1_ps(std::max({ triangle.z[0], triangle.z[1], triangle.z[2] }));
+
+            // Pixels outside the bounding box can never be entirely inside, so starting at a multiple of 4 is harmless.
+            const std::uint32_t startX = std::max(left, static_cast<std::uint32_t>(std::max(0.0f, triangle.minX))) & ~3u;
+            const std::uint32_t endX = std::min(right, static_cast<std::uint32_t>(std::min<float>(depthWidth, std::ceil(triangle.maxX))));
+            const std::uint32_t startY = std::max(top, static_cast<std::uint32_t>(std::max(0.0f, triangle.minY)));
+            const std::uint32_t endY = std::min(bottom, static_cast<std::uint32_t>(std::min<float>(depthHeight, std::ceil(triangle.maxY))));
+            const __m128 laneCentres = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            const __m128 edgeA[3] = { _mm_set1_ps(a[0]), _mm_set1_ps(a[1]), _mm_set1_ps(a[2]) };
+            const __m128 slopeX = _mm_set1_ps(depthX);
+            for (std::uint32_t y = startY; y < endY; ++y)
+            {
+                const float centreY = y + 0.5f;
+                const __m128 edgeRows[3] =
+                {
+                    _mm_set1_ps(b[0] * centreY + c[0]), _mm_set1_ps(b[1] * centreY + c[1]), _mm_set1_ps(b[2] * centreY + c[2])
+                };
+                const __m128 depthRow = _mm_set1_ps(depthY * centreY + depthOffset);
+                float* row = depths + y * depthWidth;
+                for (std::uint32_t x = startX; x < endX; x += 4)
+                {
+                    const __m128 centreX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneCentres);
+                    const __m128 inside = _mm_and_ps(
+                        _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], centreX), edgeRows[0]), _mm_setzero_ps()),
+                            _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], centreX), edgeRows[1]), _mm_setzero_ps())),
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], centreX), edgeRows[2]), _mm_setzero_ps()));
+                    if (_mm_movemask_ps(inside) == 0)
+                        continue;
+                    const __m128 depth = _mm_min_ps(_mm_add_ps(_mm_mul_ps(slopeX, centreX), depthRow), farthestDepth);
+                    const __m128 previous = _mm_loadu_ps(row + x);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(previous, depth)), _mm_andnot_ps(inside, previous)));
+                }
+            }
+        }
+    }
+
+    OccluderMesh MakeOccluderMesh(const MeshData& mesh)
+    {
+        OccluderMesh occluder;
+        occluder.positions.reserve(mesh.vertices.size());
+        for (const PositionNormalUV& vertex : mesh.vertices)
+            occluder.positions.push_back(vertex.position);
+        occluder.indices.assign(mesh.indices.begin(), mesh.indices.end());
+        return occluder;
+    }
+
+    OccluderMesh MakeOccluderMesh(const Box& box)
+    {
+        OccluderMesh occluder;
+        for (int corner = 0; corner < 8; ++corner)
+            occluder.positions.push_back(
+            {
+                box.centre.x + (corner & 1 ? box.extents.x : -box.extents.x),
+                box.centre.y + (corner & 2 ? box.extents.y : -box.extents.y),
+                box.centre.z + (corner & 4 ? box.extents.z : -box.extents.z)
+            });
+        // Two triangles for each face, -x, +x, -y, +y, -z and +z.
+        occluder.indices =
+        {
+            0, 4, 6, 0, 6, 2,  1, 3, 7, 1, 7, 5,
+            0, 1, 5, 0, 5, 4,  2, 6, 7, 2, 7, 3,
+            0, 2, 3, 0, 3, 1,  4, 5, 7, 4, 7, 6
+        };
+        return occluder;
+    }
+
+    DepthBuffer::DepthBuffer() :
+        viewProjection{},
+        depths(depthWidth * depthHeight, 1.0f),
+        tileDepths(tileColumnCount * (depthHeight / tileHeight), 1.0f)
+    {
+    }
+
+    void DepthBuffer::Rasterise(std::span<const Occluder> occluders, const XMFLOAT4X4& viewProjection, unsigned threadCount)
+    {
+        this->viewProjection = viewProjection;
+        std::vector<std::vector<ScreenTriangle>> triangles(occluders.size());
+        ParallelFor(occluders.size(), [&](std::size_t occluder)
+        {
+            SetupTriangles(occluders[occluder], viewProjection, triangles[occluder]);
+        }, threadCount);
+        // Every bin is cleared, rasterised and reduced into its tiles by one thread, so no pixel is shared.
+        ParallelFor(binColumnCount * binRowCount, [&](std::size_t bin)
+        {
+            const std::uint32_t left = static_cast<std::uint32_t>(bin % binColumnCount) * binWidth;
+            const std::uint32_t top = static_cast<std::uint32_t>(bin / binColumnCount) * binHeight;
+            const std::uint32_t right = left + binWidth, bottom = top + binHeight;
+            for (std::uint32_t y = top; y < bottom; ++y)
+                std::fill_n(depths.begin() + y * depthWidth + left, binWidth, 1.0f);
+            for (const std::vector<ScreenTriangle>& occluderTriangles : triangles)
+                for (const ScreenTriangle& triangle : occluderTriangles)
+                    if (triangle.maxX > left && triangle.minX < right && triangle.maxY > top && triangle.minY < bottom)
+                        RasteriseTriangle(triangle, left, top, right, bottom, depths.data());
+            for (std::uint32_t tileY = top; tileY < bottom; tileY += tileHeight)
+                for (std::uint32_t tileX = left; tileX < right; tileX += tileWidth)
+                {
+                    __m128 farthest = _mm_setzero_ps();
+                    for (std::uint32_t y = tileY; y < tileY + tileHeight; ++y)
+                        for (std::uint32_t x = tileX; x < tileX + tileWidth; x += 4)
+                            farthest = _mm_max_ps(farthest, _mm_loadu_ps(&depths[y * depthWidth + x]));
+                    float lanes[4];
+                    _mm_storeu_ps(lanes, farthest);
+                    tileDepths[(tileY / tileHeight) * tileColumnCount + tileX / tileWidth] = std::max({ lanes[0], lanes[1], lanes[2], lanes[3] });
+                }
+        }, threadCount);
+    }
+
+    bool DepthBuffer::Occluded(const Box& box) const
+    {
+        __m128 rows[4];
+        LoadRows(viewProjection, rows);
+        float minX = depthWidth, minY = depthHeight, maxX = 0, maxY = 0, nearestDepth = 1;
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            const XMFLOAT3 position
+            {
+                box.centre.x + (corner & 1 ? box.extents.x : -box.extents.x),
+                box.centre.y + (corner & 2 ? box.extents.y : -box.extents.y),
+                box.centre.z + (corner & 4 ? box.extents.z : -box.extents.z)
+            };
+            XMFLOAT4 clip;
+            _mm_storeu_ps(&clip.x, Transform(position, rows));
+            if (clip.z < 0 || clip.w <= 0)
+                return false;
+            const float x = (0.5f + 0.5f * clip.x / clip.w) * depthWidth, y = (0.5f - 0.5f * clip.y / clip.w) * depthHeight;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            nearestDepth = std::min(nearestDepth, clip.z / clip.w);
+        }
+        nearestDepth -= depthMargin;
+        // Every pixel the box touches at all, clamped to the screen.
+        const std::uint32_t left = static_cast<std::uint32_t>(std::max(0.0f, std::floor(minX)));
+        const std::uint32_t right = static_cast<std::uint32_t>(std::min<float>(depthWidth, std::ceil(maxX)));
+        const std::uint32_t top = static_cast<std::uint32_t>(std::max(0.0f, std::floor(minY)));
+        const std::uint32_t bottom = static_cast<std::uint32_t>(std::min<float>(depthHeight, std::ceil(maxY)));
+        if (left >= right || top >= bottom)
+            return false;
+        const __m128 nearest = _mm_set1_ps(nearestDepth);
+        const __m128i leftLanes = _mm_set1_epi32(static_cast<int>(left) - 1), rightLanes = _mm_set1_epi32(static_cast<int>(right));
+        for (std::uint32_t tileY = top / tileHeight * tileHeight; tileY < bottom; tileY += tileHeight)
+            for (std::uint32_t tileX = left / tileWidth * tileWidth; tileX < right; tileX += tileWidth)
+            {
+                // Tiles whose farthest occluder is nearer than the box hide their part of it as a whole.
+                if (tileDepths[(tileY / tileHeight) * tileColumnCount + tileX / tileWidth] < nearestDepth)
+                    continue;
+                for (std::uint32_t y = std::max(tileY, top); y < std::min(tileY + tileHeight, bottom); ++y)
+                    for (std::uint32_t x = tileX; x < tileX + tileWidth; x += 4)
+                    {
+                        const __m128i columns = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(x)), _mm_setr_epi32(0, 1, 2, 3));
+                        const __m128 inRectangle = _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(columns, leftLanes), _mm_cmplt_epi32(columns, rightLanes)));
+                        if (_mm_movemask_ps(_mm_and_ps(inRectangle, _mm_cmpge_ps(_mm_loadu_ps(&depths[y * depthWidth + x]), nearest))) != 0)
+                            return false;
+                    }
+            }
+        return true;
+    }
+
+    std::size_t DepthBuffer::CullBoxes(std::span<const Box> boxes, std::span<std::uint32_t> visible, unsigned threadCount) const
+    {
+        constexpr std::size_t chunkSize = 256;
+        std::vector<std::uint8_t> occluded(visible.size());
+        ParallelFor((visible.size() + chunkSize - 1) / chunkSize, [&](std::size_t chunk)
+        {
+            for (std::size_t index = chunk * chunkSize; index < std::min(visible.size(), (chunk + 1) * chunkSize); ++index)
+                occluded[index] = Occluded(boxes[visible[index]]);
+        }, threadCount);
+        std::size_t visibleCount = 0;
+        for (std::size_t index = 0; index < visible.size(); ++index)
+            if (!occluded[index])
+                visible[visibleCount++] = visible[index];
+        return visibleCount;
+    }
+
+    DenseSceneResult BenchmarkDenseScene(std::size_t modelCount, unsigned threadCount)
+    {
+        using Clock = std::chrono::steady_clock;
+        std::mt19937 random(1);
+        // Rows of walls across the view every 20 units, with 2 unit gaps between them, and small boxes on the
+        // ground everywhere in between.
+        std::uniform_real_distribution<float> wallHeight(3, 12);
+        std::vector<Box> walls;
+        for (float z = 20; z <= 400; z += 20)
+            for (float x = -200; x < 200; x += 12)
+            {
+                const float height = wallHeight(random);
+                walls.push_back({ { x + 5, 0.5f * height, z }, { 5, 0.5f * height, 0.5f } });
+            }
+        std::uniform_real_distribution<float> modelX(-200, 200), modelZ(2, 400), modelSize(0.25f, 1);
+        std::vector<Box> boxes(modelCount);
+        std::vector<Sphere> spheres(modelCount);
+        for (std::size_t model = 0; model < modelCount; ++model)
+        {
+            const float size = modelSize(random);
+            boxes[model] = { { modelX(random), size, modelZ(random) }, { size, size, size } };
+            spheres[model] = { boxes[model].centre, size * std::sqrt(3.0f) };
+        }
+        // Eye height camera at the origin looking down z, as XMMatrixLookToLH and XMMatrixPerspectiveFovLH build it.
+        XMFLOAT4X4 viewProjection{};
+        const float eyeHeight = 1.7f, yScale = 1 / std::tan(0.125f * std::numbers::pi_v<float>), nearPlane = 0.5f, farPlane = 1000;
+        viewProjection.m[0][0] = yScale / (16.0f / 9);
+        viewProjection.m[1][1] = yScale;
+        viewProjection.m[2][2] = farPlane / (farPlane - nearPlane);
+        viewProjection.m[2][3] = 1;
+        viewProjection.m[3][1] = -eyeHeight * yScale;
+        viewProjection.m[3][2] = -nearPlane * farPlane / (farPlane - nearPlane);
+        const Culling::Frustum frustum = Culling::ExtractFrustum(viewProjection);
+
+        std::vector<OccluderMesh> wallMeshes;
+        wallMeshes.reserve(walls.size());
+        std::vector<Occluder> occluders;
+        XMFLOAT4X4 identity{};
+        identity.m[0][0] = identity.m[1][1] = identity.m[2][2] = identity.m[3][3] = 1;
+        for (const Box& wall : walls)
+            if (!Culling::SphereOutside(frustum, wall.centre, std::sqrt(wall.extents.x * wall.extents.x + wall.extents.y * wall.extents.y + wall.extents.z * wall.extents.z)))
+            {
+                wallMeshes.push_back(MakeOccluderMesh(wall));
+                occluders.push_back({ &wallMeshes.back(), identity });
+            }
+        std::vector<std::uint32_t> visible(modelCount);
+        DenseSceneResult result{};
+        result.modelCount = modelCount;
+        result.occluderCount = occluders.size();
+        result.frustumVisibleCount = Culling::CullSpheres(spheres, frustum, visible);
+        DepthBuffer depthBuffer;
+        const Clock::time_point rasteriseStart = Clock::now();
+        depthBuffer.Rasterise(occluders, viewProjection, threadCount);
+        const Clock::time_point testStart = Clock::now();
+        result.occludedCount = result.frustumVisibleCount
+            - depthBuffer.CullBoxes(boxes, std::span(visible).first(result.frustumVisibleCount), threadCount);
+        const Clock::time_point testEnd = Clock::now();
+        result.rasteriseMilliseconds = std::chrono::duration<double, std::milli>(testStart - rasteriseStart).count();
+        result.testMilliseconds = std::chrono::duration<double, std::milli>(testEnd - testStart).count();
+        return result;
+    }
+}
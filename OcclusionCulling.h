@@ -0,0 +1,81 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include "MeshData.h"
+#include "Parallel.h"
+
+// CPU occlusion culling: occluder meshes are rasterised into a small depth buffer, against which the
+// bounding boxes of models are tested before they are drawn. Matrices follow the conventions of Culling.
+namespace OcclusionCulling
+{
+    constexpr std::uint32_t depthWidth = 320;
+    constexpr std::uint32_t depthHeight = 192;
+    // Pixels of the hierarchical level, which keeps the farthest depth of each tile.
+    constexpr std::uint32_t tileWidth = 8;
+    constexpr std::uint32_t tileHeight = 8;
+    // Pixels rasterised by one task, every triangle overlapping it clipped to it.
+    constexpr std::uint32_t binWidth = 64;
+    constexpr std::uint32_t binHeight = 48;
+    static_assert(depthWidth % binWidth == 0 && depthHeight % binHeight == 0);
+    static_assert(binWidth % tileWidth == 0 && binHeight % tileHeight == 0 && tileWidth % 4 == 0);
+    // How much nearer than a box the occluders must be to hide it, absorbing the rounding between a model
+    // rasterised as an occluder and its own bounding box.
+    constexpr float depthMargin = 1e-5f;
+
+    // Positions and triangles of a mesh rasterised as an occluder, usually a low detail stand in for it.
+    struct OccluderMesh
+    {
+        std::vector<XMFLOAT3> positions;
+        std::vector<std::uint32_t> indices;
+    };
+
+    OccluderMesh MakeOccluderMesh(const MeshData& mesh);
+    // The 12 triangles of the surface of a box.
+    OccluderMesh MakeOccluderMesh(const Box& box);
+
+    struct Occluder
+    {
+        const OccluderMesh* mesh;
+        XMFLOAT4X4 model;
+    };
+
+    // Depth, in [0, 1] with 1 the far plane, of the occluders seen through one view projection. Occluders
+    // only cover the pixels they cover entirely, at the farthest depth they reach over each, so a box
+    // found to be occluded is hidden at any resolution.
+    class DepthBuffer
+    {
+    public:
+        DepthBuffer();
+
+        // Replaces the content of the buffer with the triangles of every occluder, rasterised bin by bin on
+        // up to threadCount threads. Triangles crossing the near plane are left out.
+        void Rasterise(std::span<const Occluder> occluders, const XMFLOAT4X4& viewProjection, unsigned threadCount = HardwareThreadCount());
+        // Whether the world space box is entirely behind the occluders, never for boxes crossing the near
+        // plane or outside the screen.
+        bool Occluded(const Box& box) const;
+        // Removes the indices of the occluded boxes from visible, keeping the order of the others, and
+        // returns how many are left.
+        std::size_t CullBoxes(std::span<const Box> boxes, std::span<std::uint32_t> visible, unsigned threadCount = HardwareThreadCount()) const;
+        float Depth(std::uint32_t x, std::uint32_t y) const { return depths[y * depthWidth + x]; }
+
+    private:
+        XMFLOAT4X4 viewProjection;
+        std::vector<float> depths;
+        std::vector<float> tileDepths;
+    };
+
+    struct DenseSceneResult
+    {
+        std::size_t modelCount;
+        std::size_t occluderCount;
+        std::size_t frustumVisibleCount;
+        std::size_t occludedCount;
+        double rasteriseMilliseconds;
+        double testMilliseconds;
+    };
+
+    // Frustum and occlusion culls a generated city of modelCount small boxes among rows of wall
+    // occluders, seen from street level, on up to threadCount threads.
+    DenseSceneResult BenchmarkDenseScene(std::size_t modelCount, unsigned threadCount = HardwareThreadCount());
+}
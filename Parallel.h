@@ -0,0 +1,13 @@
+#pragma once
+
+#include <utility>
+#include "JobSystem.h"
+
+// Calls task(index) for every index in [0, count) on up to threadCount threads of the shared job system, the
+// calling thread included, and returns once all of them are done. The first exception thrown by a task is
+// rethrown on the calling thread.
+template<typename Task>
+void ParallelFor(std::size_t count, Task&& task, unsigned threadCount = HardwareThreadCount())
+{
+    Jobs::JobSystem::Shared().ParallelFor(count, std::forward<Task>(task), threadCount);
+}
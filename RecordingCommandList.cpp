@@ -0,0 +1,288 @@
+#include "RecordingCommandList.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+namespace Rhi
+{
+    void RecordingCommandList::SetPipelineState(PipelineState* pipelineState)
+    {
+        Write(Command::SetPipelineState);
+        WriteObject(pipelineState);
+    }
+
+    void RecordingCommandList::SetGraphicsRootSignature(RootSignature* rootSignature)
+    {
+        Write(Command::SetGraphicsRootSignature);
+        WriteObject(rootSignature);
+    }
+
+    void RecordingCommandList::SetGraphicsRootConstantBufferView(std::uint32_t rootParameterIndex, GpuAddress bufferLocation)
+    {
+        Write(Command::SetGraphicsRootConstantBufferView);
+        Write(rootParameterIndex);
+        WriteAddress(bufferLocation, buffers);
+    }
+
+    void RecordingCommandList::SetGraphicsRootShaderResourceView(std::uint32_t rootParameterIndex, GpuAddress bufferLocation)
+    {
+        Write(Command::SetGraphicsRootShaderResourceView);
+        Write(rootParameterIndex);
+        WriteAddress(bufferLocation, buffers);
+    }
+
+    void RecordingCommandList::SetGraphicsRootDescriptorTable(std::uint32_t rootParameterIndex, DescriptorHandle baseDescriptor)
+    {
+        Write(Command::SetGraphicsRootDescriptorTable);
+        Write(rootParameterIndex);
+        WriteAddress(baseDescriptor.ptr, descriptors);
+    }
+
+    void RecordingCommandList::SetDescriptorHeaps(std::uint32_t descriptorHeapCount, DescriptorHeap* const* descriptorHeaps)
+    {
+        Write(Command::SetDescriptorHeaps);
+        Write(descriptorHeapCount);
+        for (std::uint32_t heapIndex = 0; heapIndex < descriptorHeapCount; ++heapIndex)
+            WriteObject(descriptorHeaps[heapIndex]);
+    }
+
+    void RecordingCommandList::IASetVertexBuffers(std::uint32_t startSlot, std::uint32_t viewCount, const VertexBufferView* views)
+    {
+        Write(Command::IASetVertexBuffers);
+        Write(startSlot);
+        Write(viewCount);
+        for (std::uint32_t viewIndex = 0; viewIndex < viewCount; ++viewIndex)
+        {
+            WriteAddress(views[viewIndex].bufferLocation, buffers);
+            Write(views[viewIndex].sizeInBytes);
+            Write(views[viewIndex].strideInBytes);
+        }
+    }
+
+    void RecordingCommandList::IASetIndexBuffer(const IndexBufferView* view)
+    {
+        Write(Command::IASetIndexBuffer);
+        WriteAddress(view->bufferLocation, buffers);
+        Write(view->sizeInBytes);
+        Write(view->format);
+    }
+
+    void RecordingCommandList::IASetPrimitiveTopology(PrimitiveTopology primitiveTopology)
+    {
+        Write(Command::IASetPrimitiveTopology);
+        Write(primitiveTopology);
+    }
+
+    void RecordingCommandList::OMSetStencilRef(std::uint32_t stencilReference)
+    {
+        Write(Command::OMSetStencilRef);
+        Write(stencilReference);
+    }
+
+    void RecordingCommandList::DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+        std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation)
+    {
+        Write(Command::DrawIndexedInstanced);
+        Write(indexCountPerInstance);
+        Write(instanceCount);
+        Write(startIndexLocation);
+        Write(baseVertexLocation);
+        Write(startInstanceLocation);
+    }
+
+    void RecordingCommandList::AddBuffer(GpuAddress begin, std::uint64_t size)
+    {
+        buffers.Add(begin, size);
+    }
+
+    void RecordingCommandList::AddDescriptors(DescriptorHandle begin, std::uint64_t size)
+    {
+        descriptors.Add(begin.ptr, size);
+    }
+
+    void RecordingCommandList::Clear()
+    {
+        stream.clear();
+        commandCount = 0;
+    }
+
+    void RecordingCommandList::Write(Command command)
+    {
+        stream.push_back(static_cast<std::byte>(command));
+        ++commandCount;
+    }
+
+    // Values are written unaligned, as they are in memory.
+    template<typename T>
+    void RecordingCommandList::Write(const T& value)
+    {
+        const std::byte* bytes = reinterpret_cast<const std::byte*>(&value);
+        stream.insert(stream.end(), bytes, bytes + sizeof(T));
+    }
+
+    void RecordingCommandList::WriteObject(const void* object)
+    {
+        // Few distinct objects are bound while recording, which a linear search finds fastest.
+        auto known = std::find(objects.begin(), objects.end(), object);
+        if (known == objects.end())
+            known = objects.insert(known, object);
+        Write(static_cast<std::uint32_t>(known - objects.begin()));
+    }
+
+    void RecordingCommandList::WriteAddress(std::uint64_t address, AddressNumbering& numbering)
+    {
+        const auto [number, offset] = numbering.Find(address);
+        Write(number);
+        Write(offset);
+    }
+
+    namespace
+    {
+        constexpr std::uint32_t unnumbered = std::numeric_limits<std::uint32_t>::max();
+    }
+
+    void RecordingCommandList::AddressNumbering::Add(std::uint64_t begin, std::uint64_t size)
+    {
+        auto next = std::upper_bound(ranges.begin(), ranges.end(), begin,
+            [](std::uint64_t address, const Range& range) { return address < range.begin; });
+        assert(size > 0 && (next == ranges.end() || begin + size <= next->begin));
+        assert(next == ranges.begin() || std::prev(next)->begin + std::prev(next)->size <= begin);
+        ranges.insert(next, { begin, size, unnumbered });
+    }
+
+    std::pair<std::uint32_t, std::uint64_t> RecordingCommandList::AddressNumbering::Find(std::uint64_t address)
+    {
+        auto next = std::upper_bound(ranges.begin(), ranges.end(), address,
+            [](std::uint64_t address, const Range& range) { return address < range.begin; });
+        auto range = next == ranges.begin() ? ranges.end() : std::prev(next);
+        if (range == ranges.end() || address - range->begin >= range->size)
+            range = ranges.insert(next, { address, 1, unnumbered });
+        if (range->number == unnumbered)
+            range->number = usedCount++;
+        return { range->number, address - range->begin };
+    }
+
+    namespace
+    {
+        class StreamReader
+        {
+        public:
+            explicit StreamReader(std::span<const std::byte> stream) : stream(stream), offset(0) {}
+
+            bool AtEnd() const { return offset == stream.size(); }
+
+            template<typename T>
+            T Read()
+            {
+                if (stream.size() - offset < sizeof(T))
+                    throw std::runtime_error("Truncated command stream");
+                T value;
+                std::memcpy(&value, stream.data() + offset, sizeof(T));
+                offset += sizeof(T);
+                return value;
+            }
+
+        private:
+            std::span<const std::byte> stream;
+            std::size_t offset;
+        };
+    }
+
+    std::string Describe(std::span<const std::byte> stream)
+    {
+        using Command = RecordingCommandList::Command;
+        StreamReader reader(stream);
+        std::string text;
+        auto number = [](auto value) { return std::to_string(value); };
+        auto address = [&reader, &number](const char* range)
+        {
+            const std::uint32_t rangeNumber = reader.Read<std::uint32_t>();
+            return range + (" " + number(rangeNumber)) + " + " + number(reader.Read<std::uint64_t>());
+        };
+        while (!reader.AtEnd())
+        {
+            switch (static_cast<Command>(reader.Read<std::uint8_t>()))
+            {
+            case Command::SetPipelineState:
+                text += "SetPipelineState(pipeline state " + number(reader.Read<std::uint32_t>()) + ")";
+                break;
+            case Command::SetGraphicsRootSignature:
+                text += "SetGraphicsRootSignature(root signature " + number(reader.Read<std::uint32_t>()) + ")";
+                break;
+            case Command::SetGraphicsRootConstantBufferView:
+            {
+                const std::uint32_t rootParameterIndex = reader.Read<std::uint32_t>();
+                text += "SetGraphicsRootConstantBufferView(" + number(rootParameterIndex) + ", " + address("buffer") + ")";
+                break;
+            }
+            case Command::SetGraphicsRootShaderResourceView:
+            {
+                const std::uint32_t rootParameterIndex = reader.Read<std::uint32_t>();
+                text += "SetGraphicsRootShaderResourceView(" + number(rootParameterIndex) + ", " + address("buffer") + ")";
+                break;
+            }
+            case Command::SetGraphicsRootDescriptorTable:
+            {
+                const std::uint32_t rootParameterIndex = reader.Read<std::uint32_t>();
+                text += "SetGraphicsRootDescriptorTable(" + number(rootParameterIndex) + ", " + address("descriptors") + ")";
+                break;
+            }
+            case Command::SetDescriptorHeaps:
+            {
+                const std::uint32_t descriptorHeapCount = reader.Read<std::uint32_t>();
+                text += "SetDescriptorHeaps(";
+                for (std::uint32_t heapIndex = 0; heapIndex < descriptorHeapCount; ++heapIndex)
+                    text += (heapIndex > 0 ? ", heap " : "heap ") + number(reader.Read<std::uint32_t>());
+                text += ")";
+                break;
+            }
+            case Command::IASetVertexBuffers:
+            {
+                const std::uint32_t startSlot = reader.Read<std::uint32_t>();
+                const std::uint32_t viewCount = reader.Read<std::uint32_t>();
+                text += "IASetVertexBuffers(" + number(startSlot);
+                for (std::uint32_t viewIndex = 0; viewIndex < viewCount; ++viewIndex)
+                {
+                    const std::string bufferLocation = address("buffer");
+                    const std::uint32_t sizeInBytes = reader.Read<std::uint32_t>();
+                    text += ", {" + bufferLocation + ", " + number(sizeInBytes) + ", " + number(reader.Read<std::uint32_t>()) + "}";
+                }
+                text += ")";
+                break;
+            }
+            case Command::IASetIndexBuffer:
+            {
+                const std::string bufferLocation = address("buffer");
+                const std::uint32_t sizeInBytes = reader.Read<std::uint32_t>();
+                text += "IASetIndexBuffer({" + bufferLocation + ", " + number(sizeInBytes) + ", "
+                    + (reader.Read<IndexFormat>() == IndexFormat::Uint16 ? "16 bit" : "32 bit") + "})";
+                break;
+            }
+            case Command::IASetPrimitiveTopology:
+                text += "IASetPrimitiveTopology(" + number(static_cast<std::uint32_t>(reader.Read<PrimitiveTopology>())) + ")";
+                break;
+            case Command::OMSetStencilRef:
+                text += "OMSetStencilRef(" + number(reader.Read<std::uint32_t>()) + ")";
+                break;
+            case Command::DrawIndexedInstanced:
+            {
+                const std::uint32_t indexCountPerInstance = reader.Read<std::uint32_t>();
+                const std::uint32_t instanceCount = reader.Read<std::uint32_t>();
+                const std::uint32_t startIndexLocation = reader.Read<std::uint32_t>();
+                const std::int32_t baseVertexLocation = reader.Read<std::int32_t>();
+                const std::uint32_t startInstanceLocation = reader.Read<std::uint32_t>();
+                text += "DrawIndexedInstanced(" + number(indexCountPerInstance) + ", " + number(instanceCount) + ", "
+                    + number(startIndexLocation) + ", " + number(baseVertexLocation) + ", " + number(startInstanceLocation) + ")";
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown command in command stream");
+            }
+            text += "\n";
+        }
+        return text;
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Rhi.h"
+
+namespace Rhi
+{
+    // Serialises every command into a byte stream in memory instead of submitting it anywhere, for running
+    // frames without a GPU. Objects are written as the order in which the stream first used them, not as
+    // their addresses, and so are GPU addresses and descriptor handles, as the buffer or descriptors they
+    // point into and their offset from its start, so that streams recorded by different runs or builds
+    // compare byte for byte.
+    class RecordingCommandList final : public CommandList
+    {
+    public:
+        enum class Command : std::uint8_t
+        {
+            SetPipelineState, SetGraphicsRootSignature, SetGraphicsRootConstantBufferView, SetGraphicsRootShaderResourceView,
+            SetGraphicsRootDescriptorTable, SetDescriptorHeaps, IASetVertexBuffers, IASetIndexBuffer, IASetPrimitiveTopology,
+            OMSetStencilRef, DrawIndexedInstanced
+        };
+
+        void SetPipelineState(PipelineState* pipelineState) override;
+        void SetGraphicsRootSignature(RootSignature* rootSignature) override;
+        void SetGraphicsRootConstantBufferView(std::uint32_t rootParameterIndex, GpuAddress bufferLocation) override;
+        void SetGraphicsRootShaderResourceView(std::uint32_t rootParameterIndex, GpuAddress bufferLocation) override;
+        void SetGraphicsRootDescriptorTable(std::uint32_t rootParameterIndex, DescriptorHandle baseDescriptor) override;
+        void SetDescriptorHeaps(std::uint32_t descriptorHeapCount, DescriptorHeap* const* descriptorHeaps) override;
+        void IASetVertexBuffers(std::uint32_t startSlot, std::uint32_t viewCount, const VertexBufferView* views) override;
+        void IASetIndexBuffer(const IndexBufferView* view) override;
+        void IASetPrimitiveTopology(PrimitiveTopology primitiveTopology) override;
+        void OMSetStencilRef(std::uint32_t stencilReference) override;
+        void DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+            std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation) override;
+
+        // Makes addresses within the size bytes of a buffer from begin written as the buffer and their offset
+        // into it. Buffers must not overlap; any address outside of them is written as a buffer of its own.
+        void AddBuffer(GpuAddress begin, std::uint64_t size);
+        // Likewise for the handles within the size bytes of the descriptors of a heap from begin.
+        void AddDescriptors(DescriptorHandle begin, std::uint64_t size);
+
+        std::span<const std::byte> Stream() const { return stream; }
+        std::size_t CommandCount() const { return commandCount; }
+        // Empties the stream, keeping its memory and the numbering of the objects it has seen.
+        void Clear();
+
+    private:
+        // Numbers the ranges of addresses a stream uses by the order in which it first used them.
+        class AddressNumbering
+        {
+        public:
+            void Add(std::uint64_t begin, std::uint64_t size);
+            // The number of the range holding address and the offset of address into it.
+            std::pair<std::uint32_t, std::uint64_t> Find(std::uint64_t address);
+
+        private:
+            struct Range
+            {
+                std::uint64_t begin;
+                std::uint64_t size;
+                std::uint32_t number;
+            };
+            // Sorted by begin, never overlapping.
+            std::vector<Range> ranges;
+            std::uint32_t usedCount = 0;
+        };
+
+        std::vector<std::byte> stream;
+        std::size_t commandCount = 0;
+        std::vector<const void*> objects;
+        AddressNumbering buffers;
+        AddressNumbering descriptors;
+
+        void Write(Command command);
+        template<typename T>
+        void Write(const T& value);
+        void WriteObject(const void* object);
+        void WriteAddress(std::uint64_t address, AddressNumbering& numbering);
+    };
+
+    // One line per command of a recorded stream, for reading and diffing streams. Throws
+    // std::runtime_error when the stream ends in the middle of a command or holds an unknown one.
+    std::string Describe(std::span<const std::byte> stream);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+
+// Render hardware interface: the commands frames are recorded with, free of any graphics API so that
+// recording runs, and can be measured and compared, without a GPU. D3D12CommandList records them into a
+// D3D12 command list, RecordingCommandList serialises them to memory. Values mirror their D3D12
+// counterparts, so that backends pass them on unchanged.
+namespace Rhi
+{
+    // Opaque objects of the backend, never dereferenced through these types.
+    struct PipelineState;
+    struct RootSignature;
+    struct DescriptorHeap;
+
+    using GpuAddress = std::uint64_t;
+
+    struct DescriptorHandle
+    {
+        std::uint64_t ptr;
+    };
+
+    struct VertexBufferView
+    {
+        GpuAddress bufferLocation;
+        std::uint32_t sizeInBytes;
+        std::uint32_t strideInBytes;
+    };
+
+    enum class IndexFormat : std::uint32_t
+    {
+        Uint32 = 42, Uint16 = 57
+    };
+
+    struct IndexBufferView
+    {
+        GpuAddress bufferLocation;
+        std::uint32_t sizeInBytes;
+        IndexFormat format;
+    };
+
+    enum class PrimitiveTopology : std::uint32_t
+    {
+        Undefined = 0, PointList = 1, LineList = 2, LineStrip = 3, TriangleList = 4, TriangleStrip = 5
+    };
+
+    class CommandList
+    {
+    public:
+        virtual ~CommandList() = default;
+
+        virtual void SetPipelineState(PipelineState* pipelineState) = 0;
+        virtual void SetGraphicsRootSignature(RootSignature* rootSignature) = 0;
+        virtual void SetGraphicsRootConstantBufferView(std::uint32_t rootParameterIndex, GpuAddress bufferLocation) = 0;
+        virtual void SetGraphicsRootShaderResourceView(std::uint32_t rootParameterIndex, GpuAddress bufferLocation) = 0;
+        virtual void SetGraphicsRootDescriptorTable(std::uint32_t rootParameterIndex, DescriptorHandle baseDescriptor) = 0;
+        virtual void SetDescriptorHeaps(std::uint32_t descriptorHeapCount, DescriptorHeap* const* descriptorHeaps) = 0;
+        virtual void IASetVertexBuffers(std::uint32_t startSlot, std::uint32_t viewCount, const VertexBufferView* views) = 0;
+        virtual void IASetIndexBuffer(const IndexBufferView* view) = 0;
+        virtual void IASetPrimitiveTopology(PrimitiveTopology primitiveTopology) = 0;
+        virtual void OMSetStencilRef(std::uint32_t stencilReference) = 0;
+        virtual void DrawIndexedInstanced(std::uint32_t indexCountPerInstance, std::uint32_t instanceCount,
+            std::uint32_t startIndexLocation, std::int32_t baseVertexLocation, std::uint32_t startInstanceLocation) = 0;
+    };
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdio>
+
+// Counts the checks that failed, printing each of them, for main to return whether any did.
+inline int failedCheckCount = 0;
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::fprintf(stderr, "%s(%d): check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++failedCheckCount; \
+        } \
+    } while (false)
+
+inline int CheckResult()
+{
+    if (failedCheckCount > 0)
+        std::fprintf(stderr, "%d checks failed\n", failedCheckCount);
+    return failedCheckCount > 0 ? 1 : 0;
+}
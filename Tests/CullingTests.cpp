@@ -0,0 +1,49 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "Check.h"
+#include "Culling.h"
+
+using namespace Culling;
+
+int main()
+{
+    // Perspective camera at the origin looking down z, moved a little along x.
+    XMFLOAT4X4 viewProjection{};
+    viewProjection.m[0][0] = 1.3f;
+    viewProjection.m[1][1] = 2.4f;
+    viewProjection.m[2][2] = 1.001f;
+    viewProjection.m[2][3] = 1;
+    viewProjection.m[3][2] = -1.001f;
+    viewProjection.m[3][0] = 0.3f;
+    const Frustum frustum = ExtractFrustum(viewProjection);
+
+    // Every instruction set finds the spheres SphereOutside does, in order, whatever the tail left over
+    // after the last full batch of spheres.
+    std::mt19937 random(9);
+    std::uniform_real_distribution<float> position(-30, 30), radius(0.1f, 5);
+    for (std::size_t sphereCount : { 0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 1003, 100000 })
+    {
+        std::vector<Sphere> spheres(sphereCount);
+        for (Sphere& sphere : spheres)
+            sphere = { { position(random), position(random), position(random) + 20 }, radius(random) };
+        std::vector<std::uint32_t> expected;
+        for (std::uint32_t index = 0; index < sphereCount; ++index)
+            if (!SphereOutside(frustum, spheres[index].centre, spheres[index].radius))
+                expected.push_back(index);
+        CHECK(sphereCount < 1000 || (expected.size() > sphereCount / 10 && expected.size() < sphereCount * 9 / 10));
+
+        std::vector<InstructionSet> instructionSets{ InstructionSet::Scalar, InstructionSet::SSE };
+        if (SupportsAVX2())
+            instructionSets.push_back(InstructionSet::AVX2);
+        for (InstructionSet instructionSet : instructionSets)
+        {
+            std::vector<std::uint32_t> visible(sphereCount);
+            const std::size_t visibleCount = CullSpheres(spheres, frustum, visible, instructionSet);
+            CHECK(visibleCount == expected.size() && std::equal(expected.begin(), expected.end(), visible.begin()));
+        }
+        std::vector<std::uint32_t> visible(sphereCount);
+        CHECK(CullSpheres(spheres, frustum, visible) == expected.size());
+    }
+    return CheckResult();
+}
@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+#include "Check.h"
+#include "HierarchicalDepth.h"
+
+using namespace HierarchicalDepth;
+
+namespace
+{
+    // Nearest and farthest depth of the pixels of the depth buffer, the first level, in the rectangle.
+    DepthRange BruteForceRange(std::span<const DepthRange> texels, std::uint32_t width,
+        std::uint32_t left, std::uint32_t top, std::uint32_t right, std::uint32_t bottom)
+    {
+        DepthRange range{ farDepth, 0 };
+        for (std::uint32_t y = top; y < bottom; ++y)
+            for (std::uint32_t x = left; x < right; ++x)
+            {
+                range.nearest = std::min(range.nearest, texels[y * width + x].nearest);
+                range.farthest = std::max(range.farthest, texels[y * width + x].farthest);
+            }
+        return range;
+    }
+}
+
+int main()
+{
+    std::mt19937 random(5);
+    for (auto [width, height] : { std::pair{ 1280u, 720u }, { 333u, 211u }, { 13u, 7u }, { 5u, 1u }, { 1u, 1u } })
+    {
+        const std::vector<Level> levels = MakeLevels(width, height);
+        CHECK(levels.back().width == 1 && levels.back().height == 1);
+        std::vector<DepthRange> texels(TexelCount(levels));
+        // Blocks of near depth over a noisy far background.
+        for (std::uint32_t y = 0; y < height; ++y)
+            for (std::uint32_t x = 0; x < width; ++x)
+            {
+                const float depth = (x / 37 + y / 23) % 3 == 0 ? 0.3f : (x * 7 + y * 3) % 11 / 11.0f * 0.2f + 0.8f;
+                texels[y * width + x] = { QuantiseDepth(depth), QuantiseDepth(depth) };
+            }
+        BuildPyramid(levels, texels);
+
+        // Every texel of every level holds the range of the pixels it covers, the last of a row or column
+        // also covering those an odd sized level before it left over.
+        for (std::size_t levelIndex = 1; levelIndex < levels.size(); ++levelIndex)
+        {
+            const Level& level = levels[levelIndex];
+            for (std::uint32_t y = 0; y < level.height; ++y)
+                for (std::uint32_t x = 0; x < level.width; ++x)
+                {
+                    const std::uint32_t right = x + 1 == level.width ? width : (x + 1) << levelIndex;
+                    const std::uint32_t bottom = y + 1 == level.height ? height : (y + 1) << levelIndex;
+                    const DepthRange expected = BruteForceRange(texels, width, x << levelIndex, y << levelIndex, right, bottom);
+                    const DepthRange& texel = texels[level.offset + y * level.width + x];
+                    CHECK(texel.nearest == expected.nearest && texel.farthest == expected.farthest);
+                }
+        }
+
+        // Test never finds a rectangle occluded or in front unless every pixel it covers says so, and does
+        // find some of both.
+        std::size_t occludedCount = 0, inFrontCount = 0;
+        std::uniform_int_distribution<std::uint32_t> x(0, width - 1), y(0, height - 1), size(1, 200), depth(0, farDepth);
+        for (int test = 0; test < 20000; ++test)
+        {
+            ScreenRectangle rectangle;
+            rectangle.left = x(random);
+            rectangle.top = y(random);
+            rectangle.right = std::min(width, rectangle.left + size(random));
+            rectangle.bottom = std::min(height, rectangle.top + size(random));
+            const std::uint32_t first = depth(random), second = depth(random);
+            rectangle.depth = { std::min(first, second), std::max(first, second) };
+            const DepthRange covered = BruteForceRange(texels, width, rectangle.left, rectangle.top, rectangle.right, rectangle.bottom);
+            switch (Test(levels, texels, rectangle))
+            {
+            case Visibility::Occluded:
+                CHECK(rectangle.depth.nearest > covered.farthest);
+                ++occludedCount;
+                break;
+            case Visibility::InFront:
+                CHECK(rectangle.depth.farthest < covered.nearest);
+                ++inFrontCount;
+                break;
+            case Visibility::Visible:
+                break;
+            }
+        }
+        CHECK(occludedCount > 0 && inFrontCount > 0);
+    }
+    return CheckResult();
+}
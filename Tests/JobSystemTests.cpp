@@ -0,0 +1,115 @@
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "Check.h"
+#include "JobSystem.h"
+#include "Parallel.h"
+
+using namespace Jobs;
+
+namespace
+{
+    void StressParallelFor(JobSystem& jobSystem)
+    {
+        // Every index is called exactly once.
+        std::vector<std::atomic<int>> calls(10007);
+        jobSystem.ParallelFor(calls.size(), [&](std::size_t index) { calls[index].fetch_add(1, std::memory_order_relaxed); });
+        bool everyIndexOnce = true;
+        for (const std::atomic<int>& callCount : calls)
+            everyIndexOnce = everyIndexOnce && callCount == 1;
+        CHECK(everyIndexOnce);
+
+        // Tasks can run ParallelFor themselves.
+        std::atomic<int> nestedCallCount = 0;
+        jobSystem.ParallelFor(16, [&](std::size_t)
+        {
+            jobSystem.ParallelFor(100, [&](std::size_t) { nestedCallCount.fetch_add(1, std::memory_order_relaxed); });
+        });
+        CHECK(nestedCallCount == 1600);
+
+        // The exception of a task reaches the caller, once the other tasks are done.
+        bool caught = false;
+        try
+        {
+            jobSystem.ParallelFor(1000, [](std::size_t index)
+            {
+                if (index == 500)
+                    throw std::runtime_error("Task failed");
+            });
+        }
+        catch (const std::runtime_error&)
+        {
+            caught = true;
+        }
+        CHECK(caught);
+    }
+
+    void StressDependencies(JobSystem& jobSystem)
+    {
+        // A diamond, submitted in reverse, runs its first job first and its last job last.
+        std::vector<std::size_t> order;
+        std::mutex orderMutex;
+        auto task = [&](std::size_t index)
+        {
+            std::scoped_lock lock(orderMutex);
+            order.push_back(index);
+        };
+        Job first, left, right, last;
+        first.Bind(task, 0);
+        left.Bind(task, 1);
+        right.Bind(task, 2);
+        last.Bind(task, 3);
+        first.Precede(left);
+        first.Precede(right);
+        left.Precede(last);
+        right.Precede(last);
+        Counter counter;
+        for (Job* job : { &last, &right, &left, &first })
+            jobSystem.Submit(*job, counter);
+        jobSystem.Wait(counter);
+        CHECK(order.size() == 4 && order.front() == 0 && order.back() == 3);
+    }
+}
+
+int main()
+{
+    for (unsigned threadCount : { 1u, 2u, 4u, 8u })
+    {
+        JobSystem jobSystem(threadCount);
+        CHECK(jobSystem.ThreadCount() == threadCount);
+        for (int repetition = 0; repetition < 100; ++repetition)
+        {
+            StressParallelFor(jobSystem);
+            StressDependencies(jobSystem);
+        }
+
+        // Threads that are not workers submit through the shared queue.
+        std::atomic<int> externalCallCount = 0;
+        std::thread external([&]
+        {
+            jobSystem.ParallelFor(1000, [&](std::size_t) { externalCallCount.fetch_add(1, std::memory_order_relaxed); });
+        });
+        external.join();
+        CHECK(externalCallCount == 1000);
+
+        // More jobs than a deque holds still all run.
+        std::atomic<int> jobCallCount = 0;
+        auto countCall = [&](std::size_t) { jobCallCount.fetch_add(1, std::memory_order_relaxed); };
+        std::vector<Job> jobs(3 * WorkStealingDeque::capacity);
+        Counter counter;
+        for (Job& job : jobs)
+        {
+            job.Bind(countCall);
+            jobSystem.Submit(job, counter);
+        }
+        jobSystem.Wait(counter);
+        CHECK(jobCallCount == static_cast<int>(jobs.size()));
+    }
+
+    std::atomic<int> sharedCallCount = 0;
+    ParallelFor(100, [&](std::size_t) { sharedCallCount.fetch_add(1, std::memory_order_relaxed); });
+    CHECK(sharedCallCount == 100);
+    return CheckResult();
+}
@@ -0,0 +1,88 @@
+#include <cstring>
+#include <string>
+#include <string_view>
+#include "Check.h"
+#include "MeshTextParser.h"
+
+using namespace MeshTextParser;
+
+namespace
+{
+    // The line Parse reports text malformed on, 0 when it parses.
+    std::size_t ErrorLine(std::string_view text)
+    {
+        try
+        {
+            MeshData mesh;
+            Parse(text, mesh, 1);
+            return 0;
+        }
+        catch (const ParseError& error)
+        {
+            return error.Line();
+        }
+    }
+
+    bool SameMesh(const MeshData& first, const MeshData& second)
+    {
+        return first.vertices.size() == second.vertices.size() && first.indices == second.indices &&
+            std::memcmp(first.vertices.data(), second.vertices.data(), first.vertices.size() * sizeof(PositionNormalUV)) == 0;
+    }
+}
+
+int main()
+{
+    const std::string triangle =
+        "VertexCount: 3\n"
+        "TriangleCount: 1\n"
+        "VertexList (pos, normal)\n"
+        "{\n"
+        "    0 0 0 0 0 -1\n"
+        "    1 0 0 0 0 -1\n"
+        "    0 1.5 0 0 0 -1\n"
+        "}\n"
+        "TriangleList\n"
+        "{\n"
+        "    0 1 2\n"
+        "}\n";
+    MeshData mesh;
+    Parse(triangle, mesh, 1);
+    CHECK(mesh.vertices.size() == 3 && mesh.indices.size() == 3);
+    CHECK(mesh.vertices[2].position.y == 1.5f && mesh.vertices[2].normal.z == -1);
+    CHECK(mesh.indices[0] == 0 && mesh.indices[1] == 1 && mesh.indices[2] == 2);
+
+    // Errors are reported on the line of the record at fault.
+    CHECK(ErrorLine("VertexCount: 3\nTriangleCount: 1\nVertexList\n{\n0 0 0 0 0 0\n0 0 0 0 0 0\n0 0 0 0 0 0\n}\nTriangleList\n{\n0 1 3\n}\n") == 11);
+    CHECK(ErrorLine("VertexCount: 3\nTriangleCount: 1\nVertexList\n{\n0 0 0 0 0 0\n0 0 0 0 0 0 0\n0 0 0 0 0 0\n}\nTriangleList\n{\n0 1 2\n}\n") == 6);
+
+    // Lists packed as tightly as records allow hold the counts they declare.
+    CHECK(ErrorLine("VertexCount: 2\nTriangleCount: 2\nVertexList\n{0 0 0 0 0 0\n0 0 0 0 0 0}\nTriangleList\n{0 1 1\n1 0 0}") == 0);
+
+    // Counts larger than their lists can hold are rejected on their line before anything is sized from
+    // them, rather than failing to allocate.
+    const std::string_view lists = "VertexList\n{\n0 0 0 0 0 0\n0 0 0 0 0 0\n0 0 0 0 0 0\n}\nTriangleList\n{\n0 1 2\n}\n";
+    CHECK(ErrorLine("VertexCount: 3\nTriangleCount: 2000000000\n" + std::string(lists)) == 2);
+    CHECK(ErrorLine("VertexCount: 4000000000\nTriangleCount: 1\n" + std::string(lists)) == 1);
+    // Counts their lists have the room for but not the records still fail, when the records run out.
+    CHECK(ErrorLine("VertexCount: 4\nTriangleCount: 1\nVertexList\n{\n0.000 0.000 0.000 0.000 0.000 0.000\n"
+        "0.000 0.000 0.000 0.000 0.000 0.000\n0.000 0.000 0.000 0.000 0.000 0.000\n}\nTriangleList\n{\n0 1 2\n}\n") != 0);
+    try
+    {
+        ParseHeader("VertexCount: 3\n\nTriangleCount: 2000000000\n" + std::string(lists));
+        CHECK(false);
+    }
+    catch (const ParseError& error)
+    {
+        CHECK(error.Line() == 3);
+    }
+
+    // Texts large enough to be split parse the same on any number of threads.
+    const std::string synthetic = GenerateSyntheticText(100000);
+    CHECK(synthetic.size() >= parallelThreshold);
+    MeshData serial, parallel;
+    Parse(synthetic, serial, 1);
+    Parse(synthetic, parallel, 4);
+    CHECK(serial.indices.size() >= 3 * 100000 && SameMesh(serial, parallel));
+
+    return CheckResult();
+}
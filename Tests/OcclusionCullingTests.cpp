@@ -0,0 +1,103 @@
+#include <cmath>
+#include <numbers>
+#include <numeric>
+#include <random>
+#include <vector>
+#include "Check.h"
+#include "OcclusionCulling.h"
+
+using namespace OcclusionCulling;
+
+namespace
+{
+    constexpr float eyeHeight = 1.7f;
+    // Front face of the wall, which spans x in [-5, 5] and y in [0, 4].
+    constexpr float wallFront = 9.5f;
+    const Box wall{ { 0, 2, 10 }, { 5, 2, 0.5f } };
+
+    // Camera at eye height above the origin looking down z, as XMMatrixLookToLH and XMMatrixPerspectiveFovLH build it.
+    XMFLOAT4X4 ViewProjection()
+    {
+        const float yScale = 1 / std::tan(0.125f * std::numbers::pi_v<float>);
+        const float nearPlane = 0.5f, farPlane = 1000;
+        XMFLOAT4X4 viewProjection{};
+        viewProjection.m[0][0] = yScale / (16.0f / 9);
+        viewProjection.m[1][1] = yScale;
+        viewProjection.m[2][2] = farPlane / (farPlane - nearPlane);
+        viewProjection.m[2][3] = 1;
+        viewProjection.m[3][1] = -eyeHeight * yScale;
+        viewProjection.m[3][2] = -nearPlane * farPlane / (farPlane - nearPlane);
+        return viewProjection;
+    }
+
+    XMFLOAT4X4 Identity()
+    {
+        XMFLOAT4X4 identity{};
+        identity.m[0][0] = identity.m[1][1] = identity.m[2][2] = identity.m[3][3] = 1;
+        return identity;
+    }
+
+    // Whether the wall truly hides the box: the box being convex, it does exactly when every corner is
+    // behind the front face and seen through it.
+    bool HiddenByWall(const Box& box)
+    {
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            const float x = box.centre.x + (corner & 1 ? box.extents.x : -box.extents.x);
+            const float y = box.centre.y + (corner & 2 ? box.extents.y : -box.extents.y);
+            const float z = box.centre.z + (corner & 4 ? box.extents.z : -box.extents.z);
+            if (z <= wallFront)
+                return false;
+            const float t = wallFront / z;
+            const float hitX = x * t, hitY = eyeHeight + (y - eyeHeight) * t;
+            if (hitX < -5 || hitX > 5 || hitY < 0 || hitY > 4)
+                return false;
+        }
+        return true;
+    }
+}
+
+int main()
+{
+    const OccluderMesh wallMesh = MakeOccluderMesh(wall);
+    const Occluder occluder{ &wallMesh, Identity() };
+    DepthBuffer depth;
+    depth.Rasterise({ &occluder, 1 }, ViewProjection(), 1);
+
+    // Never culls a box that is not hidden, yet culls most of those that are, the rest being
+    // those whose edges fall on pixels the wall only partly covers.
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> x(-8, 8), y(0, 6), z(5, 30), extent(0.05f, 1.5f);
+    std::vector<Box> boxes(50000);
+    for (Box& box : boxes)
+        box = { { x(random), y(random), z(random) }, { extent(random), extent(random), extent(random) } };
+    std::size_t hiddenCount = 0, occludedCount = 0;
+    for (const Box& box : boxes)
+    {
+        const bool hidden = HiddenByWall(box);
+        const bool occluded = depth.Occluded(box);
+        CHECK(!occluded || hidden);
+        hiddenCount += hidden;
+        occludedCount += occluded;
+    }
+    CHECK(occludedCount * 2 > hiddenCount);
+
+    // Boxes crossing the near plane or outside the screen are never occluded.
+    CHECK(!depth.Occluded({ { 0, eyeHeight, 0.5f }, { 0.2f, 0.2f, 0.2f } }));
+    CHECK(!depth.Occluded({ { 0, eyeHeight, -20 }, { 1, 1, 1 } }));
+    CHECK(!depth.Occluded({ { 200, eyeHeight, 20 }, { 1, 1, 1 } }));
+
+    // Rasterising on several threads gives the same depths, and CullBoxes agrees with Occluded.
+    DepthBuffer parallelDepth;
+    parallelDepth.Rasterise({ &occluder, 1 }, ViewProjection(), 4);
+    for (std::uint32_t pixelY = 0; pixelY < depthHeight; ++pixelY)
+        for (std::uint32_t pixelX = 0; pixelX < depthWidth; ++pixelX)
+            CHECK(parallelDepth.Depth(pixelX, pixelY) == depth.Depth(pixelX, pixelY));
+    std::vector<std::uint32_t> visible(boxes.size());
+    std::iota(visible.begin(), visible.end(), 0);
+    const std::size_t visibleCount = parallelDepth.CullBoxes(boxes, visible, 4);
+    CHECK(visibleCount == boxes.size() - occludedCount);
+    for (std::size_t index = 0; index < visibleCount; ++index)
+        CHECK(!depth.Occluded(boxes[visible[index]]) && (index == 0 || visible[index - 1] < visible[index]));
+    return CheckResult();
+}
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include "Check.h"
+#include "DrawRecording.h"
+#include "FilteredCommandList.h"
+#include "RecordingCommandList.h"
+
+using namespace Rhi;
+
+namespace
+{
+    // Where one run of the program happens to have its objects, buffers and descriptors.
+    struct Run
+    {
+        std::uint64_t objects[3];
+        GpuAddress bufferBase;
+        std::uint64_t descriptorBase;
+    };
+
+    constexpr std::uint64_t meshBufferSize = 0x10000, instanceBufferSize = 0x100000, descriptorsSize = 0x1000;
+
+    // Records a frame of draws of four meshes sharing two pipeline states, the way the renderer does.
+    std::vector<std::byte> RecordFrame(Run& run)
+    {
+        PipelineState* opaque = reinterpret_cast<PipelineState*>(&run.objects[0]);
+        PipelineState* transparent = reinterpret_cast<PipelineState*>(&run.objects[1]);
+        RootSignature* rootSignature = reinterpret_cast<RootSignature*>(&run.objects[2]);
+        const GpuAddress instanceBuffer = run.bufferBase + 8 * meshBufferSize;
+        RecordingCommandList recording;
+        for (std::uint32_t buffer = 0; buffer < 8; ++buffer)
+            recording.AddBuffer(run.bufferBase + buffer * meshBufferSize, meshBufferSize);
+        recording.AddBuffer(instanceBuffer, instanceBufferSize);
+        recording.AddDescriptors({ run.descriptorBase }, descriptorsSize);
+
+        std::vector<DrawRecording::DrawPacket> packets;
+        for (std::uint32_t draw = 0; draw < 32; ++draw)
+        {
+            const std::uint32_t mesh = draw / 8;
+            packets.push_back({ draw * 256ull, { run.bufferBase + mesh * meshBufferSize, 0x4000, 32 },
+                { run.bufferBase + (4 + mesh) * meshBufferSize + draw % 2 * 64, 0x100, IndexFormat::Uint16 }, 36, 2, 0, 0 });
+        }
+        FilteredCommandList filtered;
+        filtered.Begin(recording, opaque);
+        filtered.SetGraphicsRootSignature(rootSignature);
+        filtered.SetGraphicsRootDescriptorTable(2, { run.descriptorBase + 64 });
+        filtered.SetGraphicsRootConstantBufferView(0, run.bufferBase + 12 * meshBufferSize);
+        filtered.IASetPrimitiveTopology(PrimitiveTopology::TriangleList);
+        DrawRecording::Record(filtered, std::span(packets).first(16), instanceBuffer);
+        filtered.SetPipelineState(transparent);
+        DrawRecording::Record(filtered, std::span(packets).subspan(16), instanceBuffer);
+        return { recording.Stream().begin(), recording.Stream().end() };
+    }
+}
+
+int main()
+{
+    // Runs whose objects, buffers and descriptors all lie elsewhere record the same bytes.
+    Run first{ {}, 0x10000000, 0x400000 };
+    Run second{ {}, 0x7FF000000, 0x9A0000 };
+    const std::vector<std::byte> firstStream = RecordFrame(first);
+    const std::vector<std::byte> secondStream = RecordFrame(second);
+    CHECK(!firstStream.empty() && firstStream == secondStream);
+    CHECK(Describe(firstStream) == Describe(secondStream));
+
+    // Addresses are described as the buffer or descriptors they point into and their offset, numbered by
+    // first use, and addresses outside of every registered range each as a range of their own.
+    RecordingCommandList recording;
+    recording.AddBuffer(0x5000, 0x1000);
+    recording.AddBuffer(0x1000, 0x1000);
+    recording.AddDescriptors({ 0x80 }, 0x100);
+    const VertexBufferView vertexBufferView{ 0x1040, 0x100, 32 };
+    const IndexBufferView indexBufferView{ 0x5010, 0x20, IndexFormat::Uint32 };
+    recording.IASetVertexBuffers(0, 1, &vertexBufferView);
+    recording.IASetIndexBuffer(&indexBufferView);
+    recording.SetGraphicsRootShaderResourceView(1, 0x1000);
+    recording.SetGraphicsRootConstantBufferView(0, 0x9000);
+    recording.SetGraphicsRootDescriptorTable(2, { 0xA0 });
+    recording.DrawIndexedInstanced(8, 1, 0, -4, 0);
+    CHECK(recording.CommandCount() == 6);
+    CHECK(Describe(recording.Stream()) ==
+        "IASetVertexBuffers(0, {buffer 0 + 64, 256, 32})\n"
+        "IASetIndexBuffer({buffer 1 + 16, 32, 32 bit})\n"
+        "SetGraphicsRootShaderResourceView(1, buffer 0 + 0)\n"
+        "SetGraphicsRootConstantBufferView(0, buffer 2 + 0)\n"
+        "SetGraphicsRootDescriptorTable(2, descriptors 0 + 32)\n"
+        "DrawIndexedInstanced(8, 1, 0, -4, 0)\n");
+
+    // Clearing keeps the numbering, and a stream cut short is not described.
+    recording.Clear();
+    recording.SetGraphicsRootConstantBufferView(0, 0x9000);
+    CHECK(Describe(recording.Stream()) == "SetGraphicsRootConstantBufferView(0, buffer 2 + 0)\n");
+    bool threw = false;
+    try
+    {
+        Describe(recording.Stream().first(recording.Stream().size() - 1));
+    }
+    catch (const std::runtime_error&)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+    return CheckResult();
+}
@@ -56,6 +56,15 @@ float NormalizedToUnsignedNormalized(float number)
     return number * 0.5 + 0.5;
 }
 
+// Inverse of the octahedral normal encoding in VertexCompression.cpp, from snorm components in [-1, 1].
+float3 DecodeOctahedral(float2 encoded)
+{
+    float3 normal = float3(encoded, 1 - abs(encoded.x) - abs(encoded.y));
+    float fold = saturate(-normal.z);
+    normal.xy += normal.xy >= 0 ? -fold : fold;
+    return normalize(normal);
+}
+
 float3 NormalizedFromTo(float3 from, float3 to, out float fromToLength)
 {
     float3 fromTo = to - from;
@@ -0,0 +1,168 @@
+#include "VertexCompression.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace VertexCompression
+{
+    namespace
+    {
+        constexpr float positionSteps = 65535;
+        constexpr float normalSteps = 32767;
+        // Largest angle between a unit normal and the decode of its best octahedral snorm16 encoding,
+        // measured over a dense sphere sampling and rounded up.
+        constexpr float octahedralNormalBound = 5e-5f;
+
+        std::uint16_t QuantiseUnsigned(float value, float offset, float scale)
+        {
+            const float normalised = scale > 0 ? (value - offset) / scale : 0;
+            return static_cast<std::uint16_t>(std::lround(std::clamp(normalised, 0.0f, 1.0f) * positionSteps));
+        }
+
+        float DequantiseSigned(std::int16_t value)
+        {
+            return std::max(value / normalSteps, -1.0f);
+        }
+
+        XMFLOAT3 Normalised(XMFLOAT3 vector)
+        {
+            const float length = std::sqrt(vector.x * vector.x + vector.y * vector.y + vector.z * vector.z);
+            return length > 0 ? XMFLOAT3{ vector.x / length, vector.y / length, vector.z / length } : XMFLOAT3{ 0, 0, 1 };
+        }
+
+        // Same decode as DecodeOctahedral in Utility.hlsli.
+        XMFLOAT3 DecodeOctahedral(float x, float y)
+        {
+            XMFLOAT3 normal{ x, y, 1 - std::fabs(x) - std::fabs(y) };
+            const float fold = std::max(-normal.z, 0.0f);
+            normal.x += normal.x >= 0 ? -fold : fold;
+            normal.y += normal.y >= 0 ? -fold : fold;
+            return Normalised(normal);
+        }
+
+        // Through the cross product rather than acos, which cannot resolve angles this small in float.
+        float Angle(XMFLOAT3 first, XMFLOAT3 second)
+        {
+            const float crossX = first.y * second.z - first.z * second.y;
+            const float crossY = first.z * second.x - first.x * second.z;
+            const float crossZ = first.x * second.y - first.y * second.x;
+            const float cosine = first.x * second.x + first.y * second.y + first.z * second.z;
+            return std::atan2(std::sqrt(crossX * crossX + crossY * crossY + crossZ * crossZ), cosine);
+        }
+
+        // Projects the normal onto the octahedron and unfolds the lower half over the upper one, then
+        // keeps whichever of the four surrounding snorm16 grid points decodes closest to it.
+        void EncodeOctahedral(XMFLOAT3 normal, std::int16_t encoded[2])
+        {
+            normal = Normalised(normal);
+            const float manhattanLength = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+            float x = normal.x / manhattanLength, y = normal.y / manhattanLength;
+            if (normal.z < 0)
+            {
+                const float foldedX = (1 - std::fabs(y)) * (x >= 0 ? 1 : -1);
+                const float foldedY = (1 - std::fabs(x)) * (y >= 0 ? 1 : -1);
+                x = foldedX;
+                y = foldedY;
+            }
+            const float floorX = std::floor(std::clamp(x, -1.0f, 1.0f) * normalSteps);
+            const float floorY = std::floor(std::clamp(y, -1.0f, 1.0f) * normalSteps);
+            float bestAngle = std::numeric_limits<float>::max();
+            for (std::uint32_t candidate = 0; candidate < 4; ++candidate)
+            {
+                const std::int16_t candidateX = static_cast<std::int16_t>(std::clamp(floorX + (candidate & 1), -normalSteps, normalSteps));
+                const std::int16_t candidateY = static_cast<std::int16_t>(std::clamp(floorY + (candidate >> 1), -normalSteps, normalSteps));
+                const float angle = Angle(normal, DecodeOctahedral(DequantiseSigned(candidateX), DequantiseSigned(candidateY)));
+                if (angle < bestAngle)
+                {
+                    bestAngle = angle;
+                    encoded[0] = candidateX;
+                    encoded[1] = candidateY;
+                }
+            }
+        }
+
+        float HalfUlp(float value)
+        {
+            // Spacing of half floats around value, with the 10 bit mantissa; subnormals share the
+            // spacing of the smallest normal exponent.
+            int exponent;
+            std::frexp(std::fabs(value), &exponent);
+            return std::ldexp(1.0f, std::max(exponent, -13) - 11);
+        }
+    }
+
+    Dequantisation ComputeDequantisation(std::span<const PositionNormalUV> vertices)
+    {
+        if (vertices.empty())
+            return { { 1, 1, 1 }, { 0, 0, 0 } };
+        XMFLOAT3 minimum = vertices[0].position, maximum = minimum;
+        for (const PositionNormalUV& vertex : vertices)
+        {
+            minimum = { std::min(minimum.x, vertex.position.x), std::min(minimum.y, vertex.position.y), std::min(minimum.z, vertex.position.z) };
+            maximum = { std::max(maximum.x, vertex.position.x), std::max(maximum.y, vertex.position.y), std::max(maximum.z, vertex.position.z) };
+        }
+        return { { maximum.x - minimum.x, maximum.y - minimum.y, maximum.z - minimum.z }, minimum };
+    }
+
+    PackedPositionNormalUV Encode(const PositionNormalUV& vertex, const Dequantisation& dequantisation)
+    {
+        PackedPositionNormalUV packed;
+        packed.position[0] = QuantiseUnsigned(vertex.position.x, dequantisation.offset.x, dequantisation.scale.x);
+        packed.position[1] = QuantiseUnsigned(vertex.position.y, dequantisation.offset.y, dequantisation.scale.y);
+        packed.position[2] = QuantiseUnsigned(vertex.position.z, dequantisation.offset.z, dequantisation.scale.z);
+        packed.position[3] = 0;
+        EncodeOctahedral(vertex.normal, packed.normal);
+        packed.uv[0] = PackedVector::XMConvertFloatToHalf(vertex.uv.x);
+        packed.uv[1] = PackedVector::XMConvertFloatToHalf(vertex.uv.y);
+        return packed;
+    }
+
+    PositionNormalUV Decode(const PackedPositionNormalUV& vertex, const Dequantisation& dequantisation)
+    {
+        PositionNormalUV decoded;
+        decoded.position =
+        {
+            dequantisation.offset.x + dequantisation.scale.x * (vertex.position[0] / positionSteps),
+            dequantisation.offset.y + dequantisation.scale.y * (vertex.position[1] / positionSteps),
+            dequantisation.offset.z + dequantisation.scale.z * (vertex.position[2] / positionSteps)
+        };
+        decoded.normal = DecodeOctahedral(DequantiseSigned(vertex.normal[0]), DequantiseSigned(vertex.normal[1]));
+        decoded.uv = { PackedVector::XMConvertHalfToFloat(vertex.uv[0]), PackedVector::XMConvertHalfToFloat(vertex.uv[1]) };
+        return decoded;
+    }
+
+    ErrorBounds Encode(std::span<const PositionNormalUV> source, const Dequantisation& dequantisation,
+        std::span<PackedPositionNormalUV> destination)
+    {
+        ErrorBounds measured{};
+        for (std::size_t vertexIndex = 0; vertexIndex < source.size(); ++vertexIndex)
+        {
+            const PositionNormalUV& vertex = source[vertexIndex];
+            const PackedPositionNormalUV packed = Encode(vertex, dequantisation);
+            destination[vertexIndex] = packed;
+            const PositionNormalUV decoded = Decode(packed, dequantisation);
+            measured.position = std::max({ measured.position, std::fabs(decoded.position.x - vertex.position.x),
+                std::fabs(decoded.position.y - vertex.position.y), std::fabs(decoded.position.z - vertex.position.z) });
+            measured.normal = std::max(measured.normal, Angle(decoded.normal, Normalised(vertex.normal)));
+            measured.uv = std::max({ measured.uv, std::fabs(decoded.uv.x - vertex.uv.x), std::fabs(decoded.uv.y - vertex.uv.y) });
+        }
+        return measured;
+    }
+
+    ErrorBounds GuaranteedBounds(std::span<const PositionNormalUV> vertices, const Dequantisation& dequantisation)
+    {
+        float largestUV = 0;
+        for (const PositionNormalUV& vertex : vertices)
+            largestUV = std::max({ largestUV, std::fabs(vertex.uv.x), std::fabs(vertex.uv.y) });
+        const float largestScale = std::max({ dequantisation.scale.x, dequantisation.scale.y, dequantisation.scale.z });
+        // The float arithmetic of the decode adds a few ulps of the largest coordinate on top of the quantisation.
+        const float largestCoordinate = std::max({ std::fabs(dequantisation.offset.x), std::fabs(dequantisation.offset.y),
+            std::fabs(dequantisation.offset.z) }) + largestScale;
+        return
+        {
+            0.5f * largestScale / positionSteps + 4 * largestCoordinate * std::numeric_limits<float>::epsilon(),
+            octahedralNormalBound,
+            0.5f * HalfUlp(largestUV)
+        };
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <span>
+#include <DirectXPackedVector.h>
+#include "MeshData.h"
+
+// Packed alternative to PositionNormalUV, half its size:
+//     position   R16G16B16A16_UNORM  relative to the mesh bounding box, w unused
+//     normal     R16G16_SNORM        octahedral encoding of the unit normal
+//     uv         R16G16_FLOAT
+// Positions are decoded in the vertex shader as offset + scale * position, from the mesh Dequantisation.
+namespace VertexCompression
+{
+    struct PackedPositionNormalUV
+    {
+        std::uint16_t position[4];
+        std::int16_t normal[2];
+        PackedVector::HALF uv[2];
+    };
+
+    static_assert(sizeof(PackedPositionNormalUV) == sizeof(PositionNormalUV) / 2);
+
+    struct Dequantisation
+    {
+        XMFLOAT3 scale;
+        XMFLOAT3 offset;
+    };
+
+    // Largest absolute error of a decoded vertex: position in mesh units along any axis, normal as the
+    // angle in radians to the source normal (normalised) and uv per component.
+    struct ErrorBounds
+    {
+        float position;
+        float normal;
+        float uv;
+    };
+
+    // Maps the bounding box of the positions onto the full unsigned 16 bit range of every axis.
+    Dequantisation ComputeDequantisation(std::span<const PositionNormalUV> vertices);
+    PackedPositionNormalUV Encode(const PositionNormalUV& vertex, const Dequantisation& dequantisation);
+    PositionNormalUV Decode(const PackedPositionNormalUV& vertex, const Dequantisation& dequantisation);
+    // Encodes every vertex of source into destination, which may be write combined memory, and
+    // returns the errors measured by decoding them again.
+    ErrorBounds Encode(std::span<const PositionNormalUV> source, const Dequantisation& dequantisation,
+        std::span<PackedPositionNormalUV> destination);
+    // Errors no encoded vertex exceeds: half a quantisation step for positions, the worst case of the
+    // octahedral snorm16 grid for normals and half a half float ulp at the largest uv for uvs.
+    ErrorBounds GuaranteedBounds(std::span<const PositionNormalUV> vertices, const Dequantisation& dequantisation);
+}